@@ -0,0 +1,574 @@
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BCN_SSE2
+#endif
+
+#include "bcn_encoder.hpp"
+
+namespace {
+
+// The 16 pixels of a block, one row of 16 values per channel so 8 pixels fit a SIMD register
+struct Block {
+	int16_t channels[4][16];
+};
+
+// Interpolation weights of BC7 4-bit indices, out of 64
+const int bc7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/**
+ * @brief Finds the nearest palette entry of every pixel, squared distance over the 4 channels, the first one on ties.
+ * Channels that don't matter must be 0 in both the block and the palette.
+ * @return int The sum of the squared distances.
+ */
+
+int nearestIndices(const Block & block, const int palette[][4], int count, uint8_t out_indices[16]) {
+	int error = 0;
+#ifdef BCN_SSE2
+	for (int half = 0; half < 2; half++) {
+		__m128i r = _mm_loadu_si128((const __m128i *)&block.channels[0][half * 8]);
+		__m128i g = _mm_loadu_si128((const __m128i *)&block.channels[1][half * 8]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&block.channels[2][half * 8]);
+		__m128i a = _mm_loadu_si128((const __m128i *)&block.channels[3][half * 8]);
+		__m128i bestLow = _mm_set1_epi32(INT_MAX), bestHigh = bestLow;
+		__m128i indexLow = _mm_setzero_si128(), indexHigh = indexLow;
+
+		for (int e = 0; e < count; e++) {
+			__m128i dr = _mm_sub_epi16(r, _mm_set1_epi16((int16_t)palette[e][0]));
+			__m128i dg = _mm_sub_epi16(g, _mm_set1_epi16((int16_t)palette[e][1]));
+			__m128i db = _mm_sub_epi16(b, _mm_set1_epi16((int16_t)palette[e][2]));
+			__m128i da = _mm_sub_epi16(a, _mm_set1_epi16((int16_t)palette[e][3]));
+
+			// Interleaved pairs of channels, madd squares and sums them into 32 bits per pixel
+			__m128i rg = _mm_unpacklo_epi16(dr, dg), ba = _mm_unpacklo_epi16(db, da);
+			__m128i distanceLow = _mm_add_epi32(_mm_madd_epi16(rg, rg), _mm_madd_epi16(ba, ba));
+			rg = _mm_unpackhi_epi16(dr, dg);
+			ba = _mm_unpackhi_epi16(db, da);
+			__m128i distanceHigh = _mm_add_epi32(_mm_madd_epi16(rg, rg), _mm_madd_epi16(ba, ba));
+
+			__m128i entry = _mm_set1_epi32(e);
+			__m128i closer = _mm_cmplt_epi32(distanceLow, bestLow);
+			bestLow = _mm_or_si128(_mm_and_si128(closer, distanceLow), _mm_andnot_si128(closer, bestLow));
+			indexLow = _mm_or_si128(_mm_and_si128(closer, entry), _mm_andnot_si128(closer, indexLow));
+			closer = _mm_cmplt_epi32(distanceHigh, bestHigh);
+			bestHigh = _mm_or_si128(_mm_and_si128(closer, distanceHigh), _mm_andnot_si128(closer, bestHigh));
+			indexHigh = _mm_or_si128(_mm_and_si128(closer, entry), _mm_andnot_si128(closer, indexHigh));
+		}
+
+		int32_t best[8], index[8];
+		_mm_storeu_si128((__m128i *)&best[0], bestLow);
+		_mm_storeu_si128((__m128i *)&best[4], bestHigh);
+		_mm_storeu_si128((__m128i *)&index[0], indexLow);
+		_mm_storeu_si128((__m128i *)&index[4], indexHigh);
+		for (int i = 0; i < 8; i++) {
+			out_indices[half * 8 + i] = (uint8_t)index[i];
+			error += best[i];
+		}
+	}
+#else
+	for (int i = 0; i < 16; i++) {
+		int best = INT_MAX;
+		for (int e = 0; e < count; e++) {
+			int distance = 0;
+			for (int c = 0; c < 4; c++) {
+				int d = block.channels[c][i] - palette[e][c];
+				distance += d * d;
+			}
+			if (distance < best) {
+				best = distance;
+				out_indices[i] = (uint8_t)e;
+			}
+		}
+		error += best;
+	}
+#endif
+	return error;
+}
+
+/**
+ * @brief The extremes of the pixels along their principal axis, the first channelCount channels.
+ */
+
+void principalEndpoints(const Block & block, int channelCount, float out_low[4], float out_high[4]) {
+	float mean[4] = {0, 0, 0, 0};
+	float minimum[4] = {255, 255, 255, 255}, maximum[4] = {0, 0, 0, 0};
+	for (int c = 0; c < channelCount; c++) {
+		for (int i = 0; i < 16; i++) {
+			float v = block.channels[c][i];
+			mean[c] += v / 16.0f;
+			minimum[c] = std::min(minimum[c], v);
+			maximum[c] = std::max(maximum[c], v);
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < channelCount; c++) {
+			for (int k = 0; k < channelCount; k++) {
+				covariance[c][k] += (block.channels[c][i] - mean[c]) * (block.channels[k][i] - mean[k]);
+			}
+		}
+	}
+
+	// Power iterations from the diagonal of the bounding box
+	float axis[4] = {0, 0, 0, 0};
+	for (int c = 0; c < channelCount; c++) {
+		axis[c] = maximum[c] - minimum[c];
+	}
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {0, 0, 0, 0};
+		float length = 0.0f;
+		for (int c = 0; c < channelCount; c++) {
+			for (int k = 0; k < channelCount; k++) {
+				next[c] += covariance[c][k] * axis[k];
+			}
+			length = std::max(length, fabsf(next[c]));
+		}
+		if (length < 1e-6f) {
+			break;
+		}
+		for (int c = 0; c < channelCount; c++) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < channelCount; c++) {
+		length += axis[c] * axis[c];
+	}
+	if (length < 1e-12f) {
+		for (int c = 0; c < 4; c++) {
+			out_low[c] = out_high[c] = (c < channelCount) ? mean[c] : 0.0f;
+		}
+		return;
+	}
+
+	float tMin = 1e30f, tMax = -1e30f;
+	for (int i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (int c = 0; c < channelCount; c++) {
+			t += (block.channels[c][i] - mean[c]) * axis[c];
+		}
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+	for (int c = 0; c < 4; c++) {
+		out_low[c] = (c < channelCount) ? std::min(std::max(mean[c] + axis[c] * tMin / length, 0.0f), 255.0f) : 0.0f;
+		out_high[c] = (c < channelCount) ? std::min(std::max(mean[c] + axis[c] * tMax / length, 0.0f), 255.0f) : 0.0f;
+	}
+}
+
+/**
+ * @brief Endpoints that minimize the squared error of pixels interpolated as (1 - w) * first + w * second.
+ * @return bool False if the weights can't tell the endpoints apart.
+ */
+
+bool leastSquaresEndpoints(const Block & block, int channelCount, const float weights[16], float out_first[4], float out_second[4]) {
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		aa += (1.0f - weights[i]) * (1.0f - weights[i]);
+		ab += (1.0f - weights[i]) * weights[i];
+		bb += weights[i] * weights[i];
+	}
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < 1e-6f) {
+		return false;
+	}
+
+	for (int c = 0; c < 4; c++) {
+		float xa = 0.0f, xb = 0.0f;
+		if (c < channelCount) {
+			for (int i = 0; i < 16; i++) {
+				xa += (1.0f - weights[i]) * block.channels[c][i];
+				xb += weights[i] * block.channels[c][i];
+			}
+		}
+		out_first[c] = std::min(std::max((bb * xa - ab * xb) / determinant, 0.0f), 255.0f);
+		out_second[c] = std::min(std::max((aa * xb - ab * xa) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+uint16_t packRGB565(const float color[4]) {
+	int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+	int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+	int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, int out_color[4]) {
+	int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+	out_color[0] = (r << 3) | (r >> 2);
+	out_color[1] = (g << 2) | (g >> 4);
+	out_color[2] = (b << 3) | (b >> 2);
+	out_color[3] = 0;
+}
+
+/**
+ * @brief The 4 colors of a BC1 block, 3 colors and black when color0 <= color1.
+ */
+
+void colorPalette(uint16_t color0, uint16_t color1, int out_palette[4][4]) {
+	unpackRGB565(color0, out_palette[0]);
+	unpackRGB565(color1, out_palette[1]);
+	for (int c = 0; c < 4; c++) {
+		if (color0 > color1) {
+			out_palette[2][c] = (2 * out_palette[0][c] + out_palette[1][c]) / 3;
+			out_palette[3][c] = (out_palette[0][c] + 2 * out_palette[1][c]) / 3;
+		} else {
+			out_palette[2][c] = (out_palette[0][c] + out_palette[1][c]) / 2;
+			out_palette[3][c] = 0;
+		}
+	}
+}
+
+/**
+ * @brief A BC1 color block in the 4 color mode, alpha is ignored.
+ */
+
+void encodeColorBlock(const Block & pixels, unsigned char * out) {
+	const float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+	Block block = pixels;
+	memset(block.channels[3], 0, sizeof(block.channels[3]));
+	float first[4], second[4];
+	principalEndpoints(block, 3, second, first);
+
+	int bestError = INT_MAX;
+	uint16_t bestColors[2] = {0, 0};
+	uint8_t bestIndices[16] = {0};
+	for (int pass = 0; pass < 2; pass++) {
+		uint16_t color0 = packRGB565(first), color1 = packRGB565(second);
+		if (color0 < color1) {
+			std::swap(color0, color1);
+		}
+
+		int palette[4][4];
+		colorPalette(color0, color1, palette);
+		uint8_t indices[16];
+		int error = nearestIndices(block, palette, (color0 == color1) ? 1 : 4, indices);
+		if (error < bestError) {
+			bestError = error;
+			bestColors[0] = color0;
+			bestColors[1] = color1;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+		if (error == 0 || color0 == color1) {
+			break;
+		}
+
+		float pixelWeights[16];
+		for (int i = 0; i < 16; i++) {
+			pixelWeights[i] = weights[indices[i]];
+		}
+		if (!leastSquaresEndpoints(block, 3, pixelWeights, first, second)) {
+			break;
+		}
+	}
+
+	out[0] = bestColors[0] & 0xFF;
+	out[1] = bestColors[0] >> 8;
+	out[2] = bestColors[1] & 0xFF;
+	out[3] = bestColors[1] >> 8;
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++) {
+		bits |= (uint32_t)bestIndices[i] << (2 * i);
+	}
+	for (int k = 0; k < 4; k++) {
+		out[4 + k] = (bits >> (8 * k)) & 0xFF;
+	}
+}
+
+/**
+ * @brief The 8 alpha values of a BC3 alpha block, the 8 value mode when alpha0 > alpha1.
+ */
+
+void alphaPalette(int alpha0, int alpha1, int out_palette[8]) {
+	out_palette[0] = alpha0;
+	out_palette[1] = alpha1;
+	if (alpha0 > alpha1) {
+		for (int k = 1; k < 7; k++) {
+			out_palette[k + 1] = ((7 - k) * alpha0 + k * alpha1) / 7;
+		}
+	} else {
+		for (int k = 1; k < 5; k++) {
+			out_palette[k + 1] = ((5 - k) * alpha0 + k * alpha1) / 5;
+		}
+		out_palette[6] = 0;
+		out_palette[7] = 255;
+	}
+}
+
+/**
+ * @brief A BC3 alpha block in the 8 value mode, between the extremes of the alpha of the pixels.
+ */
+
+void encodeAlphaBlock(const Block & pixels, unsigned char * out) {
+	Block block = {};
+	memcpy(block.channels[0], pixels.channels[3], sizeof(block.channels[0]));
+	int alpha0 = *std::max_element(block.channels[0], block.channels[0] + 16);
+	int alpha1 = *std::min_element(block.channels[0], block.channels[0] + 16);
+
+	int values[8];
+	alphaPalette(alpha0, alpha1, values);
+	int palette[8][4] = {};
+	for (int k = 0; k < 8; k++) {
+		palette[k][0] = values[k];
+	}
+	uint8_t indices[16];
+	nearestIndices(block, palette, (alpha0 == alpha1) ? 1 : 8, indices);
+
+	out[0] = (unsigned char)alpha0;
+	out[1] = (unsigned char)alpha1;
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; i++) {
+		bits |= (uint64_t)indices[i] << (3 * i);
+	}
+	for (int k = 0; k < 6; k++) {
+		out[2 + k] = (bits >> (8 * k)) & 0xFF;
+	}
+}
+
+/**
+ * @brief Quantizes a BC7 mode 6 endpoint to 7 bits per channel and the p-bit, shared low bit of the 4 channels, that fits it best.
+ */
+
+void quantizeEndpoint(const float endpoint[4], int out_quantized[4], int & out_pBit) {
+	float bestError = 1e30f;
+	for (int p = 0; p < 2; p++) {
+		int quantized[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++) {
+			quantized[c] = std::min(std::max((int)floorf((endpoint[c] - p) / 2.0f + 0.5f), 0), 127);
+			float d = (float)((quantized[c] << 1) | p) - endpoint[c];
+			error += d * d;
+		}
+		if (error < bestError) {
+			bestError = error;
+			memcpy(out_quantized, quantized, sizeof(quantized));
+			out_pBit = p;
+		}
+	}
+}
+
+// Writes the bits of a 128-bit block from the lowest
+struct BitWriter {
+	unsigned char * out;
+	int position = 0;
+
+	void write(uint32_t value, int count) {
+		for (int k = 0; k < count; k++, position++) {
+			out[position >> 3] |= ((value >> k) & 1) << (position & 7);
+		}
+	}
+};
+
+struct BitReader {
+	const unsigned char * in;
+	int position = 0;
+
+	uint32_t read(int count) {
+		uint32_t value = 0;
+		for (int k = 0; k < count; k++, position++) {
+			value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << k;
+		}
+		return value;
+	}
+};
+
+/**
+ * @brief A BC7 block in mode 6.
+ */
+
+void encodeBC7Block(const Block & block, unsigned char * out) {
+	float first[4], second[4];
+	principalEndpoints(block, 4, first, second);
+
+	int bestError = INT_MAX;
+	int bestEndpoints[2][4] = {}, bestPBits[2] = {0, 0};
+	uint8_t bestIndices[16] = {0};
+	for (int pass = 0; pass < 2; pass++) {
+		int endpoints[2][4], pBits[2];
+		quantizeEndpoint(first, endpoints[0], pBits[0]);
+		quantizeEndpoint(second, endpoints[1], pBits[1]);
+
+		int palette[16][4];
+		for (int c = 0; c < 4; c++) {
+			int e0 = (endpoints[0][c] << 1) | pBits[0], e1 = (endpoints[1][c] << 1) | pBits[1];
+			for (int k = 0; k < 16; k++) {
+				palette[k][c] = (e0 * (64 - bc7Weights[k]) + e1 * bc7Weights[k] + 32) >> 6;
+			}
+		}
+		uint8_t indices[16];
+		int error = nearestIndices(block, palette, 16, indices);
+		if (error < bestError) {
+			bestError = error;
+			memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+			memcpy(bestPBits, pBits, sizeof(pBits));
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+		if (error == 0) {
+			break;
+		}
+
+		float pixelWeights[16];
+		for (int i = 0; i < 16; i++) {
+			pixelWeights[i] = bc7Weights[indices[i]] / 64.0f;
+		}
+		if (!leastSquaresEndpoints(block, 4, pixelWeights, first, second)) {
+			break;
+		}
+	}
+
+	// The highest index bit of the first pixel is implicitly 0, swap the endpoints otherwise
+	if (bestIndices[0] & 8) {
+		std::swap(bestEndpoints[0], bestEndpoints[1]);
+		std::swap(bestPBits[0], bestPBits[1]);
+		for (int i = 0; i < 16; i++) {
+			bestIndices[i] = 15 - bestIndices[i];
+		}
+	}
+
+	memset(out, 0, 16);
+	BitWriter writer = {out};
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.write(bestEndpoints[0][c], 7);
+		writer.write(bestEndpoints[1][c], 7);
+	}
+	writer.write(bestPBits[0], 1);
+	writer.write(bestPBits[1], 1);
+	writer.write(bestIndices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		writer.write(bestIndices[i], 4);
+	}
+}
+
+bool decodeBC7Block(const unsigned char * in, unsigned char out_pixels[16][4]) {
+	BitReader reader = {in};
+	if (reader.read(7) != (1 << 6)) {
+		return false;
+	}
+	int endpoints[2][4];
+	for (int c = 0; c < 4; c++) {
+		endpoints[0][c] = reader.read(7) << 1;
+		endpoints[1][c] = reader.read(7) << 1;
+	}
+	int pBit0 = reader.read(1), pBit1 = reader.read(1);
+	for (int c = 0; c < 4; c++) {
+		endpoints[0][c] |= pBit0;
+		endpoints[1][c] |= pBit1;
+	}
+	for (int i = 0; i < 16; i++) {
+		int w = bc7Weights[reader.read(i == 0 ? 3 : 4)];
+		for (int c = 0; c < 4; c++) {
+			out_pixels[i][c] = (unsigned char)((endpoints[0][c] * (64 - w) + endpoints[1][c] * w + 32) >> 6);
+		}
+	}
+	return true;
+}
+
+void decodeColorBlock(const unsigned char * in, unsigned char out_pixels[16][4]) {
+	uint16_t color0 = in[0] | (in[1] << 8), color1 = in[2] | (in[3] << 8);
+	int palette[4][4];
+	colorPalette(color0, color1, palette);
+	uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+	for (int i = 0; i < 16; i++) {
+		int index = (bits >> (2 * i)) & 3;
+		for (int c = 0; c < 3; c++) {
+			out_pixels[i][c] = (unsigned char)palette[index][c];
+		}
+		out_pixels[i][3] = (color0 <= color1 && index == 3) ? 0 : 255;
+	}
+}
+
+void decodeAlphaBlock(const unsigned char * in, unsigned char out_pixels[16][4]) {
+	int palette[8];
+	alphaPalette(in[0], in[1], palette);
+	uint64_t bits = 0;
+	for (int k = 0; k < 6; k++) {
+		bits |= (uint64_t)in[2 + k] << (8 * k);
+	}
+	for (int i = 0; i < 16; i++) {
+		out_pixels[i][3] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+	}
+}
+
+} // namespace
+
+size_t blockSize(BlockFormat format) {
+	return (format == BlockFormat::BC1) ? 8 : 16;
+}
+
+void encodeImage(const Image & image, BlockFormat format, std::vector<unsigned char> & out_blocks) {
+	int blocksX = (image.width + 3) / 4, blocksY = (image.height + 3) / 4;
+	out_blocks.resize((size_t)blocksX * blocksY * blockSize(format));
+	unsigned char * out = out_blocks.data();
+
+	for (int by = 0; by < blocksY; by++) {
+		for (int bx = 0; bx < blocksX; bx++, out += blockSize(format)) {
+			Block block;
+			for (int i = 0; i < 16; i++) {
+				int x = std::min(bx * 4 + (i & 3), image.width - 1);
+				int y = std::min(by * 4 + (i >> 2), image.height - 1);
+				const unsigned char * pixel = &image.pixels[((size_t)y * image.width + x) * 4];
+				for (int c = 0; c < 4; c++) {
+					block.channels[c][i] = pixel[c];
+				}
+			}
+
+			switch (format) {
+			case BlockFormat::BC1:
+				encodeColorBlock(block, out);
+				break;
+			case BlockFormat::BC3:
+				encodeAlphaBlock(block, out);
+				encodeColorBlock(block, out + 8);
+				break;
+			case BlockFormat::BC7:
+				encodeBC7Block(block, out);
+				break;
+			}
+		}
+	}
+}
+
+bool decodeImage(const unsigned char * blocks, int width, int height, BlockFormat format, Image & out_image) {
+	out_image.width = width;
+	out_image.height = height;
+	out_image.pixels.resize((size_t)width * height * 4);
+
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	for (int by = 0; by < blocksY; by++) {
+		for (int bx = 0; bx < blocksX; bx++, blocks += blockSize(format)) {
+			unsigned char pixels[16][4];
+			switch (format) {
+			case BlockFormat::BC1:
+				decodeColorBlock(blocks, pixels);
+				break;
+			case BlockFormat::BC3:
+				decodeColorBlock(blocks + 8, pixels);
+				decodeAlphaBlock(blocks, pixels);
+				break;
+			case BlockFormat::BC7:
+				if (!decodeBC7Block(blocks, pixels)) {
+					return false;
+				}
+				break;
+			}
+
+			for (int i = 0; i < 16; i++) {
+				int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+				if (x < width && y < height) {
+					memcpy(&out_image.pixels[((size_t)y * width + x) * 4], pixels[i], 4);
+				}
+			}
+		}
+	}
+	return true;
+}
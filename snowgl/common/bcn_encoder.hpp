@@ -0,0 +1,41 @@
+#ifndef BCN_ENCODER_HPP
+#define BCN_ENCODER_HPP
+
+#include <vector>
+#include <stddef.h>
+
+#include "image.hpp"
+
+/**
+ * @brief The block compressed formats the encoder writes, each block holds 4x4 pixels.
+ */
+
+enum class BlockFormat {
+	BC1,	// RGB, 8 bytes per block (DXT1)
+	BC3,	// RGBA, an alpha block then a BC1 color block, 16 bytes per block (DXT5)
+	BC7		// RGBA, 16 bytes per block, always written in mode 6 (one subset, 7-bit endpoints with p-bits, 4-bit indices)
+};
+
+/**
+ * @brief The size of a block in bytes.
+ */
+
+size_t blockSize(BlockFormat format);
+
+/**
+ * @brief Compresses an image, blocks row by row from the top. The edge blocks of sizes that aren't multiples of 4 repeat the last row or column.
+ *
+ * The endpoints of a block lie on the principal axis of its pixels, then are fit again by least squares
+ * to the indices they gave. The nearest palette entry of the pixels is searched with SSE2 when available.
+ */
+
+void encodeImage(const Image & image, BlockFormat format, std::vector<unsigned char> & out_blocks);
+
+/**
+ * @brief Decompresses blocks written by encodeImage, to measure the error of the compression.
+ * @return bool False for BC7 blocks of another mode than 6.
+ */
+
+bool decodeImage(const unsigned char * blocks, int width, int height, BlockFormat format, Image & out_image);
+
+#endif // BCN_ENCODER_HPP
@@ -0,0 +1,130 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief A bounded, lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design).
+ *
+ * Every cell carries a sequence number telling producers and consumers whether it is free or filled,
+ * so pushing and popping only cost one compare-and-swap on the shared position. Neither call blocks:
+ * tryPush() fails when the queue is full and tryPop() when it is empty, waiting is up to the caller.
+ */
+
+template <typename T>
+class BoundedQueue {
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+
+	// Producers and consumers write different positions, keep them on different cache lines.
+	alignas(64) std::atomic<size_t> enqueuePosition;
+	alignas(64) std::atomic<size_t> dequeuePosition;
+
+public:
+
+	/**
+	 * @brief Creates an empty queue.
+	 * @param capacity The minimum capacity, rounded up to a power of two.
+	 */
+
+	explicit BoundedQueue(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity) {
+			size *= 2;
+		}
+
+		cells.reset(new Cell[size]);
+		mask = size - 1;
+		for (size_t i = 0; i < size; i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		enqueuePosition.store(0, std::memory_order_relaxed);
+		dequeuePosition.store(0, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue &) = delete;
+	BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+	/**
+	 * @brief Appends an element if there is room for it.
+	 * @return bool False if the queue is full, the element is then left untouched.
+	 */
+
+	bool tryPush(T & value) {
+		Cell * cell;
+		size_t position = enqueuePosition.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &cells[position & mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+			if (difference == 0) {
+				if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->data = std::move(value);
+		cell->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Removes the oldest element if there is one.
+	 * @return bool False if the queue is empty.
+	 */
+
+	bool tryPop(T & value) {
+		Cell * cell;
+		size_t position = dequeuePosition.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &cells[position & mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+			if (difference == 0) {
+				if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = dequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		value = std::move(cell->data);
+		cell->sequence.store(position + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Returns the number of queued elements. Only a snapshot while other threads are working.
+	 */
+
+	size_t size() const {
+		size_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+		size_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+		return enqueued > dequeued ? enqueued - dequeued : 0;
+	}
+
+	size_t capacity() const {
+		return mask + 1;
+	}
+};
+
+#endif // BOUNDED_QUEUE_HPP
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "clustered_lights.hpp"
+
+void placeLightRing(int count, float ringRadius, float height, float radius, const glm::vec3 & color, std::vector<LocalLight> & out_lights) {
+	for (int i = 0; i < count; i++) {
+		float angle = 6.28318531f * i / count;
+		LocalLight light;
+		light.position = glm::vec3(cosf(angle) * ringRadius, sinf(angle) * ringRadius, height);
+		light.radius = radius;
+		light.color = color;
+		light.intensity = 1.0f;
+		out_lights.push_back(light);
+	}
+}
+
+void LightClusters::create(int clusterTilesX, int clusterTilesY, int clusterSlices) {
+	tilesX = std::max(clusterTilesX, 1);
+	tilesY = std::max(clusterTilesY, 1);
+	slices = std::max(clusterSlices, 1);
+
+	// The textures keep pointing to their buffer when its storage is replaced by glBufferData
+	const GLenum formats[3] = {GL_RG32UI, GL_R32UI, GL_RGBA32F};
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::upload(int index, const void * data, size_t size) {
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers[index]);
+	glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), size > 0 ? data : NULL, GL_STREAM_DRAW);
+}
+
+void LightClusters::update(const std::vector<LocalLight> & lights, const glm::mat4 & view, const glm::mat4 & projection, int width, int height) {
+	lightCount = lights.size();
+
+	// Near and far planes of the perspective projection
+	float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+	float farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+
+	// Slice of a view depth: log(depth / near) / log(far / near) * slices
+	float tileWidth = ceilf((float)width / tilesX);
+	float tileHeight = ceilf((float)height / tilesY);
+	float sliceScale = slices / logf(farPlane / nearPlane);
+	float sliceBias = -logf(nearPlane) * sliceScale;
+	params = glm::vec4(tileWidth, tileHeight, sliceScale, sliceBias);
+
+	auto sliceOf = [&](float depth) {
+		return std::min(std::max((int)floorf(logf(depth) * sliceScale + sliceBias), 0), slices - 1);
+	};
+	auto tileOf = [&](float ndc, float size, float tileSize, int tiles) {
+		return std::min(std::max((int)floorf((ndc * 0.5f + 0.5f) * size / tileSize), 0), tiles - 1);
+	};
+
+	// Lights in view space, three texels each
+	lightData.resize(lights.size() * 3);
+	ranges.assign(lights.size(), glm::ivec4(0, 0, -1, -1));
+	sliceRanges.assign(lights.size(), glm::ivec2(0, -1));
+	for (size_t i = 0; i < lights.size(); i++) {
+		const LocalLight & light = lights[i];
+		glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		glm::vec3 direction = glm::normalize(glm::mat3(view) * light.direction);
+		float cosOuter = cosf(glm::radians(std::min(light.outerAngle, 180.0f)));
+		float cosInner = std::max(cosf(glm::radians(std::min(light.innerAngle, light.outerAngle))), cosOuter + 1e-4f);
+		lightData[i * 3 + 0] = glm::vec4(center, light.radius);
+		lightData[i * 3 + 1] = glm::vec4(light.color * light.intensity, cosInner);
+		lightData[i * 3 + 2] = glm::vec4(direction, cosOuter);
+
+		// Depth slices of the bounding sphere, nothing if it lies outside the depth range
+		float depth = -center.z;
+		if (depth + light.radius < nearPlane || depth - light.radius > farPlane || light.intensity <= 0.0f) {
+			continue;
+		}
+		sliceRanges[i] = glm::ivec2(sliceOf(std::max(depth - light.radius, nearPlane)), sliceOf(std::min(depth + light.radius, farPlane)));
+
+		// Screen tiles of the bounding box of the sphere, all of them if the sphere crosses the near plane
+		glm::ivec4 tiles(0, 0, tilesX - 1, tilesY - 1);
+		if (depth - light.radius > nearPlane) {
+			glm::vec2 lower(FLT_MAX), upper(-FLT_MAX);
+			for (int corner = 0; corner < 8; corner++) {
+				glm::vec3 offset((corner & 1) ? light.radius : -light.radius, (corner & 2) ? light.radius : -light.radius, (corner & 4) ? light.radius : -light.radius);
+				glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+				glm::vec2 ndc = glm::vec2(clip) / clip.w;
+				lower = glm::min(lower, ndc);
+				upper = glm::max(upper, ndc);
+			}
+			if (upper.x < -1.0f || lower.x > 1.0f || upper.y < -1.0f || lower.y > 1.0f) {
+				sliceRanges[i] = glm::ivec2(0, -1);
+				continue;
+			}
+			tiles = glm::ivec4(tileOf(lower.x, width, tileWidth, tilesX), tileOf(lower.y, height, tileHeight, tilesY),
+				tileOf(upper.x, width, tileWidth, tilesX), tileOf(upper.y, height, tileHeight, tilesY));
+		}
+		ranges[i] = tiles;
+	}
+
+	// The box of a cluster in camera space: a point at view depth d and NDC n lies at d * (n + P[2]) / P[0] (x and y)
+	auto tileEdge = [&](int tile, float tileSize, float size, int axis) {
+		float ndc = std::min(tile * tileSize / size, 1.0f) * 2.0f - 1.0f;
+		return (ndc + projection[2][axis]) / projection[axis][axis];
+	};
+	auto sliceDepth = [&](int slice) {
+		return (slice == 0) ? nearPlane : expf((slice - sliceBias) / sliceScale);
+	};
+	auto overlaps = [&](const glm::vec4 & sphere, int x, int y, int s) {
+		float depths[2] = {sliceDepth(s), (s == slices - 1) ? farPlane : sliceDepth(s + 1)};
+		float edgesX[2] = {tileEdge(x, tileWidth, width, 0), tileEdge(x + 1, tileWidth, width, 0)};
+		float edgesY[2] = {tileEdge(y, tileHeight, height, 1), tileEdge(y + 1, tileHeight, height, 1)};
+		glm::vec3 lower(FLT_MAX, FLT_MAX, -depths[1]), upper(-FLT_MAX, -FLT_MAX, -depths[0]);
+		for (int k = 0; k < 2; k++) {
+			for (int j = 0; j < 2; j++) {
+				lower.x = std::min(lower.x, depths[k] * edgesX[j]);
+				lower.y = std::min(lower.y, depths[k] * edgesY[j]);
+				upper.x = std::max(upper.x, depths[k] * edgesX[j]);
+				upper.y = std::max(upper.y, depths[k] * edgesY[j]);
+			}
+		}
+		glm::vec3 closest = glm::clamp(glm::vec3(sphere), lower, upper);
+		glm::vec3 offset = closest - glm::vec3(sphere);
+		return glm::dot(offset, offset) <= sphere.w * sphere.w;
+	};
+
+	// Count the lights of every cluster, turn the counts into offsets, then fill the index lists.
+	// The tiles and slices of a light are only a rectangle around its sphere, each cluster is tested against the sphere.
+	size_t clusterCount = (size_t)tilesX * tilesY * slices;
+	grid.assign(clusterCount * 2, 0);
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = 0; i < lights.size(); i++) {
+			for (int s = sliceRanges[i].x; s <= sliceRanges[i].y; s++) {
+				for (int y = ranges[i].y; y <= ranges[i].w; y++) {
+					for (int x = ranges[i].x; x <= ranges[i].z; x++) {
+						if (!overlaps(lightData[i * 3], x, y, s)) {
+							continue;
+						}
+						uint32_t * cluster = &grid[(((size_t)s * tilesY + y) * tilesX + x) * 2];
+						if (pass == 1) {
+							indices[cluster[0] + cluster[1]] = (uint32_t)i;
+						}
+						cluster[1]++;
+					}
+				}
+			}
+		}
+
+		if (pass == 0) {
+			uint32_t offset = 0;
+			for (size_t c = 0; c < clusterCount; c++) {
+				grid[c * 2] = offset;
+				offset += grid[c * 2 + 1];
+				maxClusterLights = std::max(maxClusterLights, grid[c * 2 + 1]);
+				grid[c * 2 + 1] = 0;
+			}
+			indices.resize(offset);
+			maxEntries = std::max(maxEntries, offset);
+		}
+	}
+
+	upload(0, grid.data(), grid.size() * sizeof(uint32_t));
+	upload(1, indices.data(), indices.size() * sizeof(uint32_t));
+	upload(2, lightData.data(), lightData.size() * sizeof(glm::vec4));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::bind(int firstUnit) const {
+	for (int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	}
+}
+
+void LightClusters::printStatistics() const {
+	printf("Clustered lights: %u lights in %d x %d x %d clusters, at most %u cluster entries in a frame and %u lights in a cluster\n",
+		lightCount, tilesX, tilesY, slices, maxEntries, maxClusterLights);
+}
+
+void LightClusters::release() {
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+	for (int i = 0; i < 3; i++) {
+		textures[i] = buffers[i] = 0;
+	}
+}
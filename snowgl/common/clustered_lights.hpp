@@ -0,0 +1,122 @@
+#ifndef CLUSTERED_LIGHTS_HPP
+#define CLUSTERED_LIGHTS_HPP
+
+#include <vector>
+#include <stdint.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+ * @brief A point light, or a spot light if its outer cone angle is below 180 degrees. Lights the scene up to its radius.
+ */
+
+struct LocalLight {
+	glm::vec3 position;					// World space
+	float radius;						// The light fades out smoothly to 0 at this distance
+	glm::vec3 color;
+	float intensity;
+	glm::vec3 direction = glm::vec3(0, 0, -1);	// Axis of the spot light cone, world space
+	float innerAngle = 180.0f;			// Half-angles of the spot light cone in degrees, full intensity inside the inner one
+	float outerAngle = 180.0f;
+};
+
+/**
+ * @brief Places point lights on a ring around the vertical axis (e.g. street lamps around the scene).
+ * @param count The number of lights.
+ * @param ringRadius The distance of the lights to the axis.
+ * @param height The height of the lights.
+ * @param radius The radius each light reaches.
+ * @param color The color of the lights.
+ * @param out_lights The lights are appended to this vector.
+ */
+
+void placeLightRing(int count, float ringRadius, float height, float radius, const glm::vec3 & color, std::vector<LocalLight> & out_lights);
+
+/**
+ * @brief Sorts local lights into the clusters of the view frustum, so a fragment only shades the lights reaching its cluster.
+ *
+ * The frustum is cut into tilesX x tilesY screen tiles and slices exponentially spaced in depth. Every frame,
+ * the bounding sphere of each light is projected on the CPU to find the clusters it overlaps, and three
+ * texture buffers are uploaded:
+ * - the grid: (first index, light count) per cluster, RG32UI;
+ * - the light indices of all clusters, R32UI;
+ * - the lights, in view space: (position, radius), (color * intensity, cos inner angle), (direction, cos outer angle), RGBA32F.
+ *
+ * The fragment shader finds its cluster from gl_FragCoord and its view depth (see parameters()), the cost
+ * of a fragment depends on the lights of its cluster and not on the number of lights in the scene.
+ */
+
+class LightClusters {
+private:
+	int tilesX = 0;
+	int tilesY = 0;
+	int slices = 0;
+
+	GLuint buffers[3] = {0, 0, 0};		// Grid, indices, lights
+	GLuint textures[3] = {0, 0, 0};
+
+	std::vector<uint32_t> grid;
+	std::vector<uint32_t> indices;
+	std::vector<glm::vec4> lightData;
+	std::vector<glm::ivec4> ranges;		// Clusters overlapped by each light: tiles x0, y0, x1, y1 (slices in sliceRanges)
+	std::vector<glm::ivec2> sliceRanges;
+
+	glm::vec4 params = glm::vec4(0.0f);
+	unsigned int lightCount = 0;
+	unsigned int maxEntries = 0;			// Most cluster entries of an update
+	unsigned int maxClusterLights = 0;		// Most lights in one cluster
+
+	void upload(int index, const void * data, size_t size);
+
+public:
+
+	/**
+	 * @brief Creates the texture buffers.
+	 * @param tilesX Screen tiles along the width.
+	 * @param tilesY Screen tiles along the height.
+	 * @param slices Depth slices between the near and far planes.
+	 */
+
+	void create(int tilesX, int tilesY, int slices);
+
+	/**
+	 * @brief Sorts the lights into the clusters of a camera and uploads the result.
+	 * @param lights The local lights of the scene.
+	 * @param view The view matrix (world to camera space).
+	 * @param projection The perspective projection matrix.
+	 * @param width The width of the framebuffer, in pixels.
+	 * @param height The height of the framebuffer, in pixels.
+	 */
+
+	void update(const std::vector<LocalLight> & lights, const glm::mat4 & view, const glm::mat4 & projection, int width, int height);
+
+	/**
+	 * @brief Binds the grid, indices and lights texture buffers to three consecutive texture units.
+	 */
+
+	void bind(int firstUnit) const;
+
+	/**
+	 * @brief (tilesX, tilesY, slices, lights) of the last update.
+	 */
+
+	glm::ivec4 gridSize() const { return glm::ivec4(tilesX, tilesY, slices, (int)lightCount); }
+
+	/**
+	 * @brief (tile width, tile height, slice scale, slice bias) of the last update: the cluster of a fragment is
+	 * (gl_FragCoord.xy / tile size, log(view depth) * scale + bias).
+	 */
+
+	glm::vec4 parameters() const { return params; }
+
+	/**
+	 * @brief Prints the number of lights, and the most cluster entries and lights in one cluster of all the updates.
+	 */
+
+	void printStatistics() const;
+
+	void release();
+};
+
+#endif // CLUSTERED_LIGHTS_HPP
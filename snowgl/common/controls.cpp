@@ -33,27 +33,34 @@ float mouseSpeed = 0.005f;
 
 glm::vec3 computeMatricesFromInputs() {
 
+	// Without a window (headless rendering) there is no input at all,
+	// the camera keeps its initial position and orientation.
+	bool hasInput = (window != NULL);
+
 	// glfwGetTime is called only once, the first time this function is called
-	static double lastTime = glfwGetTime();
+	static double lastTime = hasInput ? glfwGetTime() : 0.0;
 
 	// Compute time difference between current and last frame
-	double currentTime = glfwGetTime();
+	double currentTime = hasInput ? glfwGetTime() : 0.0;
 	float deltaTime = float(currentTime - lastTime);
 
-	// Get mouse position
-	double xpos, ypos;
-	glfwGetCursorPos(window, &xpos, &ypos);
+	if(hasInput){
 
-	// Reset mouse position for next frame
-	glfwSetCursorPos(window, WINDOW_WIDTH/2, WINDOW_HEIGHT/2);
+		// Get mouse position
+		double xpos, ypos;
+		glfwGetCursorPos(window, &xpos, &ypos);
 
-	// Compute new orientation
-	if(!HORIZONTAL_FIXED){
-		horizontalAngle += mouseSpeed * float(WINDOW_WIDTH/2 - xpos );
-	}
-	
-	if(!VERTICAL_FIXED){
-		verticalAngle   += mouseSpeed * float(WINDOW_HEIGHT/2 - ypos );
+		// Reset mouse position for next frame
+		glfwSetCursorPos(window, WINDOW_WIDTH/2, WINDOW_HEIGHT/2);
+
+		// Compute new orientation
+		if(!HORIZONTAL_FIXED){
+			horizontalAngle += mouseSpeed * float(WINDOW_WIDTH/2 - xpos );
+		}
+		
+		if(!VERTICAL_FIXED){
+			verticalAngle   += mouseSpeed * float(WINDOW_HEIGHT/2 - ypos );
+		}
 	}
 
 	// Direction : Spherical coordinates to Cartesian coordinates conversion
@@ -74,19 +81,19 @@ glm::vec3 computeMatricesFromInputs() {
 	glm::vec3 up = glm::cross( right, direction );
 
 	// Move forward
-	if (glfwGetKey( window, GLFW_KEY_W ) == GLFW_PRESS){
+	if (hasInput && glfwGetKey( window, GLFW_KEY_W ) == GLFW_PRESS){
 		position += direction * deltaTime * speed;
 	}
 	// Move backward
-	if (glfwGetKey( window, GLFW_KEY_S ) == GLFW_PRESS){
+	if (hasInput && glfwGetKey( window, GLFW_KEY_S ) == GLFW_PRESS){
 		position -= direction * deltaTime * speed;
 	}
 	// Strafe right
-	if (glfwGetKey( window, GLFW_KEY_D ) == GLFW_PRESS){
+	if (hasInput && glfwGetKey( window, GLFW_KEY_D ) == GLFW_PRESS){
 		position += right * deltaTime * speed;
 	}
 	// Strafe left
-	if (glfwGetKey( window, GLFW_KEY_A ) == GLFW_PRESS){
+	if (hasInput && glfwGetKey( window, GLFW_KEY_A ) == GLFW_PRESS){
 		position -= right * deltaTime * speed;
 	}
 
@@ -1,47 +1,138 @@
 #include "csv_reader.hpp"
-#include <fstream>
-#include <sstream>
-#include <iostream>
+#include "mapped_file.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <charconv>
+
+Data EnvironmentColumns::row(size_t row) const {
+    Data entry;
+    memcpy(entry.time, time(row), DATA_TIME_LENGTH);
+    entry.minute = minutes[row];
+    entry.temperature = values[(int)DataColumn::Temperature][row];
+    entry.snow_amount = values[(int)DataColumn::SnowAmount][row];
+    entry.light_intensity = values[(int)DataColumn::LightIntensity][row];
+    entry.elevation_angle = values[(int)DataColumn::ElevationAngle][row];
+    entry.light_direction_x = values[(int)DataColumn::LightDirectionX][row];
+    entry.light_direction_y = values[(int)DataColumn::LightDirectionY][row];
+    entry.light_direction_z = values[(int)DataColumn::LightDirectionZ][row];
+    entry.sky_color_r = values[(int)DataColumn::SkyColorR][row];
+    entry.sky_color_g = values[(int)DataColumn::SkyColorG][row];
+    entry.sky_color_b = values[(int)DataColumn::SkyColorB][row];
+    entry.sun_color_r = values[(int)DataColumn::SunColorR][row];
+    entry.sun_color_g = values[(int)DataColumn::SunColorG][row];
+    entry.sun_color_b = values[(int)DataColumn::SunColorB][row];
+    entry.wind_speed = values[(int)DataColumn::WindSpeed][row];
+    entry.wind_direction = values[(int)DataColumn::WindDirection][row];
+    return entry;
+}
+
+static const char * skipSpaces(const char * p, const char * end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+// Parses a whole field and moves past its comma, like std::stof/std::stoi but without a copy of the field
+template <typename T>
+static bool parseField(const char * & p, const char * end, T & value) {
+    p = skipSpaces(p, end);
+    if (p < end && *p == '+') {
+        p++;
+    }
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) {
+        return false;
+    }
+    p = skipSpaces(result.ptr, end);
+    if (p < end) {
+        if (*p != ',') {
+            return false;
+        }
+        p++;
+    }
+    return true;
+}
 
 csv_reader::csv_reader(const std::string& filename) : filename(filename) {}
 
 bool csv_reader::read_csv() {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file\n";
+    MappedFile file;
+    if (!file.open(filename.c_str(), true)) {
+        fprintf(stderr, "%s could not be opened.\n", filename.c_str());
         return false;
     }
+    columns = EnvironmentColumns();
+    const char * p = (const char *)file.data();
+    const char * end = p + file.size();
+
+    // One row per line after the header, reserved up front
+    size_t lineCount = std::count(p, end, '\n') + 1;
+    times.clear();
+    minutes.clear();
+    times.reserve(lineCount * DATA_TIME_LENGTH);
+    minutes.reserve(lineCount);
+    for (int c = 0; c < DATA_COLUMN_COUNT; c++) {
+        values[c].clear();
+        values[c].reserve(lineCount);
+    }
+
+    size_t lineNumber = 0;
+    while (p < end) {
+        const char * lineEnd = (const char *)memchr(p, '\n', end - p);
+        const char * next = (lineEnd != NULL) ? lineEnd + 1 : end;
+        lineEnd = (lineEnd != NULL) ? lineEnd : end;
+        if (lineEnd > p && lineEnd[-1] == '\r') {
+            lineEnd--;
+        }
+        lineNumber++;
+
+        // Skip the header line, and blank lines
+        if (lineNumber == 1 || lineEnd == p) {
+            p = next;
+            continue;
+        }
+
+        const char * field = p;
+        const char * timeEnd = (const char *)memchr(field, ',', lineEnd - field);
+        timeEnd = (timeEnd != NULL) ? timeEnd : lineEnd;
+        char label[DATA_TIME_LENGTH] = {};
+        memcpy(label, field, std::min<size_t>(timeEnd - field, DATA_TIME_LENGTH - 1));
+        times.insert(times.end(), label, label + DATA_TIME_LENGTH);
+        field = (timeEnd < lineEnd) ? timeEnd + 1 : lineEnd;
+
+        int32_t minute = 0;
+        bool valid = parseField(field, lineEnd, minute);
+        minutes.push_back(minute);
+        for (int c = 0; c < DATA_COLUMN_COUNT; c++) {
+            float value = 0.0f;
+            // The wind columns are optional, older data files describe still air
+            bool optional = c >= (int)DataColumn::WindSpeed;
+            const char * start = skipSpaces(field, lineEnd);
+            if (!optional || (start < lineEnd && *start != ',')) {
+                valid = valid && parseField(field, lineEnd, value);
+            } else {
+                field = (start < lineEnd) ? start + 1 : lineEnd;
+            }
+            values[c].push_back(value);
+        }
+        if (!valid) {
+            fprintf(stderr, "%s:%zu: malformed line.\n", filename.c_str(), lineNumber);
+            return false;
+        }
+        p = next;
+    }
 
-    std::string line;
-    getline(file, line); // Skip the header line
-
-    while (getline(file, line)) {
-        std::stringstream ss(line);
-        Data entry;
-        std::string temp;
-
-        getline(ss, entry.time, ',');
-        getline(ss, temp, ','); entry.minute = std::stoi(temp);
-        getline(ss, temp, ','); entry.temperature = std::stof(temp);
-        getline(ss, temp, ','); entry.snow_amount = std::stof(temp);
-        getline(ss, temp, ','); entry.light_intensity = std::stof(temp);
-        getline(ss, temp, ','); entry.elevation_angle = std::stof(temp);
-        getline(ss, temp, ','); entry.light_direction_x = std::stof(temp);
-        getline(ss, temp, ','); entry.light_direction_y = std::stof(temp);
-        getline(ss, temp, ','); entry.light_direction_z = std::stof(temp);
-        getline(ss, temp, ','); entry.sky_color_r = std::stof(temp);
-        getline(ss, temp, ','); entry.sky_color_g = std::stof(temp);
-        getline(ss, temp, ','); entry.sky_color_b = std::stof(temp);
-        getline(ss, temp, ','); entry.sun_color_r = std::stof(temp);
-        getline(ss, temp, ','); entry.sun_color_g = std::stof(temp);
-        getline(ss, temp, ','); entry.sun_color_b = std::stof(temp);
-        dataEntries.push_back(entry);
-    }
-
-    file.close();
+    columns.rows = minutes.size();
+    columns.times = times.data();
+    columns.minutes = minutes.data();
+    for (int c = 0; c < DATA_COLUMN_COUNT; c++) {
+        columns.values[c] = values[c].data();
+    }
     return true;
 }
 
-const std::vector<Data>& csv_reader::getData() const {
-    return dataEntries;
+const EnvironmentColumns& csv_reader::getData() const {
+    return columns;
 }
@@ -3,9 +3,13 @@
 
 #include <vector>
 #include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DATA_TIME_LENGTH        24      // Bytes of a time label with its terminating zero, longer labels are cut
 
 struct Data {
-    std::string time;
+    char time[DATA_TIME_LENGTH];
     int minute;
     float temperature;
     float snow_amount;
@@ -20,17 +24,75 @@ struct Data {
     float sun_color_r;
     float sun_color_g;
     float sun_color_b;
+    float wind_speed;           // m/s, optional column (0 without it)
+    float wind_direction;       // Degrees clockwise from north the wind blows from, optional column
+};
+
+/**
+ * @brief The floating point columns of the data file, in the order of the file.
+ */
+
+enum class DataColumn {
+    Temperature,
+    SnowAmount,
+    LightIntensity,
+    ElevationAngle,
+    LightDirectionX,
+    LightDirectionY,
+    LightDirectionZ,
+    SkyColorR,
+    SkyColorG,
+    SkyColorB,
+    SunColorR,
+    SunColorG,
+    SunColorB,
+    WindSpeed,
+    WindDirection
+};
+
+#define DATA_COLUMN_COUNT       15
+
+/**
+ * @brief A view of the data, one array per column. It doesn't own the arrays, they belong to the
+ * csv_reader or to the mapping of the EnvironmentTable it comes from, and it is cheap to copy.
+ */
+
+struct EnvironmentColumns {
+    size_t rows = 0;
+    const char * times = NULL;          // One label of DATA_TIME_LENGTH bytes per row, zero-terminated
+    const int32_t * minutes = NULL;
+    const float * values[DATA_COLUMN_COUNT] = {};
+
+    size_t size() const { return rows; }
+    bool empty() const { return rows == 0; }
+    const float * column(DataColumn column) const { return values[(int)column]; }
+    const char * time(size_t row) const { return times + row * DATA_TIME_LENGTH; }
+
+    /**
+     * @brief Gathers a row of every column.
+     */
+
+    Data row(size_t row) const;
 };
 
 class csv_reader {
 private:
-    std::vector<Data> dataEntries;
     std::string filename;
+    std::vector<char> times;
+    std::vector<int32_t> minutes;
+    std::vector<float> values[DATA_COLUMN_COUNT];
+    EnvironmentColumns columns;
 
 public:
     csv_reader(const std::string& filename);
+
+    /**
+     * @brief Parses the whole file, mapped in memory, with std::from_chars straight into the columns.
+     * @return bool False if the file can't be read or a line is malformed.
+     */
+
     bool read_csv();
-    const std::vector<Data>& getData() const;
+    const EnvironmentColumns& getData() const;
 };
 
-#endif // CSV_READER_H
\ No newline at end of file
+#endif // CSV_READER_H
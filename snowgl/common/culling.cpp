@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "culling.hpp"
+#include "shader.hpp"
+
+// Marks the leaves a view volume reaches as visible
+struct VisibleLeaves : btDbvt::ICollide {
+	std::vector<unsigned char> * visible;
+	unsigned int count = 0;
+
+	void Process(const btDbvtNode * leaf) {
+		(*visible)[(uintptr_t)leaf->data] = 1;
+		count++;
+	}
+};
+
+static btDbvtVolume instanceVolume(const Scene & scene, unsigned int instance) {
+	glm::vec3 boundsMin, boundsMax;
+	scene.instanceBounds(instance, boundsMin, boundsMax);
+	return btDbvtVolume::FromMM(btVector3(boundsMin.x, boundsMin.y, boundsMin.z), btVector3(boundsMax.x, boundsMax.y, boundsMax.z));
+}
+
+SceneCuller::SceneCuller(bool occlusionQueries) : occlusionQueries(occlusionQueries) {
+	if (!occlusionQueries) {
+		return;
+	}
+
+	boxProgram = LoadShaders("shaders/BoundingBox.vert", "shaders/BoundingBox.frag");
+	boxViewProjectionLocation = glGetUniformLocation(boxProgram, "viewProjection");
+	boxMinLocation = glGetUniformLocation(boxProgram, "boxMin");
+	boxMaxLocation = glGetUniformLocation(boxProgram, "boxMax");
+
+	// Unit cube, stretched over the box of an instance by the vertex shader
+	static const GLfloat corners[] = {
+		0, 0, 0,	1, 0, 0,	0, 1, 0,	1, 1, 0,
+		0, 0, 1,	1, 0, 1,	0, 1, 1,	1, 1, 1,
+	};
+	static const GLushort faces[] = {
+		0, 2, 1,	1, 2, 3,	4, 5, 6,	5, 7, 6,
+		0, 1, 4,	1, 5, 4,	2, 6, 3,	3, 6, 7,
+		0, 4, 2,	2, 4, 6,	1, 3, 5,	3, 7, 5,
+	};
+
+	GLint previousVertexArray;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+	glGenVertexArrays(1, &boxVertexArray);
+	glBindVertexArray(boxVertexArray);
+
+	glGenBuffers(1, &boxVertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, boxVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+	glGenBuffers(1, &boxElementBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxElementBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+
+	glBindVertexArray(previousVertexArray);
+}
+
+void SceneCuller::update(const Scene & scene) {
+	if (built && scene.instanceVersion() == sceneVersion) {
+		return;
+	}
+
+	// Instances are only added, the leaves of the existing ones are moved
+	for (size_t i = 0; i < leaves.size(); i++) {
+		btDbvtVolume volume = instanceVolume(scene, i);
+		tree.update(leaves[i], volume);
+	}
+
+	size_t previousCount = leaves.size();
+	for (size_t i = previousCount; i < scene.instanceCount(); i++) {
+		leaves.push_back(tree.insert(instanceVolume(scene, i), (void*)(uintptr_t)i));
+	}
+
+	// A tree built one insertion at a time is unbalanced, rebuild it when many leaves arrived at once
+	if (scene.instanceCount() - previousCount > previousCount) {
+		tree.optimizeTopDown();
+	}
+
+	if (occlusionQueries) {
+		size_t count = scene.instanceCount();
+		size_t previousQueries = queries.size();
+		queries.resize(count);
+		if (count > previousQueries) {
+			glGenQueries(count - previousQueries, &queries[previousQueries]);
+		}
+		queryPending.resize(count, 0);
+		occluded.resize(count, 0);
+	}
+
+	sceneVersion = scene.instanceVersion();
+	built = true;
+}
+
+CullingCounts SceneCuller::cullFrustum(const glm::mat4 & viewProjection, std::vector<unsigned char> & out_visible) {
+
+	// Planes of the view volume (Gribb & Hartmann): a point is inside when dot(normal, point) + offset >= 0
+	btVector3 normals[6];
+	btScalar offsets[6];
+	for (int i = 0; i < 3; i++) {
+		for (int side = 0; side < 2; side++) {
+			float sign = (side == 0) ? 1.0f : -1.0f;
+			glm::vec4 plane;
+			for (int column = 0; column < 4; column++) {
+				plane[column] = viewProjection[column][3] + sign * viewProjection[column][i];
+			}
+			normals[2 * i + side] = btVector3(plane.x, plane.y, plane.z);
+			offsets[2 * i + side] = plane.w;
+		}
+	}
+
+	out_visible.assign(leaves.size(), 0);
+
+	VisibleLeaves policy;
+	policy.visible = &out_visible;
+	btDbvt::collideKDOP(tree.m_root, normals, offsets, 6, policy);
+
+	CullingCounts counts;
+	counts.visible = policy.count;
+	counts.frustumCulled = leaves.size() - policy.count;
+	return counts;
+}
+
+void SceneCuller::cullOccluded(std::vector<unsigned char> & inout_visible, CullingCounts & counts) {
+	if (!occlusionQueries) {
+		return;
+	}
+
+	frustumVisible = inout_visible;
+
+	for (size_t i = 0; i < inout_visible.size(); i++) {
+
+		// Collect the results that have arrived, without waiting for the others
+		if (queryPending[i]) {
+			GLuint available = 0;
+			glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				GLuint samplesPassed = 0;
+				glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &samplesPassed);
+				occluded[i] = (samplesPassed == 0);
+				queryPending[i] = 0;
+			}
+		}
+
+		// An instance leaving the frustum forgets its result, it is queried again when it comes back
+		if (!inout_visible[i]) {
+			occluded[i] = 0;
+		}
+		else if (occluded[i]) {
+			inout_visible[i] = 0;
+			counts.visible--;
+			counts.occlusionCulled++;
+		}
+	}
+}
+
+void SceneCuller::queryOcclusion(const Scene & scene, const glm::mat4 & viewProjection, const glm::vec3 & eyePosition) {
+	if (!occlusionQueries) {
+		return;
+	}
+
+	GLint previousVertexArray;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+	GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+
+	// Boxes only touch the depth test, never the buffers
+	glUseProgram(boxProgram);
+	glUniformMatrix4fv(boxViewProjectionLocation, 1, GL_FALSE, &viewProjection[0][0]);
+	glBindVertexArray(boxVertexArray);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glDepthFunc(GL_LEQUAL);
+	glDisable(GL_CULL_FACE);
+
+	for (size_t i = 0; i < frustumVisible.size(); i++) {
+		if (!frustumVisible[i] || queryPending[i]) {
+			continue;
+		}
+
+		glm::vec3 boundsMin, boundsMax;
+		scene.instanceBounds(i, boundsMin, boundsMax);
+
+		// The near plane would clip the box of an instance around the camera
+		if (glm::all(glm::greaterThanEqual(eyePosition, boundsMin)) && glm::all(glm::lessThanEqual(eyePosition, boundsMax))) {
+			occluded[i] = 0;
+			continue;
+		}
+
+		glUniform3fv(boxMinLocation, 1, &boundsMin[0]);
+		glUniform3fv(boxMaxLocation, 1, &boundsMax[0]);
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[i]);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, (void*)0);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		queryPending[i] = 1;
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	if (cullFace) {
+		glEnable(GL_CULL_FACE);
+	}
+	glBindVertexArray(previousVertexArray);
+}
+
+void SceneCuller::release() {
+	if (!queries.empty()) {
+		glDeleteQueries(queries.size(), queries.data());
+		queries.clear();
+	}
+	if (occlusionQueries) {
+		glDeleteProgram(boxProgram);
+		glDeleteVertexArrays(1, &boxVertexArray);
+		glDeleteBuffers(1, &boxVertexBuffer);
+		glDeleteBuffers(1, &boxElementBuffer);
+	}
+}
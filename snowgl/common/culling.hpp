@@ -0,0 +1,111 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <BulletCollision/BroadphaseCollision/btDbvt.h>
+
+#include "scene.hpp"
+
+/**
+ * @brief What a culling stage kept and rejected, for one pass of one frame.
+ */
+
+struct CullingCounts {
+	unsigned int visible = 0;
+	unsigned int frustumCulled = 0;
+	unsigned int occlusionCulled = 0;
+};
+
+/**
+ * @brief Culls the instances of a Scene with a bounding-volume hierarchy (Bullet's dynamic AABB tree).
+ *
+ * Every instance is a leaf holding its scene-space box. A view volume is tested from the root: subtrees
+ * fully outside one of its planes are skipped, subtrees fully inside all planes are accepted without
+ * testing their leaves. Any view-projection matrix works, the perspective camera as well as the
+ * orthographic volume of the occlusion map.
+ *
+ * Optionally, the instances the camera sees are also tested with hardware occlusion queries: the box of
+ * every instance inside the frustum is rasterized against the depth buffer of the frame, and instances
+ * whose box had no visible sample are skipped by the next frame. Results are only read once available,
+ * so the CPU never waits for the GPU; an object appearing from behind an occluder may show one frame late.
+ */
+
+class SceneCuller {
+private:
+	btDbvt tree;
+	std::vector<btDbvtNode*> leaves;			// One per instance
+	unsigned int sceneVersion = 0;
+	bool built = false;
+
+	// Occlusion queries, one per instance
+	bool occlusionQueries;
+	std::vector<GLuint> queries;
+	std::vector<unsigned char> queryPending;
+	std::vector<unsigned char> occluded;		// Result of the last query of each instance
+	std::vector<unsigned char> frustumVisible;	// Of the last cullOccluded(), the instances to query
+
+	GLuint boxProgram = 0;
+	GLuint boxVertexArray = 0;
+	GLuint boxVertexBuffer = 0;
+	GLuint boxElementBuffer = 0;
+	GLint boxViewProjectionLocation = -1;
+	GLint boxMinLocation = -1;
+	GLint boxMaxLocation = -1;
+
+public:
+
+	/**
+	 * @brief Creates the culler, without any instance until update().
+	 * @param occlusionQueries Also cull the instances hidden behind others (see cullOccluded() and queryOcclusion()).
+	 */
+
+	explicit SceneCuller(bool occlusionQueries);
+
+	/**
+	 * @brief Inserts the new instances of a scene in the tree and moves the leaves of the moved ones.
+	 * Does nothing when the instances have not changed since the last call.
+	 * @param scene The scene, instances are never removed from it.
+	 */
+
+	void update(const Scene & scene);
+
+	/**
+	 * @brief Finds the instances whose box intersects a view volume.
+	 * @param viewProjection Maps scene space to clip space, e.g. P * V * M of the camera, or the depthMVP of the occlusion map.
+	 * @param out_visible One flag per instance, for Scene::draw().
+	 * @return CullingCounts The number of visible and rejected instances.
+	 */
+
+	CullingCounts cullFrustum(const glm::mat4 & viewProjection, std::vector<unsigned char> & out_visible);
+
+	/**
+	 * @brief Removes the instances the last queries found hidden, and remembers the instances to query next.
+	 * Does nothing without occlusion queries.
+	 * @param inout_visible The flags of cullFrustum() for the camera.
+	 * @param counts The counts of cullFrustum(), occluded instances are moved from visible to occlusionCulled.
+	 */
+
+	void cullOccluded(std::vector<unsigned char> & inout_visible, CullingCounts & counts);
+
+	/**
+	 * @brief Issues an occlusion query for the box of every instance inside the frustum, once the frame has been drawn.
+	 * Does nothing without occlusion queries. The color and depth buffers are left untouched.
+	 * @param scene The scene given to update().
+	 * @param viewProjection The matrix given to cullFrustum().
+	 * @param eyePosition The camera, instances whose box contains it are always visible.
+	 */
+
+	void queryOcclusion(const Scene & scene, const glm::mat4 & viewProjection, const glm::vec3 & eyePosition);
+
+	/**
+	 * @brief Deletes the queries and the box program, the tree is freed with the culler.
+	 */
+
+	void release();
+};
+
+#endif // CULLING_HPP
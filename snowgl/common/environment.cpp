@@ -0,0 +1,21 @@
+#include "environment.hpp"
+
+void EnvironmentBuffer::create() {
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(EnvironmentBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, ENVIRONMENT_BLOCK_BINDING, buffer);
+}
+
+void EnvironmentBuffer::upload(const EnvironmentBlock & block) {
+
+	// Orphan the previous content, the previous frame may still be reading it
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(EnvironmentBlock), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(EnvironmentBlock), &block);
+}
+
+void EnvironmentBuffer::release() {
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
@@ -0,0 +1,67 @@
+#ifndef ENVIRONMENT_HPP
+#define ENVIRONMENT_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "sun_shadow.hpp"
+
+// Binding point of the Environment uniform block, shared by the depth and the shading programs
+#define ENVIRONMENT_BLOCK_BINDING   0
+#define ENVIRONMENT_MAX_LIGHTS      6
+
+/**
+ * @brief The per-frame environment and camera state, laid out as the std140 "Environment" uniform block
+ * declared in shaders/DepthRTT.vert, shaders/ShadowMapping.vert and shaders/ShadowMapping.frag.
+ * The declarations in the shaders must be kept in sync with this struct.
+ */
+
+struct EnvironmentBlock {
+	glm::mat4 MVP;
+	glm::mat4 V;
+	glm::mat4 M;
+	glm::mat4 DepthBiasMVP;
+	glm::mat4 depthMVP;
+	glm::vec4 lightInvDirections[ENVIRONMENT_MAX_LIGHTS];	// xyz: direction towards the light, world space (vec3 array, 16 bytes stride)
+	glm::vec3 sunColor;
+	float distortionScalar;
+	glm::vec3 snowColor;
+	float snowAmount;
+	float lightIntensity;
+	int numLights;
+	float snowDisplacement;								// Scale of the snow depth map displacement, 0 without the map
+	float windExposure;									// 1 to scale the exposure by the wind exposure map, 0 without the map
+	glm::ivec4 clusterGrid;								// Clusters of the local lights: tiles x, tiles y, slices, lights (see LightClusters)
+	glm::vec4 clusterParams;							// Tile width and height in pixels, slice scale and bias
+	glm::mat4 sunShadowMatrices[SUN_SHADOW_MAX_CASCADES];	// World space to the coordinates of each sun cascade (see SunShadowCascades)
+	glm::vec4 sunCascadeSplits;							// View depths the cascades end at
+};
+
+static_assert(sizeof(EnvironmentBlock) == (5 + SUN_SHADOW_MAX_CASCADES) * 64 + ENVIRONMENT_MAX_LIGHTS * 16 + 96, "EnvironmentBlock does not match the std140 layout");
+
+/**
+ * @brief The uniform buffer holding the EnvironmentBlock, uploaded once per frame.
+ */
+
+class EnvironmentBuffer {
+private:
+	GLuint buffer = 0;
+
+public:
+
+	/**
+	 * @brief Creates the buffer and binds it to ENVIRONMENT_BLOCK_BINDING.
+	 */
+
+	void create();
+
+	/**
+	 * @brief Replaces the content of the buffer, a single upload for all the programs using the block.
+	 */
+
+	void upload(const EnvironmentBlock & block);
+
+	void release();
+};
+
+#endif // ENVIRONMENT_HPP
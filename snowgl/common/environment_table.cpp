@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+#include "environment_table.hpp"
+
+static const char ENVIRONMENT_TABLE_MAGIC[8] = {'S', 'N', 'O', 'W', 'E', 'N', 'V', 'T'};
+
+// Where the columns of a table of rowCount rows start, end is the size of the file
+struct TableLayout {
+	uint64_t times;
+	uint64_t minutes;
+	uint64_t values[DATA_COLUMN_COUNT];
+	uint64_t end;
+};
+
+static uint64_t alignOffset(uint64_t offset) {
+	return (offset + ENVIRONMENT_TABLE_ALIGNMENT - 1) & ~(uint64_t)(ENVIRONMENT_TABLE_ALIGNMENT - 1);
+}
+
+static TableLayout tableLayout(uint64_t rowCount) {
+	TableLayout layout;
+	layout.times = alignOffset(sizeof(EnvironmentTableHeader));
+	layout.minutes = alignOffset(layout.times + rowCount * DATA_TIME_LENGTH);
+	uint64_t offset = layout.minutes + rowCount * sizeof(int32_t);
+	for (int c = 0; c < DATA_COLUMN_COUNT; c++) {
+		layout.values[c] = alignOffset(offset);
+		offset = layout.values[c] + rowCount * sizeof(float);
+	}
+	layout.end = offset;
+	return layout;
+}
+
+bool EnvironmentTable::open(const char * tablePath, const char * sourcePath) {
+	close();
+
+	if (!file.open(tablePath)) {
+		return false;
+	}
+
+	// The header and the columns it announces must match the file
+	if (file.size() < sizeof(EnvironmentTableHeader)) {
+		close();
+		return false;
+	}
+	const EnvironmentTableHeader * header = (const EnvironmentTableHeader *)file.data();
+	if (memcmp(header->magic, ENVIRONMENT_TABLE_MAGIC, sizeof(ENVIRONMENT_TABLE_MAGIC)) != 0
+		|| header->version != ENVIRONMENT_TABLE_VERSION
+		|| header->timeLength != DATA_TIME_LENGTH
+		|| header->columnCount != DATA_COLUMN_COUNT
+		|| header->rowCount > file.size()
+		|| file.size() < tableLayout(header->rowCount).end) {
+		printf("Environment table %s is damaged or was written by another version, rebuilding it.\n", tablePath);
+		close();
+		return false;
+	}
+
+	// Same size and modification time: up to date. Same size only: compare the content.
+	uint64_t sourceSize;
+	int64_t sourceModificationTime;
+	if (!getFileStatus(sourcePath, sourceSize, sourceModificationTime) || sourceSize != header->sourceSize) {
+		printf("Environment table %s is out of date, rebuilding it.\n", tablePath);
+		close();
+		return false;
+	}
+	if (sourceModificationTime != header->sourceModificationTime) {
+		uint64_t sourceHash;
+		if (!hashFile(sourcePath, sourceHash) || sourceHash != header->sourceHash) {
+			printf("Environment table %s is out of date, rebuilding it.\n", tablePath);
+			close();
+			return false;
+		}
+
+		// Same content: record the new time, the next launches won't hash the source again.
+		// Windows can't write a mapped file, so the file is mapped again afterwards.
+		size_t mappedSize = file.size();
+		file.close();
+		if (!overwriteFile(tablePath, offsetof(EnvironmentTableHeader, sourceModificationTime), &sourceModificationTime, sizeof(sourceModificationTime))) {
+			printf("Environment table %s could not be updated, its source will be hashed again.\n", tablePath);
+		}
+		if (!file.open(tablePath) || file.size() != mappedSize) {
+			close();
+			return false;
+		}
+		header = (const EnvironmentTableHeader *)file.data();
+	}
+
+	// The mapping is page aligned, so are the columns within it
+	TableLayout layout = tableLayout(header->rowCount);
+	columns.rows = (size_t)header->rowCount;
+	columns.times = (const char *)(file.data() + layout.times);
+	columns.minutes = (const int32_t *)(file.data() + layout.minutes);
+	for (int c = 0; c < DATA_COLUMN_COUNT; c++) {
+		columns.values[c] = (const float *)(file.data() + layout.values[c]);
+	}
+	printf("Loaded environment table %s (%d rows)\n", tablePath, (int)columns.rows);
+	return true;
+}
+
+void EnvironmentTable::close() {
+	columns = EnvironmentColumns();
+	file.close();
+}
+
+// Writes a column after zeros up to its offset
+static bool writeColumn(FILE * output, uint64_t & position, uint64_t offset, const void * data, size_t size) {
+	static const char padding[ENVIRONMENT_TABLE_ALIGNMENT] = {};
+	size_t paddingSize = (size_t)(offset - position);
+	if (fwrite(padding, 1, paddingSize, output) != paddingSize || (size != 0 && fwrite(data, 1, size, output) != size)) {
+		return false;
+	}
+	position = offset + size;
+	return true;
+}
+
+bool writeEnvironmentTable(const char * tablePath, const char * sourcePath, const EnvironmentColumns & columns) {
+	EnvironmentTableHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ENVIRONMENT_TABLE_MAGIC, sizeof(ENVIRONMENT_TABLE_MAGIC));
+	header.version = ENVIRONMENT_TABLE_VERSION;
+	header.timeLength = DATA_TIME_LENGTH;
+	header.rowCount = columns.rows;
+	header.columnCount = DATA_COLUMN_COUNT;
+	if (!getFileStatus(sourcePath, header.sourceSize, header.sourceModificationTime) || !hashFile(sourcePath, header.sourceHash)) {
+		return false;
+	}
+
+	std::string temporaryPath = std::string(tablePath) + ".tmp";
+	FILE * output = fopen(temporaryPath.c_str(), "wb");
+	if (output == NULL) {
+		fprintf(stderr, "%s could not be opened for writing.\n", temporaryPath.c_str());
+		return false;
+	}
+
+	TableLayout layout = tableLayout(columns.rows);
+	uint64_t position = 0;
+	bool written = writeColumn(output, position, 0, &header, sizeof(header))
+		&& writeColumn(output, position, layout.times, columns.times, columns.rows * DATA_TIME_LENGTH)
+		&& writeColumn(output, position, layout.minutes, columns.minutes, columns.rows * sizeof(int32_t));
+	for (int c = 0; c < DATA_COLUMN_COUNT && written; c++) {
+		written = writeColumn(output, position, layout.values[c], columns.values[c], columns.rows * sizeof(float));
+	}
+	written = (fclose(output) == 0) && written;
+
+	// rename() does not replace an existing file on Windows
+	remove(tablePath);
+	if (!written || rename(temporaryPath.c_str(), tablePath) != 0) {
+		fprintf(stderr, "Environment table %s could not be written.\n", tablePath);
+		remove(temporaryPath.c_str());
+		return false;
+	}
+
+	printf("Wrote environment table %s\n", tablePath);
+	return true;
+}
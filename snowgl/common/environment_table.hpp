@@ -0,0 +1,74 @@
+#ifndef ENVIRONMENT_TABLE_HPP
+#define ENVIRONMENT_TABLE_HPP
+
+#include <stdint.h>
+
+#include "csv_reader.hpp"
+#include "mapped_file.hpp"
+
+#define ENVIRONMENT_TABLE_EXTENSION ".envtable"
+#define ENVIRONMENT_TABLE_VERSION   1
+#define ENVIRONMENT_TABLE_ALIGNMENT 64      // Every column starts on a cache line
+
+/**
+ * @brief The header of an environment table file, followed by the columns of the data file, each one
+ * starting at a multiple of ENVIRONMENT_TABLE_ALIGNMENT: rowCount time labels of timeLength bytes,
+ * rowCount 32-bit minutes, then columnCount columns of rowCount floats in the order of DataColumn.
+ * Like the mesh cache, the file is written in the byte order of the machine.
+ */
+
+struct EnvironmentTableHeader {
+	char magic[8];						// "SNOWENVT"
+	uint32_t version;					// ENVIRONMENT_TABLE_VERSION
+	uint32_t timeLength;				// DATA_TIME_LENGTH
+	uint64_t sourceSize;				// Size of the CSV file the table was built from
+	int64_t sourceModificationTime;		// Its modification time
+	uint64_t sourceHash;				// Its FNV-1a hash, checked when the modification time differs
+	uint64_t rowCount;
+	uint32_t columnCount;				// DATA_COLUMN_COUNT
+	uint32_t reserved;
+};
+
+static_assert(sizeof(EnvironmentTableHeader) == 56, "EnvironmentTableHeader must not contain padding");
+
+/**
+ * @brief A memory-mapped environment table file. Its columns are used in place, straight from the mapping,
+ * so opening a year of minutes costs a few page faults instead of parsing half a million lines.
+ */
+
+class EnvironmentTable {
+private:
+	MappedFile file;
+	EnvironmentColumns columns;
+
+public:
+
+	/**
+	 * @brief Maps a table, if it is valid and up to date with its source.
+	 * @param tablePath The path of the table file.
+	 * @param sourcePath The path of the CSV file the table was built from.
+	 * @return bool False if the table is missing, damaged, or older than its source.
+	 */
+
+	bool open(const char * tablePath, const char * sourcePath);
+
+	/**
+	 * @brief Unmaps the table, the columns returned by getData() are invalid afterwards.
+	 */
+
+	void close();
+
+	const EnvironmentColumns & getData() const { return columns; }
+};
+
+/**
+ * @brief Writes the columns of a data file into a table, through a temporary file renamed at the end.
+ * @param tablePath The path of the table file.
+ * @param sourcePath The path of the CSV file the columns come from.
+ * @param columns The columns, e.g. from csv_reader::getData().
+ * @return bool True if the table has been written.
+ */
+
+bool writeEnvironmentTable(const char * tablePath, const char * sourcePath, const EnvironmentColumns & columns);
+
+#endif // ENVIRONMENT_TABLE_HPP
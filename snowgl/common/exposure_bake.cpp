@@ -0,0 +1,193 @@
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "exposure_bake.hpp"
+#include "global.hpp"
+
+// Noise added to the inclination by ShadowMapping.frag, uniform in [0, BAKE_INCLINATION_NOISE]
+#define BAKE_INCLINATION_NOISE  0.4f
+
+// Triangles are checked for exposure changes every BAKE_EDGE_SPACING texels, with BAKE_EDGE_SAMPLES taps per point.
+// A point whose exposure differs from the interpolation of the vertices by more than BAKE_EDGE_TOLERANCE flags the triangle.
+#define BAKE_EDGE_SPACING       8.0f
+#define BAKE_EDGE_SUBDIVISIONS  64
+#define BAKE_EDGE_SAMPLES       16
+#define BAKE_EDGE_TOLERANCE     0.25f
+
+namespace {
+
+/**
+ * @brief The highest surface of the mesh above every texel of a grid, seen from +z. -FLT_MAX where there is none.
+ */
+
+class HeightMap {
+private:
+	glm::vec2 origin;
+	float texelSize = 1.0f;
+	int width = 0;
+	int height = 0;
+	std::vector<float> heights;
+
+	void raise(int x, int y, float z) {
+		float & texel = heights[(size_t)y * width + x];
+		texel = std::max(texel, z);
+	}
+
+public:
+	void create(const glm::vec2 & boundsMin, const glm::vec2 & boundsMax, int resolution) {
+		glm::vec2 extent = boundsMax - boundsMin;
+		texelSize = std::max(std::max(extent.x, extent.y) / resolution, 1e-6f);
+		origin = boundsMin;
+		width = std::max(1, (int)ceilf(extent.x / texelSize));
+		height = std::max(1, (int)ceilf(extent.y / texelSize));
+		heights.assign((size_t)width * height, -FLT_MAX);
+	}
+
+	float texel() const { return texelSize; }
+
+	// Raises the texels whose center the triangle covers to the height of the triangle there
+	void rasterize(const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c) {
+		float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+		if (fabsf(area) < 1e-12f) {
+			return;
+		}
+
+		glm::vec2 lower = (glm::vec2(glm::min(a, glm::min(b, c))) - origin) / texelSize;
+		glm::vec2 upper = (glm::vec2(glm::max(a, glm::max(b, c))) - origin) / texelSize;
+		int x0 = std::max(0, (int)floorf(lower.x)), x1 = std::min(width - 1, (int)floorf(upper.x));
+		int y0 = std::max(0, (int)floorf(lower.y)), y1 = std::min(height - 1, (int)floorf(upper.y));
+
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				glm::vec2 p = origin + (glm::vec2(x, y) + 0.5f) * texelSize;
+				float wa = ((b.x - p.x) * (c.y - p.y) - (c.x - p.x) * (b.y - p.y)) / area;
+				float wb = ((c.x - p.x) * (a.y - p.y) - (a.x - p.x) * (c.y - p.y)) / area;
+				float wc = 1.0f - wa - wb;
+				if (wa >= 0.0f && wb >= 0.0f && wc >= 0.0f) {
+					raise(x, y, wa * a.z + wb * b.z + wc * c.z);
+				}
+			}
+		}
+	}
+
+	// Raises the texel of a point, so triangles smaller than a texel still leave their vertices
+	void splat(const glm::vec3 & p) {
+		int x = (int)floorf((p.x - origin.x) / texelSize);
+		int y = (int)floorf((p.y - origin.y) / texelSize);
+		if (x >= 0 && x < width && y >= 0 && y < height) {
+			raise(x, y, p.z);
+		}
+	}
+
+	float at(const glm::vec2 & p) const {
+		int x = (int)floorf((p.x - origin.x) / texelSize);
+		int y = (int)floorf((p.y - origin.y) / texelSize);
+		if (x < 0 || x >= width || y < 0 || y >= height) {
+			return -FLT_MAX;
+		}
+		return heights[(size_t)y * width + x];
+	}
+};
+
+// Points of the unit disk, evenly spread (Vogel's spiral)
+void diskSamples(int count, std::vector<glm::vec2> & out_samples) {
+	const float goldenAngle = 2.39996323f;
+	out_samples.resize(count);
+	for (int i = 0; i < count; i++) {
+		float radius = sqrtf((i + 0.5f) / count);
+		out_samples[i] = radius * glm::vec2(cosf(i * goldenAngle), sinf(i * goldenAngle));
+	}
+}
+
+// Fraction of the taps around a point that see no surface above it, the taps of the unit disk are scaled by tapRadius
+float exposureAt(const HeightMap & heights, const glm::vec3 & p, const std::vector<glm::vec2> & taps, const glm::vec2 & tapRadius, float depthBias) {
+	int exposed = 0;
+	for (const glm::vec2 & tap : taps) {
+		if (p.z >= heights.at(glm::vec2(p) + tap * tapRadius) - depthBias) {
+			exposed++;
+		}
+	}
+	return (float)exposed / taps.size();
+}
+
+// Expected value of min(dotn + noise, 1) with the noise uniform in [0, BAKE_INCLINATION_NOISE], 0 for surfaces facing down
+float expectedInclination(const glm::vec3 & normal) {
+	float length = glm::length(normal);
+	float dotn = (length > 0.0f) ? normal.z / length : 0.0f;
+	if (dotn <= 0.0f) {
+		return 0.0f;
+	}
+
+	// Below 1 the noise adds its mean, above 1 the value is clamped
+	float unclamped = std::min(std::max((1.0f - dotn) / BAKE_INCLINATION_NOISE, 0.0f), 1.0f);
+	return unclamped * 0.5f * (dotn + std::min(dotn + BAKE_INCLINATION_NOISE, 1.0f)) + (1.0f - unclamped);
+}
+
+}
+
+void bakeExposure(const PackedVertex * vertices, size_t vertexCount, const unsigned int * indices, size_t indexCount,
+	const glm::vec3 & occlusionBoundsMin, const glm::vec3 & occlusionBoundsMax, int resolution, int samples, std::vector<glm::vec3> & out_exposure) {
+
+	// Footprint of the taps of ShadowMapping.frag (poissonDisk / OCCLUSION_TAP_SPREAD of the map) and their
+	// depth bias (OCCLUSION_DEPTH_BIAS of the depth range of the map), in scene units
+	glm::vec3 occlusionExtent = occlusionBoundsMax - occlusionBoundsMin;
+	glm::vec2 tapRadius = glm::vec2(occlusionExtent) / (float)OCCLUSION_TAP_SPREAD;
+	float depthBias = OCCLUSION_DEPTH_BIAS * occlusionExtent.z;
+
+	out_exposure.assign(vertexCount, glm::vec3(1.0f, 0.0f, 0.0f));
+	if (vertexCount == 0) {
+		return;
+	}
+
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	for (size_t i = 0; i < vertexCount; i++) {
+		boundsMin = glm::min(boundsMin, vertices[i].position);
+		boundsMax = glm::max(boundsMax, vertices[i].position);
+	}
+
+	HeightMap heights;
+	heights.create(glm::vec2(boundsMin), glm::vec2(boundsMax), resolution);
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		heights.rasterize(vertices[indices[i]].position, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position);
+	}
+	for (size_t i = 0; i < vertexCount; i++) {
+		heights.splat(vertices[i].position);
+	}
+
+	std::vector<glm::vec2> taps;
+	diskSamples(std::max(samples, 1), taps);
+	for (size_t i = 0; i < vertexCount; i++) {
+		out_exposure[i].x = exposureAt(heights, vertices[i].position, taps, tapRadius, depthBias);
+		out_exposure[i].y = expectedInclination(vertices[i].normal);
+	}
+
+	// Triangles larger than a few texels may hold an occlusion edge their vertices don't see:
+	// compare the exposure inside them with the interpolation of the vertex values
+	std::vector<glm::vec2> edgeTaps;
+	diskSamples(BAKE_EDGE_SAMPLES, edgeTaps);
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		unsigned int v[3] = {indices[i], indices[i + 1], indices[i + 2]};
+		glm::vec3 a = vertices[v[0]].position, b = vertices[v[1]].position, c = vertices[v[2]].position;
+		float size = std::max(glm::length(b - a), std::max(glm::length(c - b), glm::length(a - c)));
+		int subdivisions = std::min((int)(size / (BAKE_EDGE_SPACING * heights.texel())), BAKE_EDGE_SUBDIVISIONS);
+		if (subdivisions < 2) {
+			continue;
+		}
+
+		bool edge = false;
+		for (int s = 0; s <= subdivisions && !edge; s++) {
+			for (int t = 0; s + t <= subdivisions && !edge; t++) {
+				float wb = (float)s / subdivisions, wc = (float)t / subdivisions, wa = 1.0f - wb - wc;
+				float interpolated = wa * out_exposure[v[0]].x + wb * out_exposure[v[1]].x + wc * out_exposure[v[2]].x;
+				float exposure = exposureAt(heights, wa * a + wb * b + wc * c, edgeTaps, tapRadius, depthBias);
+				edge = fabsf(exposure - interpolated) > BAKE_EDGE_TOLERANCE;
+			}
+		}
+		if (edge) {
+			for (int k = 0; k < 3; k++) {
+				out_exposure[v[k]].z = 1.0f;
+			}
+		}
+	}
+}
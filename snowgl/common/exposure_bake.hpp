@@ -0,0 +1,39 @@
+#ifndef EXPOSURE_BAKE_HPP
+#define EXPOSURE_BAKE_HPP
+
+#include <vector>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+#include "vboindexer.hpp"
+
+/**
+ * @brief Evaluates once the static terms of the snow equation at every vertex of a mesh.
+ *
+ * x: the exposure f_e, the fraction of the snowfall reaching the vertex. The mesh is rasterized into a
+ * height map seen from above (+z) and the vertex is tested against it at many points of a disk, the
+ * footprint of the four shadow taps of ShadowMapping.frag.
+ * y: the inclination f_inc, the expected value of the noisy term of ShadowMapping.frag.
+ * z: 1 if the exposure changes inside a triangle of the vertex (e.g. the shadow of an object across
+ * a large floor quad), where vertex values can't hold it: the fragment shader then tests the occlusion
+ * map itself. 0 elsewhere.
+ *
+ * Only the mesh occludes itself, in its own space: the exposure holds for instances that are only
+ * translated or scaled, and don't cover each other.
+ *
+ * @param vertices The unique interleaved vertices (see indexVBO).
+ * @param vertexCount The number of vertices.
+ * @param indices Three indices per triangle.
+ * @param indexCount The number of indices.
+ * @param occlusionBoundsMin The box the occlusion map covers, its taps and depth bias are relative to it.
+ * @param occlusionBoundsMax
+ * @param resolution Texels of the height map along its largest side.
+ * @param samples Height map tests per vertex.
+ * @param out_exposure One value per vertex.
+ */
+
+void bakeExposure(const PackedVertex * vertices, size_t vertexCount, const unsigned int * indices, size_t indexCount,
+	const glm::vec3 & occlusionBoundsMin, const glm::vec3 & occlusionBoundsMax, int resolution, int samples, std::vector<glm::vec3> & out_exposure);
+
+#endif // EXPOSURE_BAKE_HPP
@@ -7,6 +7,12 @@
 #define WINDOW_WIDTH            1024
 #define WINDOW_HEIGHT           1024
 #define WINDOW_BORDER           false
+#define MSAA_SAMPLES            4
+
+// Headless batch rendering (no window, no OpenCV GUI, frames are written to disk)
+#define USE_EGL                 // Comment this line if EGL is not installed
+#define HEADLESS_RENDERING      false     // Can also be enabled with the --headless argument
+#define HEADLESS_FRAME_PATTERN  "outputs/frame_%04d"
 
 // OpenCV Capture Window
 #define USE_OPENCV              // Comment this line if OpenCV is not installed
@@ -17,12 +23,24 @@
 #define OUTPUT_VIDEO_FILENAME   "outputs/L35S.asf"
 #define OUTPUT_VIDEO_FPS        60
 #define AUTO_STOP_RECORDING     true
+#define READBACK_RING_SIZE      3         // Frames in flight in the asynchronous readback
+
+// Output pipeline (overlay, encoding and preview run off the render thread)
+#define OUTPUT_QUEUE_CAPACITY   8
+#define OUTPUT_WORKER_THREADS   2
+#define OUTPUT_DROP_FRAMES      false     // Drop frames instead of waiting when the queue is full (not in headless mode)
+#define GPU_STATISTICS_OVERLAY  true      // Draw the statistics with OpenGL, otherwise with OpenCV on the output threads
+#define FONT_TEXTURE_LOCATION   "models/font.bmp"
+#define USE_PROGRAM_CACHE       true      // Keep the linked shader programs on disk and load them instead of compiling at the next launch
+#define PROGRAM_CACHE_DIRECTORY "programcache"
 
 // Operating Mode 
 //#define IS_WINDOWS_OS         // Comment this line on non-Windows Operating Systems
 #define DAYTIME_SIMULATION      true      
 #define FRAME_MICRO_STEP        0.0
 #define INITIAL_TIME_OF_DAY     22 * 60
+#define DATA_LOCATION           "data/data.csv"
+#define USE_ENVIRONMENT_TABLE   true      // Keep the data file as binary columns next to it (DATA_LOCATION.envtable) and map them instead of parsing it
 
 // Manual defined item (If DAYTIME_SIMULATION is set to false)
 #define MANUAL_SNOW_AMOUNT      0.0
@@ -53,12 +71,70 @@
 #define TEXTURE_LOCATION        "models/rainbow.bmp"
 //#define TEXTURE_LOCATION      "models/checkerboard.bmp"
 //#define TEXTURE_LOCATION      "models/pure_color.bmp"
+//#define TEXTURE_LOCATION      "models/rainbow.dds"      // Compressed with its mip chain by the "textures" target (tools/texture_converter.cpp)
+#define TEXTURE_STREAMING       false     // Load the texture levels in the background, the finest ones only for the instances large enough on screen
+#define TEXTURE_BUDGET_MB       64        // Video memory of the streamed textures, the levels least needed are evicted beyond it
+#define TEXTURE_UPLOAD_KB       2048      // Levels uploaded per frame at most (at least one load)
+#define TEXTURE_STREAM_TAIL     64        // The levels up to this size are loaded first, together
+#define TEXTURE_STREAM_LOADS    4         // Loads in flight, each one with its own pixel unpack buffer
+#define SPLIT_LARGE_MESHES      false     // Split meshes over 65,536 vertices into chunks with 16-bit indices instead of using 32-bit indices
+#define USE_MESH_CACHE          true      // Keep the indexed model in a binary file next to the OBJ file (MODEL_LOCATION.meshcache)
+#define USE_SCENE_IMPORTER      false     // Load all meshes and materials of MODEL_LOCATION through Assimp (any format), TEXTURE_LOCATION is only the fallback
+#define SCENE_GRID_SIZE         1         // Repeat the model on an N x N grid (instanced, for large scenes)
+#define SCENE_GRID_SPACING      40.0f     // Distance between two copies of the model on the grid
+#define USE_FRUSTUM_CULLING     true      // Skip the instances outside the camera frustum (and outside the occlusion map volume in the depth pass)
+#define USE_OCCLUSION_QUERIES   false     // Also skip the instances hidden behind others, found by occlusion queries one frame late
+#define LOD_LEVELS              4         // Simplified levels built for every mesh at load (and kept in the mesh cache), 0 to always draw at full detail
+#define LOD_REDUCTION           0.5f      // Fraction of the triangles of a level kept by the next one
+#define LOD_MAX_ERROR           0.02f     // Simplification stops at this error, as a fraction of the size of the mesh
+#define LOD_SHADING_PIXEL_ERROR 1.0f      // Coarsest level drawn on screen: its error covers at most this many pixels
+#define LOD_DEPTH_PIXEL_ERROR   2.0f      // Same for the occlusion map, which can use coarser levels than the screen
 
 // Snow effect
 #define SNOW_COLOR_R            0.9375
 #define SNOW_COLOR_G            0.9375
 #define SNOW_COLOR_B            1.0000
 #define DISTORTION_SCALAR       0.1000
+#define SHADOW_TAPS             4         // Occlusion map taps of the fragments whose exposure isn't baked (at most 16)
+#define OCCLUSION_BOX_SIZE      60.0f     // Side of the cube around the origin the occlusion map covers, in scene units
+#define OCCLUSION_TAP_SPREAD    700       // The occlusion map taps lie within 1/OCCLUSION_TAP_SPREAD of the map around the fragment
+#define OCCLUSION_DEPTH_BIAS    0.005f    // Depth bias of the occlusion map tests, in [0, 1] depth
+#define DEBUG_VIEW              0         // 0 shows the snow, 1 the visibility and 2 the inclination as colors (the V key cycles through them)
+#define SNOW_DEPTH_MAP          true      // Accumulate and melt a persistent snow layer with the weather data, and raise the exposed vertices by it
+#define SNOW_DEPTH_RESOLUTION   512       // Texels of the snow depth map, over the box of the occlusion map
+#define SNOW_FALL_RATE          0.002     // Snow depth added per minute on a flat surface at snow_amount 1, in scene units
+#define SNOW_MELT_RATE          0.0002    // Snow depth melted per minute and per degree above 0C
+#define SNOW_MAX_DEPTH          1.0       // Deepest snow layer
+#define WIND_EXPOSURE           true      // Soften the exposure with occlusion maps from a cone of snowfall directions, tilted by the wind of the data
+#define WIND_CONE_ANGLE         10.0f     // Half-angle of the cone of directions around the snowfall direction, in degrees
+#define WIND_CONE_DIRECTIONS    32        // Directions accumulated into a complete wind exposure map
+#define WIND_PASSES_PER_FRAME   4         // Directions rendered per frame while the map is accumulated (all at once in headless mode)
+#define WIND_MAP_RESOLUTION     512       // Texels of the wind exposure map, over the box of the occlusion map
+#define WIND_FALL_SPEED         1.0f      // Fall speed of the snow in still air (m/s), the wind tilts the snowfall by atan(wind speed / fall speed)
+#define WIND_TOLERANCE          2.0f      // Degrees the snowfall direction can veer before the wind exposure map is accumulated again
+#define USE_EXPOSURE_BAKE       true      // Bake the exposure and inclination of the model vertices at load (kept in the mesh cache) instead of sampling per fragment
+#define EXPOSURE_BAKE_TEXELS    2048      // Texels of the height map the exposure is baked against, along the largest side of the model
+#define EXPOSURE_BAKE_SAMPLES   64        // Height map tests per vertex
+
+// Sun shadows, cascaded shadow maps of the light direction of the data
+#define SUN_SHADOWS             true
+#define SUN_CASCADES            4         // Cascades along the view depth, at most 4
+#define SUN_SHADOW_RESOLUTION   1024      // Texels of each cascade
+#define SUN_SHADOW_DISTANCE     60.0f     // View depth the last cascade ends at
+#define SUN_CASCADE_LAMBDA      0.6f      // 1 for logarithmic cascade splits, 0 for uniform ones
+#define SUN_CASCADE_MARGIN      0.15f     // Extra size of a cascade, the camera can move this fraction of it before it is rendered again
+#define SUN_TOLERANCE           0.5f      // Degrees the sun can move before the cascades are rendered again
+
+// Local lights, shaded per cluster of the view frustum (point lights and spot lights, see common/clustered_lights.hpp)
+#define STREET_LAMP_COUNT       0         // Point lights on a ring around the scene, lit at night
+#define STREET_LAMP_RING        20.0f     // Distance of the lamps to the vertical axis of the scene
+#define STREET_LAMP_HEIGHT      6.0f
+#define STREET_LAMP_RADIUS      15.0f     // Distance a lamp lights up to
+#define STREET_LAMP_POWER       40.0f
+#define STREET_LAMP_DUSK        0.3f      // The lamps fade in as the light intensity falls below this value
+#define LIGHT_CLUSTERS_X        16        // Screen tiles of the clusters along the width
+#define LIGHT_CLUSTERS_Y        16        // Same along the height
+#define LIGHT_CLUSTER_SLICES    24        // Depth slices of the clusters, exponentially spaced between the near and far planes
 
 // Mathematical constants
 #define MY_PI                   3.1415926
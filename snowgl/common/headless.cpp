@@ -0,0 +1,159 @@
+#include <stdio.h>
+
+#include "headless.hpp"
+
+#ifdef USE_EGL
+// Keep eglplatform.h from pulling in Xlib, render farm nodes have no X server anyway.
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+static EGLDisplay headlessDisplay = EGL_NO_DISPLAY;
+static EGLContext headlessContext = EGL_NO_CONTEXT;
+
+bool createHeadlessContext() {
+
+	// Prefer a surfaceless platform display, it does not need a GPU device or a display server.
+	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (eglGetPlatformDisplayEXT != NULL) {
+		headlessDisplay = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (headlessDisplay == EGL_NO_DISPLAY) {
+		headlessDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major, minor;
+	if (headlessDisplay == EGL_NO_DISPLAY || !eglInitialize(headlessDisplay, &major, &minor)) {
+		fprintf(stderr, "Failed to initialize EGL display (0x%x).\n", eglGetError());
+		return false;
+	}
+	printf("Headless rendering with EGL %d.%d\n", major, minor);
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "EGL does not support desktop OpenGL.\n");
+		destroyHeadlessContext();
+		return false;
+	}
+
+	// The default framebuffer is never used, only pick a config to be able to create the context.
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = NULL;
+	EGLint numConfigs = 0;
+	eglChooseConfig(headlessDisplay, configAttributes, &config, 1, &numConfigs);
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	headlessContext = eglCreateContext(headlessDisplay, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttributes);
+	if (headlessContext == EGL_NO_CONTEXT) {
+		fprintf(stderr, "Failed to create EGL context (0x%x).\n", eglGetError());
+		destroyHeadlessContext();
+		return false;
+	}
+
+	// EGL_KHR_surfaceless_context: no pbuffer is needed since we only render into FBOs.
+	if (!eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, headlessContext)) {
+		fprintf(stderr, "Failed to make EGL context current (0x%x).\n", eglGetError());
+		destroyHeadlessContext();
+		return false;
+	}
+
+	return true;
+}
+
+void destroyHeadlessContext() {
+	if (headlessDisplay == EGL_NO_DISPLAY) {
+		return;
+	}
+
+	eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (headlessContext != EGL_NO_CONTEXT) {
+		eglDestroyContext(headlessDisplay, headlessContext);
+		headlessContext = EGL_NO_CONTEXT;
+	}
+	eglTerminate(headlessDisplay);
+	headlessDisplay = EGL_NO_DISPLAY;
+}
+
+#else
+
+bool createHeadlessContext() {
+	fprintf(stderr, "Headless rendering requires EGL, define USE_EGL in global.hpp.\n");
+	return false;
+}
+
+void destroyHeadlessContext() {}
+
+#endif
+
+bool createOffscreenTarget(OffscreenTarget & target, int width, int height, int samples) {
+	target.width = width;
+	target.height = height;
+	target.samples = samples > 1 ? samples : 0;
+
+	// Multisampled framebuffer the scene is rendered into
+	glGenFramebuffers(1, &target.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+
+	glGenRenderbuffers(1, &target.colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.colorBuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, target.samples, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.colorBuffer);
+
+	glGenRenderbuffers(1, &target.depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.depthBuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, target.samples, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depthBuffer);
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	// Single-sampled framebuffer the pixels are read back from
+	glGenFramebuffers(1, &target.resolveFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.resolveFramebuffer);
+
+	glGenRenderbuffers(1, &target.resolveBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.resolveBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.resolveBuffer);
+
+	complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete) {
+		fprintf(stderr, "Offscreen framebuffer is incomplete.\n");
+	}
+	return complete;
+}
+
+void resolveOffscreenTarget(const OffscreenTarget & target) {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, target.framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.resolveFramebuffer);
+	glBlitFramebuffer(0, 0, target.width, target.height, 0, 0, target.width, target.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.framebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, target.resolveFramebuffer);
+}
+
+void deleteOffscreenTarget(OffscreenTarget & target) {
+	glDeleteFramebuffers(1, &target.framebuffer);
+	glDeleteFramebuffers(1, &target.resolveFramebuffer);
+	glDeleteRenderbuffers(1, &target.colorBuffer);
+	glDeleteRenderbuffers(1, &target.depthBuffer);
+	glDeleteRenderbuffers(1, &target.resolveBuffer);
+	target = OffscreenTarget();
+}
@@ -0,0 +1,66 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include <GL/glew.h>
+#include "global.hpp"
+
+/**
+ * @brief An offscreen render target that replaces the default framebuffer in headless mode.
+ *
+ * The scene is rendered into a multisampled framebuffer (colour and depth renderbuffers), which is
+ * resolved into a single-sampled framebuffer before the pixels are read back.
+ */
+
+struct OffscreenTarget {
+	GLuint framebuffer = 0;
+	GLuint colorBuffer = 0;
+	GLuint depthBuffer = 0;
+	GLuint resolveFramebuffer = 0;
+	GLuint resolveBuffer = 0;
+	int width = 0;
+	int height = 0;
+	int samples = 0;
+};
+
+/**
+ * @brief Creates an OpenGL 3.3 core context without any window or display server.
+ *
+ * The context is created through EGL on a surfaceless display (Mesa's EGL_PLATFORM_SURFACELESS_MESA,
+ * falling back to the default display) and made current on the calling thread.
+ * @return bool True if the context is current, false otherwise.
+ */
+
+bool createHeadlessContext();
+
+/**
+ * @brief Releases the context created by createHeadlessContext().
+ */
+
+void destroyHeadlessContext();
+
+/**
+ * @brief Creates the framebuffers of an offscreen render target.
+ * @param target The render target to initialize.
+ * @param width The width of the render target in pixels.
+ * @param height The height of the render target in pixels.
+ * @param samples The number of MSAA samples, 0 or 1 disables multisampling.
+ * @return bool True if both framebuffers are complete, false otherwise.
+ */
+
+bool createOffscreenTarget(OffscreenTarget & target, int width, int height, int samples);
+
+/**
+ * @brief Resolves the multisampled framebuffer and binds the result as GL_READ_FRAMEBUFFER.
+ * @param target The render target to resolve.
+ */
+
+void resolveOffscreenTarget(const OffscreenTarget & target);
+
+/**
+ * @brief Deletes all framebuffers and renderbuffers of an offscreen render target.
+ * @param target The render target to delete.
+ */
+
+void deleteOffscreenTarget(OffscreenTarget & target);
+
+#endif // HEADLESS_HPP
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "image.hpp"
+
+// Little-endian fields of the BMP headers
+static uint32_t readU32(const unsigned char * p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t readU16(const unsigned char * p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+// What the pixels of a BMP file need, from its headers
+struct BMPHeader {
+	uint32_t dataPos;
+	int32_t width;
+	int32_t height;		// Negative for rows stored from the top
+	int bytesPerPixel;
+};
+
+static bool readBMPHeader(FILE * file, const char * path, BMPHeader & out_header) {
+	unsigned char header[54];
+	if (fread(header, 1, sizeof(header), file) != sizeof(header) || header[0] != 'B' || header[1] != 'M') {
+		fprintf(stderr, "%s is not a BMP file.\n", path);
+		return false;
+	}
+
+	out_header.dataPos = readU32(header + 0x0A);
+	out_header.width = (int32_t)readU32(header + 0x12);
+	out_header.height = (int32_t)readU32(header + 0x16);
+	uint16_t bitsPerPixel = readU16(header + 0x1C);
+	uint32_t compression = readU32(header + 0x1E);
+	if (compression != 0 || (bitsPerPixel != 24 && bitsPerPixel != 32) || out_header.width <= 0 || out_header.height == 0) {
+		fprintf(stderr, "%s: only uncompressed 24 and 32-bit BMP files are supported.\n", path);
+		return false;
+	}
+	if (out_header.dataPos == 0) {
+		out_header.dataPos = sizeof(header);
+	}
+	out_header.bytesPerPixel = bitsPerPixel / 8;
+	return true;
+}
+
+bool readBMPSize(const char * path, int & out_width, int & out_height) {
+	FILE * file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "%s could not be opened.\n", path);
+		return false;
+	}
+	BMPHeader header;
+	bool valid = readBMPHeader(file, path, header);
+	fclose(file);
+	if (valid) {
+		out_width = header.width;
+		out_height = (header.height > 0) ? header.height : -header.height;
+	}
+	return valid;
+}
+
+bool readBMP(const char * path, Image & out_image) {
+	FILE * file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "%s could not be opened.\n", path);
+		return false;
+	}
+
+	BMPHeader header;
+	if (!readBMPHeader(file, path, header)) {
+		fclose(file);
+		return false;
+	}
+	uint32_t dataPos = header.dataPos;
+	int32_t width = header.width;
+	int32_t height = header.height;
+	int bytesPerPixel = header.bytesPerPixel;
+
+	// Rows are padded to 4 bytes, and stored from the bottom unless the height is negative
+	bool bottomUp = height > 0;
+	height = bottomUp ? height : -height;
+	size_t rowSize = ((size_t)width * bytesPerPixel + 3) & ~(size_t)3;
+	std::vector<unsigned char> data(rowSize * height);
+	if (fseek(file, dataPos, SEEK_SET) != 0 || fread(data.data(), 1, data.size(), file) != data.size()) {
+		fprintf(stderr, "%s is truncated.\n", path);
+		fclose(file);
+		return false;
+	}
+	fclose(file);
+
+	out_image.width = width;
+	out_image.height = height;
+	out_image.pixels.resize((size_t)width * height * 4);
+	for (int y = 0; y < height; y++) {
+		const unsigned char * row = &data[rowSize * (bottomUp ? height - 1 - y : y)];
+		unsigned char * pixel = &out_image.pixels[(size_t)y * width * 4];
+		for (int x = 0; x < width; x++, row += bytesPerPixel, pixel += 4) {
+			pixel[0] = row[2];
+			pixel[1] = row[1];
+			pixel[2] = row[0];
+			pixel[3] = (bytesPerPixel == 4) ? row[3] : 255;
+		}
+	}
+	return true;
+}
+
+void downsampleImage(const Image & image, Image & out_half) {
+	out_half.width = std::max(image.width / 2, 1);
+	out_half.height = std::max(image.height / 2, 1);
+	out_half.pixels.resize((size_t)out_half.width * out_half.height * 4);
+
+	for (int y = 0; y < out_half.height; y++) {
+		int y0 = std::min(y * 2, image.height - 1), y1 = std::min(y * 2 + 1, image.height - 1);
+		for (int x = 0; x < out_half.width; x++) {
+			int x0 = std::min(x * 2, image.width - 1), x1 = std::min(x * 2 + 1, image.width - 1);
+			const unsigned char * p00 = &image.pixels[((size_t)y0 * image.width + x0) * 4];
+			const unsigned char * p01 = &image.pixels[((size_t)y0 * image.width + x1) * 4];
+			const unsigned char * p10 = &image.pixels[((size_t)y1 * image.width + x0) * 4];
+			const unsigned char * p11 = &image.pixels[((size_t)y1 * image.width + x1) * 4];
+			unsigned char * out = &out_half.pixels[((size_t)y * out_half.width + x) * 4];
+			for (int c = 0; c < 4; c++) {
+				out[c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+			}
+		}
+	}
+}
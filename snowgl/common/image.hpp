@@ -0,0 +1,36 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <vector>
+
+/**
+ * @brief An 8-bit RGBA image in memory, rows from the top.
+ */
+
+struct Image {
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;		// width * height * 4 bytes
+};
+
+/**
+ * @brief Reads an uncompressed 24 or 32-bit BMP file (alpha is 255 for 24-bit files).
+ * @return bool False if the file can't be read or isn't supported.
+ */
+
+bool readBMP(const char * path, Image & out_image);
+
+/**
+ * @brief Reads the size of a BMP file without its pixels.
+ * @return bool False if the file can't be read or isn't supported by readBMP.
+ */
+
+bool readBMPSize(const char * path, int & out_width, int & out_height);
+
+/**
+ * @brief Halves an image with a 2x2 box filter, the next level of its mip chain. Odd sizes are rounded down, at least 1.
+ */
+
+void downsampleImage(const Image & image, Image & out_half);
+
+#endif // IMAGE_HPP
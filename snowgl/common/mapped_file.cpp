@@ -0,0 +1,155 @@
+#include "mapped_file.hpp"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#ifndef IS_WINDOWS_OS
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef IS_WINDOWS_OS
+
+bool MappedFile::open(const char * path, bool sequential) {
+	close();
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		close();
+		return false;
+	}
+	mappedSize = (size_t)size.QuadPart;
+	if (mappedSize == 0) {
+		return true;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		close();
+		return false;
+	}
+
+	mappedData = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (mappedData == NULL) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close() {
+	if (mappedData != NULL) {
+		UnmapViewOfFile(mappedData);
+	}
+	if (mapping != NULL) {
+		CloseHandle(mapping);
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+	}
+	mappedData = NULL;
+	mappedSize = 0;
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const char * path, bool sequential) {
+	close();
+
+	int descriptor = ::open(path, O_RDONLY);
+	if (descriptor < 0) {
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0) {
+		::close(descriptor);
+		return false;
+	}
+
+	mappedSize = (size_t)status.st_size;
+	if (mappedSize > 0) {
+		void * address = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (address == MAP_FAILED) {
+			::close(descriptor);
+			mappedSize = 0;
+			return false;
+		}
+		mappedData = (const unsigned char *)address;
+		madvise(address, mappedSize, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	::close(descriptor);
+	return true;
+}
+
+void MappedFile::close() {
+	if (mappedData != NULL) {
+		munmap((void *)mappedData, mappedSize);
+	}
+	mappedData = NULL;
+	mappedSize = 0;
+}
+
+#endif
+
+const unsigned char * MappedFile::data() const {
+	return mappedData;
+}
+
+size_t MappedFile::size() const {
+	return mappedSize;
+}
+
+bool getFileStatus(const char * path, uint64_t & size, int64_t & modificationTime) {
+	struct stat status;
+	if (stat(path, &status) != 0) {
+		return false;
+	}
+	size = (uint64_t)status.st_size;
+	modificationTime = (int64_t)status.st_mtime;
+	return true;
+}
+
+bool hashFile(const char * path, uint64_t & hash) {
+	MappedFile source;
+	if (!source.open(path, true)) {
+		return false;
+	}
+
+	hash = hashBytes(source.data(), source.size());
+	return true;
+}
+
+uint64_t hashBytes(const void * data, size_t size) {
+	const unsigned char * bytes = (const unsigned char *)data;
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+bool overwriteFile(const char * path, uint64_t offset, const void * data, size_t size) {
+	FILE * file = fopen(path, "r+b");
+	if (file == NULL) {
+		return false;
+	}
+	bool written = fseek(file, (long)offset, SEEK_SET) == 0 && fwrite(data, 1, size, file) == size;
+	return (fclose(file) == 0) && written;
+}
@@ -0,0 +1,82 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "global.hpp"
+
+#ifdef IS_WINDOWS_OS
+#include <windows.h>
+#endif
+
+/**
+ * @brief A read-only memory mapping of a whole file (mmap, or a file mapping object on Windows).
+ * The pages are loaded by the OS on first access, nothing is copied.
+ */
+
+class MappedFile {
+private:
+	const unsigned char * mappedData = NULL;
+	size_t mappedSize = 0;
+
+	#ifdef IS_WINDOWS_OS
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+	#endif
+
+public:
+	MappedFile() {}
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	/**
+	 * @brief Maps a file, a previously mapped file is closed first.
+	 * @param path The path of the file.
+	 * @param sequential Hints the OS that the file will be read from the beginning to the end.
+	 * @return bool True if the file is mapped (an empty file is mapped with data() == NULL).
+	 */
+
+	bool open(const char * path, bool sequential = false);
+
+	/**
+	 * @brief Unmaps the file, the pointers returned by data() are invalid afterwards.
+	 */
+
+	void close();
+
+	const unsigned char * data() const;
+	size_t size() const;
+};
+
+/**
+ * @brief Returns the size and the last modification time of a file.
+ * @return bool False if the file does not exist.
+ */
+
+bool getFileStatus(const char * path, uint64_t & size, int64_t & modificationTime);
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of a whole file, read through a sequential mapping.
+ * @return bool False if the file can't be mapped.
+ */
+
+bool hashFile(const char * path, uint64_t & hash);
+
+/**
+ * @brief Computes the 64-bit FNV-1a hash of a block of memory, the same hash as hashFile().
+ */
+
+uint64_t hashBytes(const void * data, size_t size);
+
+/**
+ * @brief Overwrites bytes of an existing file in place, e.g. a field of a cache header.
+ * The file must not be mapped while it is written (Windows doesn't share a mapped file for writing).
+ * @return bool True if all the bytes have been written.
+ */
+
+bool overwriteFile(const char * path, uint64_t offset, const void * data, size_t size);
+
+#endif // MAPPED_FILE_HPP
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+#include "mesh_cache.hpp"
+
+static const char MESH_CACHE_MAGIC[8] = {'S', 'N', 'O', 'W', 'M', 'E', 'S', 'H'};
+
+// Size of the baked exposure section following the vertices
+static uint64_t exposureSize(const MeshCacheHeader * header) {
+	return (header->exposureSamples != 0) ? header->vertexCount * sizeof(glm::vec3) : 0;
+}
+
+uint64_t hashMeshCacheSettings(const MeshCacheSettings & settings) {
+	return hashBytes(&settings, sizeof(settings));
+}
+
+bool MeshCache::open(const char * cachePath, const char * sourcePath, uint64_t settingsHash) {
+	close();
+
+	if (!file.open(cachePath)) {
+		return false;
+	}
+
+	// The header and the data sizes it announces must match the file
+	if (file.size() < sizeof(MeshCacheHeader)) {
+		close();
+		return false;
+	}
+	const MeshCacheHeader * candidate = (const MeshCacheHeader *)file.data();
+	uint64_t lodTableEnd = sizeof(MeshCacheHeader) + candidate->vertexCount * sizeof(PackedVertex) + exposureSize(candidate)
+		+ candidate->indexCount * sizeof(unsigned int) + (uint64_t)candidate->lodCount * sizeof(MeshCacheLod);
+	if (memcmp(candidate->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0
+		|| candidate->version != MESH_CACHE_VERSION
+		|| candidate->vertexSize != sizeof(PackedVertex)
+		|| file.size() < lodTableEnd) {
+		printf("Mesh cache %s is damaged or was written by another version, rebuilding it.\n", cachePath);
+		close();
+		return false;
+	}
+
+	// Levels of detail, each one within the level indices that end the file
+	const MeshCacheLod * lodTable = (const MeshCacheLod *)(file.data() + lodTableEnd - candidate->lodCount * sizeof(MeshCacheLod));
+	uint64_t lodIndexCount = (file.size() - lodTableEnd) / sizeof(unsigned int);
+	bool levelsValid = (file.size() - lodTableEnd) % sizeof(unsigned int) == 0;
+	for (uint32_t i = 0; i < candidate->lodCount && levelsValid; i++) {
+		levelsValid = lodTable[i].firstIndex <= lodIndexCount && lodTable[i].indexCount <= lodIndexCount - lodTable[i].firstIndex;
+		MeshLod level = {(size_t)lodTable[i].firstIndex, (size_t)lodTable[i].indexCount, lodTable[i].error};
+		levels.push_back(level);
+	}
+	if (!levelsValid) {
+		printf("Mesh cache %s is damaged or was written by another version, rebuilding it.\n", cachePath);
+		close();
+		return false;
+	}
+
+	if (candidate->settingsHash != settingsHash) {
+		printf("Mesh cache %s was built with other settings, rebuilding it.\n", cachePath);
+		close();
+		return false;
+	}
+
+	// Same size and modification time: up to date. Same size only: compare the content.
+	uint64_t sourceSize;
+	int64_t sourceModificationTime;
+	if (!getFileStatus(sourcePath, sourceSize, sourceModificationTime) || sourceSize != candidate->sourceSize) {
+		printf("Mesh cache %s is out of date, rebuilding it.\n", cachePath);
+		close();
+		return false;
+	}
+	if (sourceModificationTime != candidate->sourceModificationTime) {
+		uint64_t sourceHash;
+		if (!hashFile(sourcePath, sourceHash) || sourceHash != candidate->sourceHash) {
+			printf("Mesh cache %s is out of date, rebuilding it.\n", cachePath);
+			close();
+			return false;
+		}
+
+		// Same content: record the new time, the next launches won't hash the source again.
+		// Windows can't write a mapped file, so the file is mapped again afterwards.
+		size_t mappedSize = file.size();
+		file.close();
+		if (!overwriteFile(cachePath, offsetof(MeshCacheHeader, sourceModificationTime), &sourceModificationTime, sizeof(sourceModificationTime))) {
+			printf("Mesh cache %s could not be updated, its source will be hashed again.\n", cachePath);
+		}
+		if (!file.open(cachePath) || file.size() != mappedSize) {
+			close();
+			return false;
+		}
+		candidate = (const MeshCacheHeader *)file.data();
+	}
+
+	header = candidate;
+	printf("Loaded mesh cache %s (%d vertices, %d indices, %d levels of detail)\n", cachePath, (int)header->vertexCount, (int)header->indexCount, (int)header->lodCount);
+	return true;
+}
+
+void MeshCache::close() {
+	header = NULL;
+	levels.clear();
+	file.close();
+}
+
+const PackedVertex * MeshCache::vertices() const {
+	return (const PackedVertex *)(file.data() + sizeof(MeshCacheHeader));
+}
+
+size_t MeshCache::vertexCount() const {
+	return (size_t)header->vertexCount;
+}
+
+const glm::vec3 * MeshCache::exposure() const {
+	if (header->exposureSamples == 0) {
+		return NULL;
+	}
+	return (const glm::vec3 *)(file.data() + sizeof(MeshCacheHeader) + header->vertexCount * sizeof(PackedVertex));
+}
+
+unsigned int MeshCache::exposureSamples() const {
+	return header->exposureSamples;
+}
+
+const unsigned int * MeshCache::indices() const {
+	return (const unsigned int *)(file.data() + sizeof(MeshCacheHeader) + header->vertexCount * sizeof(PackedVertex) + exposureSize(header));
+}
+
+size_t MeshCache::indexCount() const {
+	return (size_t)header->indexCount;
+}
+
+const unsigned int * MeshCache::lodIndices() const {
+	return (const unsigned int *)(file.data() + sizeof(MeshCacheHeader) + header->vertexCount * sizeof(PackedVertex) + exposureSize(header)
+		+ header->indexCount * sizeof(unsigned int) + header->lodCount * sizeof(MeshCacheLod));
+}
+
+const MeshLod * MeshCache::lods() const {
+	return levels.data();
+}
+
+size_t MeshCache::lodCount() const {
+	return levels.size();
+}
+
+glm::vec3 MeshCache::boundsMin() const {
+	return glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+}
+
+glm::vec3 MeshCache::boundsMax() const {
+	return glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+}
+
+bool writeMeshCache(const char * cachePath, const char * sourcePath, const std::vector<PackedVertex> & vertices, const std::vector<unsigned int> & indices,
+	const std::vector<unsigned int> & lodIndices, const std::vector<MeshLod> & lods,
+	const std::vector<glm::vec3> & exposure, unsigned int exposureSamples, uint64_t settingsHash) {
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof(PackedVertex);
+	header.vertexCount = vertices.size();
+	header.indexCount = indices.size();
+	header.lodCount = lods.size();
+	header.exposureSamples = (exposure.size() == vertices.size() && !vertices.empty()) ? exposureSamples : 0;
+	header.settingsHash = settingsHash;
+
+	std::vector<MeshCacheLod> lodTable(lods.size());
+	for (size_t i = 0; i < lods.size(); i++) {
+		lodTable[i].firstIndex = lods[i].firstIndex;
+		lodTable[i].indexCount = lods[i].indexCount;
+		lodTable[i].error = lods[i].error;
+		lodTable[i].reserved = 0;
+	}
+
+	if (!getFileStatus(sourcePath, header.sourceSize, header.sourceModificationTime) || !hashFile(sourcePath, header.sourceHash)) {
+		return false;
+	}
+
+	glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+	if (!vertices.empty()) {
+		boundsMin = boundsMax = vertices[0].position;
+	}
+	for (size_t i = 1; i < vertices.size(); i++) {
+		boundsMin = glm::min(boundsMin, vertices[i].position);
+		boundsMax = glm::max(boundsMax, vertices[i].position);
+	}
+	for (int k = 0; k < 3; k++) {
+		header.boundsMin[k] = boundsMin[k];
+		header.boundsMax[k] = boundsMax[k];
+	}
+
+	std::string temporaryPath = std::string(cachePath) + ".tmp";
+	FILE * output = fopen(temporaryPath.c_str(), "wb");
+	if (output == NULL) {
+		fprintf(stderr, "%s could not be opened for writing.\n", temporaryPath.c_str());
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, output) == 1
+		&& fwrite(vertices.data(), sizeof(PackedVertex), vertices.size(), output) == vertices.size()
+		&& (header.exposureSamples == 0 || fwrite(exposure.data(), sizeof(glm::vec3), exposure.size(), output) == exposure.size())
+		&& fwrite(indices.data(), sizeof(unsigned int), indices.size(), output) == indices.size()
+		&& fwrite(lodTable.data(), sizeof(MeshCacheLod), lodTable.size(), output) == lodTable.size()
+		&& fwrite(lodIndices.data(), sizeof(unsigned int), lodIndices.size(), output) == lodIndices.size();
+	written = (fclose(output) == 0) && written;
+
+	// rename() does not replace an existing file on Windows
+	remove(cachePath);
+	if (!written || rename(temporaryPath.c_str(), cachePath) != 0) {
+		fprintf(stderr, "Mesh cache %s could not be written.\n", cachePath);
+		remove(temporaryPath.c_str());
+		return false;
+	}
+
+	printf("Wrote mesh cache %s\n", cachePath);
+	return true;
+}
@@ -0,0 +1,149 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include <vector>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+#include "vboindexer.hpp"
+#include "mapped_file.hpp"
+#include "simplify.hpp"
+
+#define MESH_CACHE_EXTENSION    ".meshcache"
+#define MESH_CACHE_VERSION      4
+
+/**
+ * @brief The header of a mesh cache file, followed by vertexCount PackedVertex, their baked exposure (vertexCount
+ * glm::vec3, only if exposureSamples is not 0), indexCount 32-bit indices, lodCount MeshCacheLod and the 32-bit
+ * indices of the levels of detail.
+ * The file is written in the byte order of the machine, it is a local cache and not an exchange format.
+ */
+
+struct MeshCacheHeader {
+	char magic[8];						// "SNOWMESH"
+	uint32_t version;					// MESH_CACHE_VERSION
+	uint32_t vertexSize;				// sizeof(PackedVertex), guards against layout changes
+	uint64_t sourceSize;				// Size of the OBJ file the cache was built from
+	int64_t sourceModificationTime;		// Its modification time
+	uint64_t sourceHash;				// Its FNV-1a hash, checked when the modification time differs
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t lodCount;					// Simplified levels of the mesh (see buildMeshLods)
+	uint32_t exposureSamples;			// Samples per vertex of the baked exposure (see bakeExposure), 0 without one
+	uint64_t settingsHash;				// Hash of the MeshCacheSettings the content was built with
+};
+
+static_assert(sizeof(MeshCacheHeader) == 96, "MeshCacheHeader must not contain padding");
+
+/**
+ * @brief The settings the content of a mesh cache depends on besides its source file. A cache built
+ * with other settings is out of date. Settings of a disabled step are left at 0.
+ */
+
+struct MeshCacheSettings {
+	uint32_t lodLevels;					// LOD_LEVELS
+	float lodReduction;					// LOD_REDUCTION
+	float lodMaxError;					// LOD_MAX_ERROR
+	uint32_t exposureSamples;			// EXPOSURE_BAKE_SAMPLES
+	uint32_t exposureTexels;			// EXPOSURE_BAKE_TEXELS
+	float occlusionBoxSize;				// OCCLUSION_BOX_SIZE, the exposure reproduces the occlusion map taps
+	uint32_t occlusionTapSpread;		// OCCLUSION_TAP_SPREAD
+	float occlusionDepthBias;			// OCCLUSION_DEPTH_BIAS
+};
+
+static_assert(sizeof(MeshCacheSettings) == 32, "MeshCacheSettings must not contain padding");
+
+/**
+ * @brief The hash stored in MeshCacheHeader::settingsHash.
+ */
+
+uint64_t hashMeshCacheSettings(const MeshCacheSettings & settings);
+
+/**
+ * @brief A simplified level in a mesh cache file, a range of the level indices.
+ */
+
+struct MeshCacheLod {
+	uint64_t firstIndex;
+	uint64_t indexCount;
+	float error;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(MeshCacheLod) == 24, "MeshCacheLod must not contain padding");
+
+/**
+ * @brief A memory-mapped mesh cache file. The vertices and indices (of every level) are used in place, straight from the mapping.
+ */
+
+class MeshCache {
+private:
+	MappedFile file;
+	const MeshCacheHeader * header = NULL;
+	std::vector<MeshLod> levels;
+
+public:
+
+	/**
+	 * @brief Maps a mesh cache and checks that it is up to date with its source file.
+	 * @param cachePath The path of the cache file.
+	 * @param sourcePath The path of the OBJ file the cache has been built from.
+	 * @param settingsHash The hash of the current settings (see hashMeshCacheSettings).
+	 * @return bool True if the cache can be used, false if it is missing, damaged or out of date.
+	 */
+
+	bool open(const char * cachePath, const char * sourcePath, uint64_t settingsHash);
+
+	/**
+	 * @brief Unmaps the cache, the pointers returned by vertices() and indices() are invalid afterwards.
+	 */
+
+	void close();
+
+	const PackedVertex * vertices() const;
+	size_t vertexCount() const;
+	const unsigned int * indices() const;
+	size_t indexCount() const;
+	const unsigned int * lodIndices() const;
+	const MeshLod * lods() const;
+	size_t lodCount() const;
+
+	/**
+	 * @brief The baked exposure of every vertex, NULL if the cache has none.
+	 */
+
+	const glm::vec3 * exposure() const;
+
+	/**
+	 * @brief The samples per vertex the exposure was baked with, 0 if the cache has none.
+	 */
+
+	unsigned int exposureSamples() const;
+
+	glm::vec3 boundsMin() const;
+	glm::vec3 boundsMax() const;
+};
+
+/**
+ * @brief Writes the indexed mesh of a source file into a mesh cache file (through a temporary file,
+ * so a reader never sees a partial cache).
+ * @param cachePath The path of the cache file.
+ * @param sourcePath The path of the OBJ file the mesh has been loaded from.
+ * @param vertices The unique interleaved vertices (see indexVBO).
+ * @param indices Three indices per triangle.
+ * @param lodIndices The indices of the simplified levels (see buildMeshLods).
+ * @param lods The simplified levels, empty if the mesh has none.
+ * @param exposure The baked exposure of every vertex, empty if the mesh has none.
+ * @param exposureSamples The samples per vertex it was baked with.
+ * @param settingsHash The hash of the settings the content was built with (see hashMeshCacheSettings).
+ * @return bool True if the cache has been written.
+ */
+
+bool writeMeshCache(const char * cachePath, const char * sourcePath, const std::vector<PackedVertex> & vertices, const std::vector<unsigned int> & indices,
+	const std::vector<unsigned int> & lodIndices, const std::vector<MeshLod> & lods,
+	const std::vector<glm::vec3> & exposure, unsigned int exposureSamples, uint64_t settingsHash);
+
+#endif // MESH_CACHE_HPP
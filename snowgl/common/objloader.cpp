@@ -2,13 +2,19 @@
 #include <stdio.h>
 #include <string>
 #include <cstring>
+#include <climits>
+#include <charconv>
+#include <thread>
+#include <algorithm>
+#include <functional>
 
 #include <glm/glm.hpp>
 
+#include "mapped_file.hpp"
 #include "objloader.hpp"
 
 // Very, VERY simple OBJ loader.
-// Here is a short list of features a real function would provide : 
+// Here is a short list of features a real function would provide :
 // - Binary files. Reading a model should be just a few memcpy's away, not parsing a file at runtime. In short : OBJ is not very great.
 // - Animations & bones (includes bones weights)
 // - Multiple UVs
@@ -17,95 +23,313 @@
 // - More secure. Change another line and you can inject code.
 // - Loading from memory, stream, etc
 
-bool loadOBJ(
-	const char * path, 
-	std::vector<glm::vec3> & out_vertices, 
-	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
-){
-	printf("Loading OBJ file %s...\n", path);
+// Marks an attribute a corner does not have, while the chunk is parsed
+static const int ABSENT = INT_MIN;
 
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices; 
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
+// Bits of ChunkCorner::relative: the index counts from the first element of the chunk, not of the file
+static const unsigned char RELATIVE_POSITION = 1;
+static const unsigned char RELATIVE_UV = 2;
+static const unsigned char RELATIVE_NORMAL = 4;
 
+struct ChunkCorner {
+	int position;
+	int uv;
+	int normal;
+	unsigned char relative;
+};
 
-	FILE * file = fopen(path, "r");
-	if( file == NULL ){
-		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-		getchar();
+// What a thread parsed from its part of the file
+struct ObjChunk {
+	const char * begin;
+	const char * end;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<ChunkCorner> corners;
+	int errorLine = 0;		// Line number in the chunk (1-based), 0 if the chunk has been parsed
+};
+
+static inline const char * skipSpaces(const char * p, const char * end){
+	while ( p < end && (*p == ' ' || *p == '\t' || *p == '\r') ){
+		p++;
+	}
+	return p;
+}
+
+static inline bool parseFloat(const char * & p, const char * end, float & value){
+	p = skipSpaces(p, end);
+	if ( p < end && *p == '+' ){
+		p++;
+	}
+	std::from_chars_result result = std::from_chars(p, end, value);
+	if ( result.ec != std::errc() ){
+		return false;
+	}
+	p = result.ptr;
+	return true;
+}
+
+static inline bool parseInt(const char * & p, const char * end, int & value){
+	if ( p < end && *p == '+' ){
+		p++;
+	}
+	std::from_chars_result result = std::from_chars(p, end, value);
+	if ( result.ec != std::errc() || value == 0 ){
 		return false;
 	}
+	p = result.ptr;
+	return true;
+}
 
-	while( 1 ){
+// 1-based index of the file, or negative index relative to the count parsed so far
+static inline int resolveIndex(int index, size_t count, unsigned char bit, unsigned char & relative){
+	if ( index > 0 ){
+		return index - 1;
+	}
+	relative |= bit;
+	return (int)count + index;
+}
 
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
+// Parses one corner of a face: v, v/vt, v//vn or v/vt/vn
+static bool parseCorner(const char * & p, const char * end, const ObjChunk & chunk, ChunkCorner & corner){
+	int index;
+	corner.uv = ABSENT;
+	corner.normal = ABSENT;
+	corner.relative = 0;
 
-		// else : parse lineHeader
-		
-		if ( strcmp( lineHeader, "v" ) == 0 ){
+	if ( !parseInt(p, end, index) ){
+		return false;
+	}
+	corner.position = resolveIndex(index, chunk.positions.size(), RELATIVE_POSITION, corner.relative);
+
+	if ( p < end && *p == '/' ){
+		p++;
+		if ( p < end && *p != '/' ){
+			if ( !parseInt(p, end, index) ){
+				return false;
+			}
+			corner.uv = resolveIndex(index, chunk.uvs.size(), RELATIVE_UV, corner.relative);
+		}
+		if ( p < end && *p == '/' ){
+			p++;
+			if ( !parseInt(p, end, index) ){
+				return false;
+			}
+			corner.normal = resolveIndex(index, chunk.normals.size(), RELATIVE_NORMAL, corner.relative);
+		}
+	}
+	return true;
+}
+
+static void parseChunk(ObjChunk & chunk){
+	std::vector<ChunkCorner> face;
+	int line = 0;
+
+	const char * p = chunk.begin;
+	while ( p < chunk.end ){
+		line++;
+		const char * lineEnd = (const char *)memchr(p, '\n', chunk.end - p);
+		if ( lineEnd == NULL ){
+			lineEnd = chunk.end;
+		}
+
+		p = skipSpaces(p, lineEnd);
+		bool ok = true;
+
+		if ( lineEnd - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t') ){
 			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-			temp_vertices.push_back(vertex);
-		}else if ( strcmp( lineHeader, "vt" ) == 0 ){
+			p += 2;
+			ok = parseFloat(p, lineEnd, vertex.x) && parseFloat(p, lineEnd, vertex.y) && parseFloat(p, lineEnd, vertex.z);
+			chunk.positions.push_back(vertex);
+		}else if ( lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t') ){
 			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y );
+			p += 3;
+			ok = parseFloat(p, lineEnd, uv.x) && parseFloat(p, lineEnd, uv.y);
 			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-			temp_uvs.push_back(uv);
-		}else if ( strcmp( lineHeader, "vn" ) == 0 ){
+			chunk.uvs.push_back(uv);
+		}else if ( lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t') ){
 			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-			temp_normals.push_back(normal);
-		}else if ( strcmp( lineHeader, "f" ) == 0 ){
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
-			if (matches != 9){
-				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				fclose(file);
-				return false;
+			p += 3;
+			ok = parseFloat(p, lineEnd, normal.x) && parseFloat(p, lineEnd, normal.y) && parseFloat(p, lineEnd, normal.z);
+			chunk.normals.push_back(normal);
+		}else if ( lineEnd - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t') ){
+			p += 2;
+			face.clear();
+			for ( p = skipSpaces(p, lineEnd); ok && p < lineEnd && *p != '#'; p = skipSpaces(p, lineEnd) ){
+				ChunkCorner corner;
+				ok = parseCorner(p, lineEnd, chunk, corner);
+				face.push_back(corner);
+			}
+			ok = ok && face.size() >= 3;
+
+			// Triangle fan around the first corner
+			for ( size_t k=2; ok && k<face.size(); k++ ){
+				chunk.corners.push_back(face[0]);
+				chunk.corners.push_back(face[k-1]);
+				chunk.corners.push_back(face[k]);
 			}
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			uvIndices    .push_back(uvIndex[0]);
-			uvIndices    .push_back(uvIndex[1]);
-			uvIndices    .push_back(uvIndex[2]);
-			normalIndices.push_back(normalIndex[0]);
-			normalIndices.push_back(normalIndex[1]);
-			normalIndices.push_back(normalIndex[2]);
-		}else{
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
+		}
+		// Anything else (comments, groups, materials, ...) is skipped
+
+		if ( !ok ){
+			chunk.errorLine = line;
+			return;
+		}
+		p = lineEnd + 1;
+	}
+}
+
+// Makes the indices of a chunk absolute and checks them, -1 for absent attributes
+static bool resolveChunk(const ObjChunk & chunk, size_t positionBase, size_t uvBase, size_t normalBase,
+	size_t positionCount, size_t uvCount, size_t normalCount, ObjCorner * out_corners){
+
+	for ( size_t i=0; i<chunk.corners.size(); i++ ){
+		const ChunkCorner & in = chunk.corners[i];
+		long long position = in.position + ((in.relative & RELATIVE_POSITION) ? (long long)positionBase : 0);
+		long long uv = (in.uv == ABSENT) ? -1 : in.uv + ((in.relative & RELATIVE_UV) ? (long long)uvBase : 0);
+		long long normal = (in.normal == ABSENT) ? -1 : in.normal + ((in.relative & RELATIVE_NORMAL) ? (long long)normalBase : 0);
+
+		if ( position < 0 || position >= (long long)positionCount
+			|| (in.uv != ABSENT && (uv < 0 || uv >= (long long)uvCount))
+			|| (in.normal != ABSENT && (normal < 0 || normal >= (long long)normalCount)) ){
+			return false;
 		}
 
+		out_corners[i].position = (int)position;
+		out_corners[i].uv = (int)uv;
+		out_corners[i].normal = (int)normal;
+	}
+	return true;
+}
+
+bool parseOBJ(
+	const char * path,
+	ObjMesh & out_mesh
+){
+	MappedFile file;
+	if ( !file.open(path, true) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
+	}
+
+	const char * data = (const char *)file.data();
+	const char * end = data + file.size();
+
+	// Split the file into line-aligned chunks, one per thread
+	size_t threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = std::max((size_t)1, std::min(threads, file.size() / OBJ_PARALLEL_MIN_CHUNK_SIZE));
+
+	std::vector<ObjChunk> chunks(threads);
+	const char * begin = data;
+	for ( size_t t=0; t<threads; t++ ){
+		const char * chunkEnd = (t + 1 == threads) ? end : data + file.size() * (t + 1) / threads;
+		if ( chunkEnd < begin ){
+			chunkEnd = begin;
+		}
+		const char * newline = (const char *)memchr(chunkEnd, '\n', end - chunkEnd);
+		chunkEnd = (newline == NULL || t + 1 == threads) ? end : newline + 1;
+
+		chunks[t].begin = begin;
+		chunks[t].end = chunkEnd;
+		begin = chunkEnd;
+	}
+
+	std::vector<std::thread> workers;
+	for ( size_t t=1; t<threads; t++ ){
+		workers.push_back(std::thread(parseChunk, std::ref(chunks[t])));
+	}
+	parseChunk(chunks[0]);
+	for ( size_t t=0; t<workers.size(); t++ ){
+		workers[t].join();
+	}
+
+	// Where every chunk starts in the whole file
+	std::vector<size_t> positionBase(threads + 1, 0), uvBase(threads + 1, 0), normalBase(threads + 1, 0), cornerBase(threads + 1, 0);
+	int lineBase = 0;
+	for ( size_t t=0; t<threads; t++ ){
+		if ( chunks[t].errorLine != 0 ){
+			printf("%s:%d can't be read by our parser :-( Try exporting with other options\n", path, lineBase + chunks[t].errorLine);
+			return false;
+		}
+		lineBase += (int)std::count(chunks[t].begin, chunks[t].end, '\n');
+
+		positionBase[t + 1] = positionBase[t] + chunks[t].positions.size();
+		uvBase[t + 1] = uvBase[t] + chunks[t].uvs.size();
+		normalBase[t + 1] = normalBase[t] + chunks[t].normals.size();
+		cornerBase[t + 1] = cornerBase[t] + chunks[t].corners.size();
+	}
+
+	out_mesh.positions.clear();
+	out_mesh.uvs.clear();
+	out_mesh.normals.clear();
+	out_mesh.positions.reserve(positionBase[threads]);
+	out_mesh.uvs.reserve(uvBase[threads]);
+	out_mesh.normals.reserve(normalBase[threads]);
+	out_mesh.corners.resize(cornerBase[threads]);
+
+	std::vector<char> resolved(threads, 0);
+	workers.clear();
+	for ( size_t t=0; t<threads; t++ ){
+		workers.push_back(std::thread([&, t](){
+			resolved[t] = resolveChunk(chunks[t], positionBase[t], uvBase[t], normalBase[t],
+				positionBase[threads], uvBase[threads], normalBase[threads], &out_mesh.corners[cornerBase[t]]);
+		}));
+	}
+	for ( size_t t=0; t<threads; t++ ){
+		out_mesh.positions.insert(out_mesh.positions.end(), chunks[t].positions.begin(), chunks[t].positions.end());
+		out_mesh.uvs.insert(out_mesh.uvs.end(), chunks[t].uvs.begin(), chunks[t].uvs.end());
+		out_mesh.normals.insert(out_mesh.normals.end(), chunks[t].normals.begin(), chunks[t].normals.end());
+	}
+	for ( size_t t=0; t<threads; t++ ){
+		workers[t].join();
+		if ( !resolved[t] ){
+			printf("%s: a face refers to a vertex, UV or normal that does not exist\n", path);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool loadOBJ(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	printf("Loading OBJ file %s...\n", path);
+
+	ObjMesh mesh;
+	if ( !parseOBJ(path, mesh) ){
+		return false;
 	}
 
 	// For each vertex of each triangle
-	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
+	size_t count = mesh.corners.size();
+	out_vertices.resize(count);
+	out_uvs     .resize(count);
+	out_normals .resize(count);
+
+	for ( size_t i=0; i+2<count; i+=3 ){
+		const ObjCorner * corners = &mesh.corners[i];
 
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertexIndices[i];
-		unsigned int uvIndex = uvIndices[i];
-		unsigned int normalIndex = normalIndices[i];
-		
 		// Get the attributes thanks to the index
-		glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-		glm::vec2 uv = temp_uvs[ uvIndex-1 ];
-		glm::vec3 normal = temp_normals[ normalIndex-1 ];
-		
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_uvs     .push_back(uv);
-		out_normals .push_back(normal);
-	
-	}
-	fclose(file);
+		for ( int k=0; k<3; k++ ){
+			out_vertices[i+k] = mesh.positions[ corners[k].position ];
+			out_uvs     [i+k] = (corners[k].uv >= 0) ? mesh.uvs[ corners[k].uv ] : glm::vec2(0.0f);
+		}
+
+		// Without normals, the triangle is flat shaded
+		glm::vec3 faceNormal(0.0f);
+		if ( corners[0].normal < 0 || corners[1].normal < 0 || corners[2].normal < 0 ){
+			glm::vec3 cross = glm::cross(out_vertices[i+1] - out_vertices[i], out_vertices[i+2] - out_vertices[i]);
+			float length = glm::length(cross);
+			faceNormal = (length > 0.0f) ? cross / length : glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+		for ( int k=0; k<3; k++ ){
+			out_normals[i+k] = (corners[k].normal >= 0) ? mesh.normals[ corners[k].normal ] : faceNormal;
+		}
+	}
+
 	return true;
-}
\ No newline at end of file
+}
@@ -1,6 +1,34 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+// Files smaller than this are parsed by a single thread
+#define OBJ_PARALLEL_MIN_CHUNK_SIZE (4 << 20)
+
+// One corner of a triangle: 0-based indices into the attribute arrays of an ObjMesh, -1 if absent
+struct ObjCorner {
+	int position;
+	int uv;
+	int normal;
+};
+
+// The content of an OBJ file, faces already triangulated (3 corners per triangle)
+struct ObjMesh {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<ObjCorner> corners;
+};
+
+// Parses an OBJ file. The file is memory-mapped and split into line-aligned chunks parsed in parallel.
+// Faces may be written v, v/vt, v//vn or v/vt/vn, with positive or negative (relative) indices,
+// and may have any number of corners (n-gons are triangulated as fans).
+bool parseOBJ(
+	const char * path,
+	ObjMesh & out_mesh
+);
+
+// Loads an OBJ file as a triangle soup, 3 vertices per triangle.
+// Missing UVs are (0, 0), missing normals are replaced by the normal of the triangle.
 bool loadOBJ(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
@@ -18,4 +46,4 @@ bool loadAssImp(
 	std::vector<glm::vec3> & normals
 );
 
-#endif
\ No newline at end of file
+#endif
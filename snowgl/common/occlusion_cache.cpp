@@ -0,0 +1,47 @@
+#include <stdio.h>
+
+#include "occlusion_cache.hpp"
+
+bool OcclusionMapKey::operator==(const OcclusionMapKey & other) const {
+	return geometryVersion == other.geometryVersion
+		&& direction == other.direction
+		&& boundsMin == other.boundsMin
+		&& boundsMax == other.boundsMax;
+}
+
+bool OcclusionMapKey::operator!=(const OcclusionMapKey & other) const {
+	return !(*this == other);
+}
+
+bool OcclusionMapCache::needsUpdate(const OcclusionMapKey & current) {
+	requests++;
+
+	if (valid && key == current) {
+		return false;
+	}
+
+	if (renders > 0) {
+		invalidations++;
+	}
+	renders++;
+
+	key = current;
+	valid = true;
+	return true;
+}
+
+void OcclusionMapCache::invalidate() {
+	valid = false;
+}
+
+int OcclusionMapCache::invalidationCount() const {
+	return invalidations;
+}
+
+int OcclusionMapCache::renderCount() const {
+	return renders;
+}
+
+void OcclusionMapCache::printStatistics() const {
+	printf("Occlusion map: rendered %d times in %d frames, %d invalidations\n", renders, requests, invalidations);
+}
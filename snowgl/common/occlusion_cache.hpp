@@ -0,0 +1,68 @@
+#ifndef OCCLUSION_CACHE_HPP
+#define OCCLUSION_CACHE_HPP
+
+#include <glm/glm.hpp>
+
+/**
+ * @brief Everything the snow-occlusion depth map depends on.
+ */
+
+struct OcclusionMapKey {
+	unsigned int geometryVersion = 0;	// Changes whenever the geometry does (Scene::instanceVersion())
+	glm::vec3 direction;				// Direction the snow falls from
+	glm::vec3 boundsMin;				// Orthographic box of the depth pass, in light space
+	glm::vec3 boundsMax;
+
+	bool operator==(const OcclusionMapKey & other) const;
+	bool operator!=(const OcclusionMapKey & other) const;
+};
+
+/**
+ * @brief Keeps track of what the occlusion depth map was last rendered with, so the depth pass only runs
+ * when the geometry, the occlusion direction or the projection bounds change. A static scene renders it once.
+ */
+
+class OcclusionMapCache {
+private:
+	OcclusionMapKey key;
+	bool valid = false;
+	int requests = 0;
+	int renders = 0;
+	int invalidations = 0;
+
+public:
+
+	/**
+	 * @brief Called once per frame with the current inputs of the depth pass.
+	 * @param current The inputs the occlusion map has to be rendered with.
+	 * @return bool True if the depth pass has to be rendered, i.e. the map is missing or out of date.
+	 */
+
+	bool needsUpdate(const OcclusionMapKey & current);
+
+	/**
+	 * @brief Forces the next needsUpdate() to return true, e.g. after the depth texture was recreated.
+	 */
+
+	void invalidate();
+
+	/**
+	 * @brief Returns how many times a cached map has been invalidated (the first render is not counted).
+	 */
+
+	int invalidationCount() const;
+
+	/**
+	 * @brief Returns how many times the depth pass has been rendered.
+	 */
+
+	int renderCount() const;
+
+	/**
+	 * @brief Prints how many frames rendered the depth pass and how many reused the cached map.
+	 */
+
+	void printStatistics() const;
+};
+
+#endif // OCCLUSION_CACHE_HPP
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <chrono>
+
+#include "output_pipeline.hpp"
+#include "util.hpp"
+
+// How long idle threads sleep before polling their queue again
+static const std::chrono::microseconds POLL_INTERVAL(200);
+
+#ifdef USE_OPENCV
+
+VideoSink::VideoSink(const char * filename, double fps, int width, int height)
+	: video(filename, cv::VideoWriter::fourcc('W','M','V','2'), fps, cv::Size(width, height)), size(width, height) {}
+
+VideoSink::~VideoSink() {
+	video.release();
+}
+
+bool VideoSink::isOpened() const {
+	return video.isOpened();
+}
+
+bool VideoSink::write(Frame & frame) {
+	cv::Mat image(frame.height, frame.width, CV_8UC3, frame.pixels.data());
+	if (image.size() != size) {
+		cv::resize(image, scaled, size, 0, 0, cv::INTER_AREA);
+		video.write(scaled);
+	} else {
+		video.write(image);
+	}
+	return true;
+}
+
+PreviewSink::PreviewSink(const char * windowName, const char * snapshotFilename)
+	: windowName(windowName), snapshotFilename(snapshotFilename) {}
+
+PreviewSink::~PreviewSink() {
+	cv::destroyWindow(windowName);
+}
+
+bool PreviewSink::write(Frame & frame) {
+	// The frame goes back to its pool once written, keep a copy for the render thread
+	cv::Mat image(frame.height, frame.width, CV_8UC3, frame.pixels.data());
+	std::lock_guard<std::mutex> lock(mutex);
+	image.copyTo(latest);
+	fresh = true;
+	return true;
+}
+
+bool PreviewSink::show() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (fresh) {
+			cv::swap(latest, shown);
+			fresh = false;
+		}
+	}
+	if (!shown.empty()) {
+		cv::imshow(windowName, shown);
+	}
+
+	if (cv::waitKey(1) >= 0) {
+		if (!shown.empty()) {
+			cv::imwrite(snapshotFilename, shown);
+		}
+		return false;
+	}
+	return true;
+}
+
+#endif
+
+ImageSequenceSink::ImageSequenceSink(const char * pattern) : pattern(pattern) {
+	#ifdef USE_OPENCV
+	this->pattern += ".png";
+	#else
+	this->pattern += ".ppm";
+	#endif
+}
+
+bool ImageSequenceSink::write(Frame & frame) {
+	char filename[256];
+	snprintf(filename, sizeof(filename), pattern.c_str(), frame.info.index);
+
+	#ifdef USE_OPENCV
+	cv::Mat image(frame.height, frame.width, CV_8UC3, frame.pixels.data());
+	cv::imwrite(filename, image);
+	#else
+	writePPM(filename, frame.pixels, frame.width, frame.height);
+	#endif
+	return true;
+}
+
+void drawStatistics(Frame & frame, const Data & row) {
+	#ifdef USE_OPENCV
+	const FrameInfo & info = frame.info;
+
+	// Wraps the pooled pixels, no copy
+	cv::Mat capturedImage(frame.height, frame.width, CV_8UC3, frame.pixels.data());
+
+	// Set some statistical texts.
+	std::string fpsText 		   = "FPS: " 			 + std::to_string(int(info.fps));
+	std::string eyePosText 		   = "Eye Position: (" 	 + intToString(info.eye_pos.x) + ", " + intToString(info.eye_pos.y) + ", " + intToString(info.eye_pos.z) + ")";
+
+	std::string timeText 		   = std::string("Time: ")	 + row.time;
+	std::string temperatureText    = "Temperature: " 	 + floatToString(row.temperature)			+ "C";
+	std::string snowAmountText 	   = "Snow Amount: " 	 + intToString(row.snow_amount * 100)		+ "%";
+	std::string lightIntensityText = "Light Intensity: " + intToString(row.light_intensity * 100)	+ "%";
+	std::string elevationAngleText = "Elevation Angle: " + floatToString(row.elevation_angle)		+ "deg";
+
+	// Display those statistical texts.
+	int left_pos = 10;
+	int down_pos = 20;
+	//cv::putText(capturedImage, fpsText, 			cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
+	cv::putText(capturedImage, eyePosText, 			cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 40;
+
+	cv::putText(capturedImage, timeText, 			cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
+	cv::putText(capturedImage, snowAmountText,  	cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
+	cv::putText(capturedImage, temperatureText, 	cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
+	cv::putText(capturedImage, lightIntensityText,	cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
+	cv::putText(capturedImage, elevationAngleText,  cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 40;
+	#endif
+}
+
+OutputPipeline::OutputPipeline(FramePool & pool, size_t capacity, int workerCount, BackpressurePolicy policy, bool overlay)
+	: framePool(pool), policy(policy), overlay(overlay), jobs(capacity), workers(workerCount > 0 ? workerCount : 1) {
+
+	// A frame can be queued, composited by a worker, or composited and waiting for the sink
+	compositedSize = jobs.capacity() + workers.size();
+	composited.reset(new std::atomic<Frame*>[compositedSize]);
+	for (size_t i = 0; i < compositedSize; i++) {
+		composited[i].store(NULL);
+	}
+	sinkSequence.store(0);
+
+	finishing.store(false);
+	stopRequested.store(false);
+	pushedFrames.store(0);
+	droppedFrames.store(0);
+	writtenFrames.store(0);
+	maxDepth.store(0);
+}
+
+OutputPipeline::~OutputPipeline() {
+	finish();
+}
+
+void OutputPipeline::addSink(std::unique_ptr<FrameSink> sink) {
+	sinks.push_back(std::move(sink));
+}
+
+void OutputPipeline::start() {
+	for (std::thread & worker : workers) {
+		worker = std::thread(&OutputPipeline::workerLoop, this);
+	}
+	sinkThread = std::thread(&OutputPipeline::sinkLoop, this);
+}
+
+bool OutputPipeline::push(Frame * frame, const Data & row) {
+	Job job;
+	job.frame = frame;
+	job.row = row;
+	job.sequence = nextSequence;
+
+	while (!jobs.tryPush(job)) {
+		if (policy == BackpressurePolicy::Drop) {
+			framePool.release(frame);
+			droppedFrames++;
+			return false;
+		}
+		std::this_thread::sleep_for(POLL_INTERVAL);
+	}
+
+	nextSequence++;
+	pushedFrames++;
+
+	size_t depth = jobs.size();
+	size_t deepest = maxDepth.load();
+	while (depth > deepest && !maxDepth.compare_exchange_weak(deepest, depth)) {}
+
+	return true;
+}
+
+void OutputPipeline::workerLoop() {
+	Job job;
+	for (;;) {
+		if (!jobs.tryPop(job)) {
+			if (finishing.load() && jobs.size() == 0) {
+				return;
+			}
+			std::this_thread::sleep_for(POLL_INTERVAL);
+			continue;
+		}
+
+		if (overlay) {
+			drawStatistics(*job.frame, job.row);
+		}
+
+		// Wait until the sink has taken the frame compositedSize frames before this one. The slot alone
+		// isn't enough: it is also empty while a slower worker still composites that frame.
+		std::atomic<Frame*> & slot = composited[job.sequence % compositedSize];
+		while (job.sequence >= sinkSequence.load() + compositedSize || slot.load() != NULL) {
+			std::this_thread::sleep_for(POLL_INTERVAL);
+		}
+		slot.store(job.frame);
+	}
+}
+
+void OutputPipeline::sinkLoop() {
+	size_t sequence = 0;
+	for (;;) {
+		std::atomic<Frame*> & slot = composited[sequence % compositedSize];
+		Frame * frame = slot.load();
+
+		if (frame == NULL) {
+			if (finishing.load() && sequence == (size_t)pushedFrames.load()) {
+				return;
+			}
+			std::this_thread::sleep_for(POLL_INTERVAL);
+			continue;
+		}
+
+		for (std::unique_ptr<FrameSink> & sink : sinks) {
+			if (!sink->write(*frame)) {
+				stopRequested.store(true);
+			}
+		}
+
+		slot.store(NULL);
+		framePool.release(frame);
+		writtenFrames++;
+		sequence++;
+		sinkSequence.store(sequence);
+	}
+}
+
+void OutputPipeline::finish() {
+	finishing.store(true);
+
+	for (std::thread & worker : workers) {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+	if (sinkThread.joinable()) {
+		sinkThread.join();
+	}
+}
+
+bool OutputPipeline::shouldStop() const {
+	return stopRequested.load();
+}
+
+size_t OutputPipeline::queueDepth() const {
+	return jobs.size();
+}
+
+void OutputPipeline::printStatistics() const {
+	printf("Output pipeline: %d frames written, %d dropped, max queue depth %d/%d\n",
+		writtenFrames.load(), droppedFrames.load(), (int)maxDepth.load(), (int)jobs.capacity());
+}
@@ -0,0 +1,229 @@
+#ifndef OUTPUT_PIPELINE_HPP
+#define OUTPUT_PIPELINE_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include "global.hpp"
+#include "csv_reader.hpp"
+#include "readback.hpp"
+#include "bounded_queue.hpp"
+
+#ifdef USE_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+/**
+ * @brief A destination of the captured frames. Sinks are only called from the pipeline's sink thread,
+ * one frame at a time and in frame order.
+ */
+
+class FrameSink {
+public:
+	virtual ~FrameSink() {}
+
+	/**
+	 * @brief Consumes one frame, the statistics overlay has already been drawn into it.
+	 * @return bool False to ask the render loop to stop.
+	 */
+
+	virtual bool write(Frame & frame) = 0;
+};
+
+#ifdef USE_OPENCV
+
+/**
+ * @brief Encodes the frames into a video file (WMV2). The size of a video can't change, frames captured
+ * at another size (after the window was resized) are scaled to the size the video was opened with.
+ */
+
+class VideoSink : public FrameSink {
+private:
+	cv::VideoWriter video;
+	cv::Size size;
+	cv::Mat scaled;
+
+public:
+	VideoSink(const char * filename, double fps, int width, int height);
+	~VideoSink();
+	bool isOpened() const;
+	bool write(Frame & frame) override;
+};
+
+/**
+ * @brief Shows the frames in an OpenCV window. A key press saves the frame and stops the render loop.
+ *
+ * HighGUI must only be called from the main thread (macOS, Windows), so write() only keeps a copy of the
+ * latest frame and the render thread shows it with show(). The sink has to be destroyed on the main thread.
+ */
+
+class PreviewSink : public FrameSink {
+private:
+	std::string windowName;
+	std::string snapshotFilename;
+
+	std::mutex mutex;
+	cv::Mat latest;				// The last frame written, guarded by the mutex
+	bool fresh = false;			// Not shown yet
+	cv::Mat shown;				// Render thread only
+
+public:
+	PreviewSink(const char * windowName, const char * snapshotFilename);
+	~PreviewSink();
+	bool write(Frame & frame) override;
+
+	/**
+	 * @brief Shows the latest frame (if a new one came) and processes the window events, on the main thread.
+	 * @return bool False if a key has been pressed, the frame shown is then saved to the snapshot file.
+	 */
+
+	bool show();
+};
+
+#endif
+
+/**
+ * @brief Writes every frame into its own image file, PNG with OpenCV and PPM without.
+ */
+
+class ImageSequenceSink : public FrameSink {
+private:
+	std::string pattern;
+
+public:
+
+	/**
+	 * @param pattern A printf pattern taking the frame number, without extension, e.g. "outputs/frame_%04d".
+	 */
+
+	ImageSequenceSink(const char * pattern);
+	bool write(Frame & frame) override;
+};
+
+/**
+ * @brief What the pipeline does when the render loop produces frames faster than they are written.
+ */
+
+enum class BackpressurePolicy {
+	Block,		// The render loop waits for a free slot, no frame is lost (batch rendering)
+	Drop		// The frame is dropped, the render loop never waits (interactive rendering)
+};
+
+/**
+ * @brief Background output of the captured frames, off the render thread.
+ *
+ * The render thread pushes captured frames together with their environment data row into a bounded
+ * lock-free queue. Worker threads composite the statistics overlay into the frames (unless it was drawn
+ * on the GPU already), then a sink thread
+ * hands them to every sink in frame order (workers may finish out of order) and gives the frames back
+ * to their pool.
+ */
+
+class OutputPipeline {
+private:
+	struct Job {
+		Frame * frame = NULL;
+		Data row;
+		size_t sequence = 0;
+	};
+
+	FramePool & framePool;
+	std::vector<std::unique_ptr<FrameSink>> sinks;
+	BackpressurePolicy policy;
+	bool overlay;
+
+	BoundedQueue<Job> jobs;
+	std::unique_ptr<std::atomic<Frame*>[]> composited;	// Reorder ring, indexed by sequence
+	size_t compositedSize;
+	std::atomic<size_t> sinkSequence;					// The next frame the sink writes
+
+	std::vector<std::thread> workers;
+	std::thread sinkThread;
+
+	size_t nextSequence = 0;
+	std::atomic<bool> finishing;
+	std::atomic<bool> stopRequested;
+	std::atomic<int> pushedFrames;
+	std::atomic<int> droppedFrames;
+	std::atomic<int> writtenFrames;
+	std::atomic<size_t> maxDepth;
+
+	void workerLoop();
+	void sinkLoop();
+
+public:
+
+	/**
+	 * @param pool The pool the frames are given back to once written.
+	 * @param capacity The maximum number of queued frames.
+	 * @param workerCount The number of threads compositing the overlay.
+	 * @param policy What push() does when the queue is full.
+	 * @param overlay Whether the workers composite the statistics overlay, false when it was drawn on the GPU.
+	 */
+
+	OutputPipeline(FramePool & pool, size_t capacity, int workerCount, BackpressurePolicy policy, bool overlay);
+	~OutputPipeline();
+
+	OutputPipeline(const OutputPipeline &) = delete;
+	OutputPipeline & operator=(const OutputPipeline &) = delete;
+
+	/**
+	 * @brief Adds a sink, must be called before the first push().
+	 */
+
+	void addSink(std::unique_ptr<FrameSink> sink);
+
+	/**
+	 * @brief Starts the worker and sink threads.
+	 */
+
+	void start();
+
+	/**
+	 * @brief Queues a frame, only called by the render thread.
+	 * @param frame The captured frame, owned by the pipeline from now on.
+	 * @param row The environment data the frame was rendered with, for the overlay.
+	 * @return bool False if the frame was dropped (BackpressurePolicy::Drop and a full queue).
+	 */
+
+	bool push(Frame * frame, const Data & row);
+
+	/**
+	 * @brief Writes all queued frames and joins the threads.
+	 */
+
+	void finish();
+
+	/**
+	 * @brief True once a sink asked the render loop to stop.
+	 */
+
+	bool shouldStop() const;
+
+	/**
+	 * @brief Returns the number of frames waiting in the queue.
+	 */
+
+	size_t queueDepth() const;
+
+	/**
+	 * @brief Prints the number of written and dropped frames and the deepest the queue has been.
+	 */
+
+	void printStatistics() const;
+};
+
+/**
+ * @brief Composites the statistics texts (eye position, time, snow amount, ...) into a frame.
+ * Only available with OpenCV, the frame is left untouched otherwise.
+ * @param frame The frame to draw into, BGR pixels.
+ * @param row The environment data the frame was rendered with.
+ */
+
+void drawStatistics(Frame & frame, const Data & row);
+
+#endif // OUTPUT_PIPELINE_HPP
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <filesystem>
+
+#include "program_cache.hpp"
+#include "mapped_file.hpp"
+
+static const char PROGRAM_CACHE_MAGIC[8] = {'S', 'N', 'O', 'W', 'P', 'R', 'O', 'G'};
+
+// 64-bit FNV-1a hash, continued from a previous hash
+static uint64_t hashBytes(uint64_t hash, const void * data, size_t size) {
+	const unsigned char * bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+// Hashes a string and its terminating zero, so consecutive strings can't shift into each other
+static uint64_t hashString(uint64_t hash, const char * text) {
+	return hashBytes(hash, text != NULL ? text : "", (text != NULL ? strlen(text) : 0) + 1);
+}
+
+bool ProgramCache::open(const char * cacheDirectory) {
+	enabled = false;
+
+	GLint formats = 0;
+	if (GLEW_ARB_get_program_binary) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+	if (formats <= 0) {
+		printf("Program cache: the driver can't save program binaries, the shaders are compiled at every launch\n");
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(cacheDirectory, error);
+	if (error) {
+		fprintf(stderr, "Program cache directory %s could not be created.\n", cacheDirectory);
+		return false;
+	}
+
+	directory = cacheDirectory;
+	driverHash = 0xCBF29CE484222325ull;
+	driverHash = hashString(driverHash, (const char *)glGetString(GL_VENDOR));
+	driverHash = hashString(driverHash, (const char *)glGetString(GL_RENDERER));
+	driverHash = hashString(driverHash, (const char *)glGetString(GL_VERSION));
+	enabled = true;
+	return true;
+}
+
+uint64_t ProgramCache::key(const std::string & vertexCode, const std::string & fragmentCode) const {
+	uint64_t hash = hashString(driverHash, vertexCode.c_str());
+	return hashString(hash, fragmentCode.c_str());
+}
+
+std::string ProgramCache::path(uint64_t key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+	return directory + "/" + name + PROGRAM_CACHE_EXTENSION;
+}
+
+GLuint ProgramCache::load(uint64_t key) {
+	if (!enabled) {
+		return 0;
+	}
+
+	MappedFile file;
+	const ProgramCacheHeader * header = NULL;
+	if (file.open(path(key).c_str(), true) && file.size() >= sizeof(ProgramCacheHeader)) {
+		header = (const ProgramCacheHeader *)file.data();
+		if (memcmp(header->magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) != 0 || header->version != PROGRAM_CACHE_VERSION
+			|| header->key != key || header->binarySize != file.size() - sizeof(ProgramCacheHeader)) {
+			header = NULL;
+		}
+	}
+	if (header == NULL) {
+		misses++;
+		return 0;
+	}
+
+	// The driver checks the format and its own version of the binary, a refused binary leaves the program unlinked
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header->binaryFormat, file.data() + sizeof(ProgramCacheHeader), (GLsizei)header->binarySize);
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		glDeleteProgram(program);
+		rejected++;
+		misses++;
+		return 0;
+	}
+
+	hits++;
+	return program;
+}
+
+void ProgramCache::store(uint64_t key, GLuint program) {
+	if (!enabled) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	std::vector<unsigned char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	ProgramCacheHeader header;
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.binaryFormat = format;
+	header.key = key;
+	header.binarySize = (uint64_t)length;
+
+	std::string cachePath = path(key);
+	std::string temporaryPath = cachePath + ".tmp";
+	FILE * output = fopen(temporaryPath.c_str(), "wb");
+	if (output == NULL) {
+		fprintf(stderr, "%s could not be opened for writing.\n", temporaryPath.c_str());
+		return;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, output) == 1
+		&& fwrite(binary.data(), 1, (size_t)length, output) == (size_t)length;
+	written = (fclose(output) == 0) && written;
+
+	// rename() does not replace an existing file on Windows
+	remove(cachePath.c_str());
+	if (!written || rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+		fprintf(stderr, "Program cache %s could not be written.\n", cachePath.c_str());
+		remove(temporaryPath.c_str());
+		return;
+	}
+	stored++;
+}
+
+void ProgramCache::printStatistics() const {
+	if (enabled) {
+		printf("Program cache: %u hits, %u misses (%u binaries refused by the driver), %u programs saved\n", hits, misses, rejected, stored);
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include <string>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#define PROGRAM_CACHE_EXTENSION ".programcache"
+#define PROGRAM_CACHE_VERSION   1
+
+/**
+ * @brief The header of a program cache file, followed by binarySize bytes of glGetProgramBinary output.
+ */
+
+struct ProgramCacheHeader {
+	char magic[8];						// "SNOWPROG"
+	uint32_t version;					// PROGRAM_CACHE_VERSION
+	uint32_t binaryFormat;				// The format glGetProgramBinary returned, only meaningful to the same driver
+	uint64_t key;						// See ProgramCache::key
+	uint64_t binarySize;
+};
+
+static_assert(sizeof(ProgramCacheHeader) == 32, "ProgramCacheHeader must not contain padding");
+
+/**
+ * @brief Linked programs kept on disk (GL_ARB_get_program_binary), one file per program, to skip the
+ * compilation at the next launch.
+ *
+ * A program is found by a hash of its sources (definitions included) and of the driver vendor, renderer
+ * and version strings: a changed shader or another driver never matches an old binary. A driver may still
+ * refuse a binary (e.g. after an update that kept the version string), the program is then compiled
+ * from its sources and the file replaced.
+ */
+
+class ProgramCache {
+private:
+	std::string directory;
+	uint64_t driverHash = 0;
+	bool enabled = false;
+
+	unsigned int hits = 0;
+	unsigned int misses = 0;
+	unsigned int rejected = 0;			// Binaries found but refused by the driver
+	unsigned int stored = 0;
+
+	std::string path(uint64_t key) const;
+
+public:
+
+	/**
+	 * @brief Uses a directory for the cache, created if needed.
+	 * @return bool False if the driver can't save program binaries, the cache then stays disabled.
+	 */
+
+	bool open(const char * directory);
+
+	bool isEnabled() const { return enabled; }
+
+	/**
+	 * @brief The key of a program: FNV-1a hash of the sources as compiled and of the driver strings.
+	 */
+
+	uint64_t key(const std::string & vertexCode, const std::string & fragmentCode) const;
+
+	/**
+	 * @brief Creates a program from its cached binary.
+	 * @return GLuint The linked program, or 0 if there is no usable binary for the key.
+	 */
+
+	GLuint load(uint64_t key);
+
+	/**
+	 * @brief Saves the binary of a linked program. Set GL_PROGRAM_BINARY_RETRIEVABLE_HINT before linking it.
+	 */
+
+	void store(uint64_t key, GLuint program);
+
+	/**
+	 * @brief Prints the number of programs loaded from the cache, compiled, and saved.
+	 */
+
+	void printStatistics() const;
+};
+
+#endif // PROGRAM_CACHE_HPP
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "readback.hpp"
+
+FramePool::FramePool(int width, int height) : width(width), height(height) {}
+
+Frame * FramePool::acquire() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!freeFrames.empty()) {
+		Frame * frame = freeFrames.back();
+		freeFrames.pop_back();
+		if (frame->width != width || frame->height != height) {
+			frame->width = width;
+			frame->height = height;
+			frame->pixels.resize(size_t(width) * height * 3);
+		}
+		return frame;
+	}
+
+	// All frames are in use, grow the pool
+	frames.emplace_back(new Frame());
+	Frame * frame = frames.back().get();
+	frame->width = width;
+	frame->height = height;
+	frame->pixels.resize(size_t(width) * height * 3);
+	return frame;
+}
+
+void FramePool::release(Frame * frame) {
+	if (frame == NULL) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	freeFrames.push_back(frame);
+}
+
+size_t FramePool::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return frames.size();
+}
+
+void FramePool::resize(int newWidth, int newHeight) {
+	std::lock_guard<std::mutex> lock(mutex);
+	width = newWidth;
+	height = newHeight;
+}
+
+static void createColorFramebuffer(GLuint & framebuffer, GLuint & renderbuffer, int width, int height) {
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Readback framebuffer is incomplete.\n");
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+}
+
+FrameReadback::FrameReadback(int width, int height, int ringSize, GLenum format, bool resolveSource)
+	: width(width), height(height), format(format), resolveSource(resolveSource),
+	  slots(ringSize > 0 ? ringSize : 1), framePool(width, height) {
+
+	GLint previousFramebuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+	if (resolveSource) {
+		createColorFramebuffer(resolveFramebuffer, resolveBuffer, width, height);
+	}
+	createColorFramebuffer(flipFramebuffer, flipBuffer, width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+	// GL_STREAM_READ: written once by the GPU, read once by the CPU
+	GLsizeiptr size = GLsizeiptr(width) * height * 3;
+	for (Slot & slot : slots) {
+		glGenBuffers(1, &slot.pixelBuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameReadback::resize(int newWidth, int newHeight) {
+	if (newWidth == width && newHeight == height) {
+		return;
+	}
+	width = newWidth;
+	height = newHeight;
+
+	// Same objects, new storage
+	if (resolveSource) {
+		glBindRenderbuffer(GL_RENDERBUFFER, resolveBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, flipBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	GLsizeiptr size = GLsizeiptr(width) * height * 3;
+	for (Slot & slot : slots) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	framePool.resize(width, height);
+}
+
+FrameReadback::~FrameReadback() {
+	for (Slot & slot : slots) {
+		if (slot.fence) {
+			glDeleteSync(slot.fence);
+		}
+		glDeleteBuffers(1, &slot.pixelBuffer);
+	}
+
+	glDeleteFramebuffers(1, &flipFramebuffer);
+	glDeleteRenderbuffers(1, &flipBuffer);
+	if (resolveSource) {
+		glDeleteFramebuffers(1, &resolveFramebuffer);
+		glDeleteRenderbuffers(1, &resolveBuffer);
+	}
+}
+
+Frame * FrameReadback::capture(const FrameInfo & info) {
+
+	// The ring is full: the slot to reuse holds frame K-N, hand it back first.
+	Slot & slot = slots[head];
+	Frame * result = slot.pending ? retrieve(slot) : NULL;
+
+	GLint readFramebuffer, drawFramebuffer;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+
+	// Multisampled pixels can only be blitted 1:1, resolve them first.
+	if (resolveSource) {
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFramebuffer);
+	}
+
+	// Vertical flip on the GPU, so the rows are read back top-down.
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, flipFramebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, height, width, 0, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	// Asynchronous read into the pixel-pack buffer, glReadPixels returns immediately.
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, flipFramebuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, format, GL_UNSIGNED_BYTE, (void*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.info = info;
+	slot.pending = true;
+	head = (head + 1) % slots.size();
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+
+	return result;
+}
+
+Frame * FrameReadback::flush() {
+	for (size_t i = 0; i < slots.size(); i++) {
+		Slot & slot = slots[(head + i) % slots.size()];
+		if (slot.pending) {
+			return retrieve(slot);
+		}
+	}
+	return NULL;
+}
+
+Frame * FrameReadback::retrieve(Slot & slot) {
+
+	// Normally signaled long ago, the wait only happens if the GPU is more than N frames behind.
+	GLenum status = GL_TIMEOUT_EXPIRED;
+	while (status == GL_TIMEOUT_EXPIRED) {
+		status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);	// 100 ms
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	slot.pending = false;
+
+	if (status == GL_WAIT_FAILED) {
+		fprintf(stderr, "Failed to wait for the framebuffer readback.\n");
+		return NULL;
+	}
+
+	Frame * frame = framePool.acquire();
+	frame->info = slot.info;
+
+	size_t size = frame->pixels.size();
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+	void * pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	if (pixels != NULL) {
+		memcpy(frame->pixels.data(), pixels, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return frame;
+}
+
+void FrameReadback::release(Frame * frame) {
+	framePool.release(frame);
+}
+
+FramePool & FrameReadback::pool() {
+	return framePool;
+}
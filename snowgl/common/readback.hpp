@@ -0,0 +1,164 @@
+#ifndef READBACK_HPP
+#define READBACK_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+ * @brief Per-frame information travelling with the pixels, since frames are read back a few frames late.
+ */
+
+struct FrameInfo {
+	int index = 0;					// Frame number
+	int daytime_index = 0;			// Row of the environment data the frame was rendered with
+	glm::vec3 eye_pos = glm::vec3(0.0f);
+	double fps = 0.0;
+};
+
+/**
+ * @brief A captured frame, top-down rows of tightly packed 3-byte pixels (BGR or RGB).
+ */
+
+struct Frame {
+	FrameInfo info;
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> pixels;
+};
+
+/**
+ * @brief A thread-safe pool of frames with the same size, frames are recycled instead of reallocated.
+ * After a resize(), the frames of the previous size are given the new size when they are reused.
+ */
+
+class FramePool {
+private:
+	int width;
+	int height;
+	std::mutex mutex;
+	std::vector<std::unique_ptr<Frame>> frames;
+	std::vector<Frame*> freeFrames;
+
+public:
+	FramePool(int width, int height);
+
+	/**
+	 * @brief Returns a free frame, a new one is allocated only if all frames are in use.
+	 * @return Frame* A frame of width * height pixels, owned by the pool.
+	 */
+
+	Frame * acquire();
+
+	/**
+	 * @brief Gives a frame back to the pool. It may be called from any thread.
+	 * @param frame A frame returned by acquire().
+	 */
+
+	void release(Frame * frame);
+
+	/**
+	 * @brief Returns the number of frames allocated so far.
+	 */
+
+	size_t size();
+
+	/**
+	 * @brief Changes the size of the frames returned by the next acquire() calls.
+	 */
+
+	void resize(int width, int height);
+};
+
+/**
+ * @brief Asynchronous framebuffer readback through a ring of pixel-pack buffers.
+ *
+ * Each capture() flips the current read framebuffer vertically on the GPU (a framebuffer blit), starts a
+ * glReadPixels into the next pixel-pack buffer of the ring and puts a fence behind it. The pixels of a
+ * frame are only mapped once the ring wraps around, i.e. frame K-N is handed back while frame K is
+ * rendered, so the CPU never waits for the GPU to finish the current frame.
+ */
+
+class FrameReadback {
+private:
+	struct Slot {
+		GLuint pixelBuffer = 0;
+		GLsync fence = 0;
+		FrameInfo info;
+		bool pending = false;
+	};
+
+	int width;
+	int height;
+	GLenum format;
+	bool resolveSource;
+
+	GLuint resolveFramebuffer = 0;
+	GLuint resolveBuffer = 0;
+	GLuint flipFramebuffer = 0;
+	GLuint flipBuffer = 0;
+
+	std::vector<Slot> slots;
+	size_t head = 0;
+	FramePool framePool;
+
+	Frame * retrieve(Slot & slot);
+
+public:
+
+	/**
+	 * @brief Creates the pixel-pack buffers and the framebuffer used for the vertical flip.
+	 * @param width The width of the captured area.
+	 * @param height The height of the captured area.
+	 * @param ringSize The number of frames in flight, the latency of the readback in frames.
+	 * @param format GL_BGR (OpenCV) or GL_RGB.
+	 * @param resolveSource True if the source framebuffer may be multisampled, it is then resolved before
+	 *                      the flip since multisampled framebuffers cannot be blitted upside down.
+	 */
+
+	FrameReadback(int width, int height, int ringSize, GLenum format, bool resolveSource);
+	~FrameReadback();
+
+	FrameReadback(const FrameReadback &) = delete;
+	FrameReadback & operator=(const FrameReadback &) = delete;
+
+	/**
+	 * @brief Starts reading the current GL_READ_FRAMEBUFFER back.
+	 * @param info The information of the frame being captured.
+	 * @return Frame* The frame captured ringSize captures ago, or NULL while the ring is not full yet.
+	 *                It has to be given back with release().
+	 */
+
+	Frame * capture(const FrameInfo & info);
+
+	/**
+	 * @brief Returns the oldest frame still in flight, used to drain the ring at the end.
+	 * @return Frame* The oldest pending frame, or NULL if there is none.
+	 */
+
+	Frame * flush();
+
+	/**
+	 * @brief Changes the captured area, e.g. when the window is resized or moved to a screen of another scale.
+	 * The frames in flight must have been drained with flush() first.
+	 */
+
+	void resize(int width, int height);
+
+	/**
+	 * @brief Gives a frame returned by capture() or flush() back to the pool, from any thread.
+	 */
+
+	void release(Frame * frame);
+
+	/**
+	 * @brief Returns the pool the captured frames are taken from.
+	 */
+
+	FramePool & pool();
+};
+
+#endif // READBACK_HPP
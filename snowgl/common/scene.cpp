@@ -0,0 +1,413 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <float.h>
+#include <algorithm>
+
+#include "scene.hpp"
+
+Scene::Scene(bool splitLargeMeshes) : splitLargeMeshes(splitLargeMeshes) {
+}
+
+// Exposure of the vertices of meshes without a baked one: evaluated by the shader
+static const glm::vec3 UNBAKED_EXPOSURE(0.0f, 0.0f, 1.0f);
+
+void Scene::addLevel(const PackedVertex * meshVertices, const glm::vec3 * exposure, size_t vertexCount, const unsigned int * meshIndices, size_t indexCount, float error, bool fullDetail) {
+	MeshLevel level = {(unsigned int)parts.size(), 0, error};
+
+	if (vertexCount > MAX_VERTICES_16BIT && splitLargeMeshes) {
+		// One part per 16-bit chunk, the chunks are drawn as separate commands of the same instances.
+		// Every level is split on its own, with its own copy of the vertices it uses.
+		std::vector<unsigned int> allIndices(meshIndices, meshIndices + indexCount);
+		std::vector<PackedVertex> allVertices(meshVertices, meshVertices + vertexCount);
+		std::vector<unsigned short> chunkIndices;
+		std::vector<PackedVertex> chunkVertices;
+		std::vector<IndexChunk> chunks;
+		std::vector<unsigned int> sourceVertices;
+		splitVBO16(allIndices, allVertices, chunkIndices, chunkVertices, chunks, &sourceVertices);
+
+		for (const IndexChunk & chunk : chunks) {
+			MeshPart part = {(GLuint)indices.size() + chunk.firstIndex, chunk.indexCount, (GLint)(vertices.size() + chunk.baseVertex)};
+			parts.push_back(part);
+		}
+		vertices.insert(vertices.end(), chunkVertices.begin(), chunkVertices.end());
+		for (unsigned int vertex : sourceVertices) {
+			exposures.push_back(exposure != NULL ? exposure[vertex] : UNBAKED_EXPOSURE);
+		}
+		indices.insert(indices.end(), chunkIndices.begin(), chunkIndices.end());
+	}
+	else {
+		// The levels of a mesh share its vertices, only the full-detail one copies them
+		GLint baseVertex = fullDetail ? (GLint)vertices.size() : parts[levels.back().firstPart].baseVertex;
+		MeshPart part = {(GLuint)indices.size(), (GLuint)indexCount, baseVertex};
+		parts.push_back(part);
+		if (fullDetail) {
+			vertices.insert(vertices.end(), meshVertices, meshVertices + vertexCount);
+			if (exposure != NULL) {
+				exposures.insert(exposures.end(), exposure, exposure + vertexCount);
+			}
+			else {
+				exposures.resize(vertices.size(), UNBAKED_EXPOSURE);
+			}
+		}
+		indices.insert(indices.end(), meshIndices, meshIndices + indexCount);
+
+		// A single mesh too large for 16-bit indices switches the whole arena to 32-bit indices
+		if (vertexCount > MAX_VERTICES_16BIT) {
+			indexType = GL_UNSIGNED_INT;
+		}
+	}
+
+	level.partCount = parts.size() - level.firstPart;
+	levels.push_back(level);
+}
+
+unsigned int Scene::addMesh(const PackedVertex * meshVertices, size_t vertexCount, const unsigned int * meshIndices, size_t indexCount,
+	const unsigned int * lodIndices, const MeshLod * lods, size_t lodCount, const glm::vec3 * exposure) {
+
+	MeshInfo mesh;
+	mesh.firstLevel = levels.size();
+	mesh.boundsMin = glm::vec3(FLT_MAX);
+	mesh.boundsMax = glm::vec3(-FLT_MAX);
+	for (size_t i = 0; i < vertexCount; i++) {
+		mesh.boundsMin = glm::min(mesh.boundsMin, meshVertices[i].position);
+		mesh.boundsMax = glm::max(mesh.boundsMax, meshVertices[i].position);
+	}
+
+	addLevel(meshVertices, exposure, vertexCount, meshIndices, indexCount, 0.0f, true);
+	for (size_t i = 0; i < lodCount; i++) {
+		addLevel(meshVertices, exposure, vertexCount, lodIndices + lods[i].firstIndex, lods[i].indexCount, lods[i].error, false);
+	}
+
+	mesh.levelCount = levels.size() - mesh.firstLevel;
+	meshes.push_back(mesh);
+	return meshes.size() - 1;
+}
+
+unsigned int Scene::addMaterial(GLuint texture) {
+	materials.push_back(texture);
+	return materials.size() - 1;
+}
+
+unsigned int Scene::addInstance(unsigned int mesh, unsigned int material, const glm::mat4 & transform) {
+	SceneInstance instance = {mesh, material, transform};
+	instances.push_back(instance);
+	instancesChanged = true;
+	version++;
+	return instances.size() - 1;
+}
+
+void Scene::setTransform(unsigned int instance, const glm::mat4 & transform) {
+	instances[instance].transform = transform;
+	instancesChanged = true;
+	version++;
+}
+
+void Scene::instanceBounds(unsigned int instance, glm::vec3 & out_min, glm::vec3 & out_max) const {
+	const MeshInfo & mesh = meshes[instances[instance].mesh];
+	const glm::mat4 & transform = instances[instance].transform;
+
+	// Box around the transformed corners
+	out_min = glm::vec3(FLT_MAX);
+	out_max = glm::vec3(-FLT_MAX);
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 local((corner & 1) ? mesh.boundsMax.x : mesh.boundsMin.x,
+		                (corner & 2) ? mesh.boundsMax.y : mesh.boundsMin.y,
+		                (corner & 4) ? mesh.boundsMax.z : mesh.boundsMin.z);
+		glm::vec3 world = glm::vec3(transform * glm::vec4(local, 1.0f));
+		out_min = glm::min(out_min, world);
+		out_max = glm::max(out_max, world);
+	}
+}
+
+void Scene::selectLods(const glm::vec3 & eyePosition, float pixelsPerUnit, bool orthographic, float maxPixelError, std::vector<unsigned char> & out_lods) const {
+	out_lods.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); i++) {
+		const MeshInfo & mesh = meshes[instances[i].mesh];
+		const glm::mat4 & transform = instances[i].transform;
+
+		// Errors are in mesh space, the largest axis scale of the instance bounds them in scene space
+		float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		float pixelsPerMeshUnit = pixelsPerUnit * scale;
+		if (!orthographic) {
+			glm::vec3 boundsMin, boundsMax;
+			instanceBounds(i, boundsMin, boundsMax);
+			float distance = glm::length(eyePosition - glm::clamp(eyePosition, boundsMin, boundsMax));
+			pixelsPerMeshUnit = (distance > 0.0f) ? pixelsPerMeshUnit / distance : FLT_MAX;
+		}
+
+		unsigned int level = 0;
+		while (level + 1 < mesh.levelCount && level + 1 < 256 && levels[mesh.firstLevel + level + 1].error * pixelsPerMeshUnit <= maxPixelError) {
+			level++;
+		}
+		out_lods[i] = (unsigned char)level;
+	}
+}
+
+// Points the four columns of the instance model matrix at an offset of the instance buffer
+static void setInstanceAttribute(size_t firstInstance) {
+	for (int column = 0; column < 4; column++) {
+		glVertexAttribPointer(SCENE_INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+			(void*)(firstInstance * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+	}
+}
+
+void Scene::upload() {
+	size_t indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(unsigned short) : sizeof(unsigned int);
+
+	// Position-only copy for the depth pass
+	std::vector<glm::vec3> positions(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		positions[i] = vertices[i].position;
+	}
+
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PackedVertex), vertices.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &positionBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+
+	// The exposure stream is only needed when a mesh has a baked one
+	bool bakedExposure = false;
+	for (const glm::vec3 & exposure : exposures) {
+		if (exposure != UNBAKED_EXPOSURE) {
+			bakedExposure = true;
+			break;
+		}
+	}
+	if (bakedExposure) {
+		glGenBuffers(1, &exposureBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, exposureBuffer);
+		glBufferData(GL_ARRAY_BUFFER, exposures.size() * sizeof(glm::vec3), exposures.data(), GL_STATIC_DRAW);
+	}
+
+	glGenBuffers(1, &instanceBuffer);
+	glGenBuffers(1, &indirectBuffer);
+	glGenBuffers(1, &elementBuffer);
+
+	GLint previousVertexArray;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+
+	// Shading pass: interleaved position, UV and normal
+	glGenVertexArrays(1, &shadingVertexArray);
+	glBindVertexArray(shadingVertexArray);
+
+	// The element buffer binding is part of the VAO state
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+	if (indexType == GL_UNSIGNED_SHORT) {
+		std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * indexSize, shortIndices.data(), GL_STATIC_DRAW);
+	}
+	else {
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * indexSize, indices.data(), GL_STATIC_DRAW);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, uv));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+
+	// Baked exposure, otherwise the constant value of the attribute (set by draw())
+	if (exposureBuffer != 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, exposureBuffer);
+		glEnableVertexAttribArray(SCENE_EXPOSURE_ATTRIBUTE);
+		glVertexAttribPointer(SCENE_EXPOSURE_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	}
+
+	// Depth pass: positions only
+	glGenVertexArrays(1, &depthVertexArray);
+	glBindVertexArray(depthVertexArray);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+
+	glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+	// Both passes: one model matrix per instance
+	GLuint vertexArrays[2] = {shadingVertexArray, depthVertexArray};
+	for (GLuint vertexArray : vertexArrays) {
+		glBindVertexArray(vertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		for (int column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(SCENE_INSTANCE_ATTRIBUTE + column);
+			glVertexAttribDivisor(SCENE_INSTANCE_ATTRIBUTE + column, 1);
+		}
+		setInstanceAttribute(0);
+	}
+
+	glBindVertexArray(previousVertexArray);
+
+	// glMultiDrawElementsIndirect is core in OpenGL 4.3, the context only asks for 3.3
+	multiDrawIndirect = (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) && glMultiDrawElementsIndirect != NULL;
+
+	printf("Scene: %d meshes (%d vertices, %d-bit indices), %s\n", (int)meshes.size(), (int)vertices.size(),
+		indexType == GL_UNSIGNED_SHORT ? 16 : 32, multiDrawIndirect ? "multi-draw indirect" : "one draw call per command");
+
+	std::vector<PackedVertex>().swap(vertices);
+	std::vector<unsigned int>().swap(indices);
+	std::vector<glm::vec3>().swap(exposures);
+}
+
+void Scene::sortInstances() {
+
+	// Sort the instances by material then mesh, the instances of a (material, mesh) pair are then contiguous
+	sortedInstances.resize(instances.size());
+	for (size_t i = 0; i < sortedInstances.size(); i++) {
+		sortedInstances[i] = i;
+	}
+	std::sort(sortedInstances.begin(), sortedInstances.end(), [this](unsigned int a, unsigned int b) {
+		if (instances[a].material != instances[b].material) {
+			return instances[a].material < instances[b].material;
+		}
+		return instances[a].mesh < instances[b].mesh;
+	});
+
+	instancesChanged = false;
+	drawListsHoldAll = false;
+}
+
+void Scene::updateDrawLists(const std::vector<unsigned char> * visible, const std::vector<unsigned char> * lods) {
+
+	// The visible instances, in sorted order
+	std::vector<unsigned int> & order = visibleInstances;
+	order.clear();
+	for (unsigned int instance : sortedInstances) {
+		if (visible == NULL || (*visible)[instance]) {
+			order.push_back(instance);
+		}
+	}
+
+	instanceTransforms.clear();
+	commands.clear();
+	materialDraws.clear();
+	drawnTriangles = 0;
+
+	for (size_t i = 0; i < order.size(); ) {
+		const SceneInstance & first = instances[order[i]];
+
+		size_t end = i;
+		while (end < order.size() && instances[order[end]].material == first.material && instances[order[end]].mesh == first.mesh) {
+			end++;
+		}
+
+		if (materialDraws.empty() || materialDraws.back().material != first.material) {
+			MaterialDraw draw = {first.material, (unsigned int)commands.size(), 0};
+			materialDraws.push_back(draw);
+		}
+
+		// The instances of the pair drawn at the same level are contiguous and share the commands of the level
+		const MeshInfo & mesh = meshes[first.mesh];
+		for (unsigned int level = 0; level < mesh.levelCount; level++) {
+			size_t firstInstance = instanceTransforms.size();
+			for (size_t j = i; j < end; j++) {
+				unsigned int instanceLevel = (lods != NULL) ? std::min((unsigned int)(*lods)[order[j]], mesh.levelCount - 1) : 0;
+				if (instanceLevel == level) {
+					instanceTransforms.push_back(instances[order[j]].transform);
+				}
+			}
+			GLuint instanceCount = instanceTransforms.size() - firstInstance;
+			if (instanceCount == 0) {
+				continue;
+			}
+
+			const MeshLevel & meshLevel = levels[mesh.firstLevel + level];
+			for (unsigned int p = meshLevel.firstPart; p < meshLevel.firstPart + meshLevel.partCount; p++) {
+				DrawElementsIndirectCommand command = {parts[p].indexCount, instanceCount, parts[p].firstIndex, parts[p].baseVertex, (GLuint)firstInstance};
+				commands.push_back(command);
+				materialDraws.back().commandCount++;
+				drawnTriangles += (size_t)(parts[p].indexCount / 3) * instanceCount;
+			}
+		}
+		i = end;
+	}
+
+	// The instance buffer only grows, orphaning it avoids waiting for the frames still reading it
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	instanceCapacity = std::max(instanceCapacity, instanceTransforms.size());
+	glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, instanceTransforms.size() * sizeof(glm::mat4), instanceTransforms.data());
+
+	if (multiDrawIndirect) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+	}
+
+	drawListsHoldAll = (visible == NULL && lods == NULL);
+}
+
+void Scene::drawCommands(unsigned int firstCommand, unsigned int commandCount) {
+	size_t indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(unsigned short) : sizeof(unsigned int);
+
+	if (multiDrawIndirect) {
+		glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)(firstCommand * sizeof(DrawElementsIndirectCommand)), commandCount, 0);
+		drawCalls++;
+		return;
+	}
+
+	// Without base instances, the instance attribute is moved to the first instance of every command
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (unsigned int i = firstCommand; i < firstCommand + commandCount; i++) {
+		const DrawElementsIndirectCommand & command = commands[i];
+		setInstanceAttribute(command.baseInstance);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, indexType, (void*)(command.firstIndex * indexSize),
+			command.instanceCount, command.baseVertex);
+		drawCalls++;
+	}
+	setInstanceAttribute(0);
+}
+
+void Scene::draw(MeshPass pass, const std::vector<unsigned char> * visible, const std::vector<unsigned char> * lods) {
+	if (instancesChanged) {
+		sortInstances();
+	}
+	if (visible != NULL || lods != NULL || !drawListsHoldAll) {
+		updateDrawLists(visible, lods);
+	}
+
+	drawCalls = 0;
+	glBindVertexArray(pass == MeshPass::Depth ? depthVertexArray : shadingVertexArray);
+	if (multiDrawIndirect) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+	}
+
+	// The depth pass does not need the materials, all commands are drawn at once
+	if (pass == MeshPass::Depth) {
+		drawCommands(0, commands.size());
+		return;
+	}
+
+	// The current value of an attribute is context state, not part of the VAO
+	if (exposureBuffer == 0) {
+		glVertexAttrib3fv(SCENE_EXPOSURE_ATTRIBUTE, &UNBAKED_EXPOSURE[0]);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	for (const MaterialDraw & draw : materialDraws) {
+		glBindTexture(GL_TEXTURE_2D, materials[draw.material]);
+		drawCommands(draw.firstCommand, draw.commandCount);
+	}
+}
+
+void Scene::release() {
+	glDeleteVertexArrays(1, &shadingVertexArray);
+	glDeleteVertexArrays(1, &depthVertexArray);
+	glDeleteBuffers(1, &vertexBuffer);
+	glDeleteBuffers(1, &positionBuffer);
+	glDeleteBuffers(1, &exposureBuffer);
+	glDeleteBuffers(1, &elementBuffer);
+	glDeleteBuffers(1, &instanceBuffer);
+	glDeleteBuffers(1, &indirectBuffer);
+	shadingVertexArray = depthVertexArray = 0;
+	vertexBuffer = positionBuffer = exposureBuffer = elementBuffer = instanceBuffer = indirectBuffer = 0;
+	instanceCapacity = 0;
+	drawListsHoldAll = false;
+}
+
+void Scene::printStatistics() const {
+	printf("Scene: %d meshes (%d levels of detail), %d instances, %d materials, %d indirect commands, %d draw calls and %d triangles in the last pass\n",
+		(int)meshes.size(), (int)levels.size(), (int)instances.size(), (int)materials.size(), (int)commands.size(), drawCalls, (int)drawnTriangles);
+}
@@ -0,0 +1,271 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "vboindexer.hpp"
+#include "simplify.hpp"
+
+// First of the four attribute locations holding the model matrix of an instance (one column each)
+#define SCENE_INSTANCE_ATTRIBUTE    3
+
+// Attribute location of the baked exposure of the vertices (see bakeExposure), shading pass only
+#define SCENE_EXPOSURE_ATTRIBUTE    7
+
+/**
+ * @brief The attribute streams a pass fetches.
+ */
+
+enum class MeshPass {
+	Depth,		// Location 0: position
+	Shading		// Location 0: position, 1: UV, 2: normal
+};
+
+/**
+ * @brief The command layout read by glMultiDrawElementsIndirect.
+ */
+
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/**
+ * @brief An object of the scene: a mesh drawn with a material and a model matrix.
+ */
+
+struct SceneInstance {
+	unsigned int mesh;
+	unsigned int material;
+	glm::mat4 transform;
+};
+
+/**
+ * @brief The meshes, materials and instances of a scene, drawn with a handful of draw calls.
+ *
+ * All meshes share one vertex arena (interleaved PackedVertex for the shading pass, positions only for
+ * the depth pass) and one index arena; a mesh is a range of them, drawn with a base vertex. The arena
+ * uses 16-bit indices when every mesh (or every chunk of a split mesh) fits them, 32-bit indices otherwise.
+ *
+ * The model matrices of the instances are an instanced vertex attribute (SCENE_INSTANCE_ATTRIBUTE),
+ * sorted by material then mesh, so every (material, mesh) pair is a single indirect command whatever its
+ * number of instances. A pass draws all commands of a material with one glMultiDrawElementsIndirect: the
+ * depth pass is one draw call, the shading pass one per material. Without OpenGL 4.3 the commands are
+ * drawn one by one with glDrawElementsInstancedBaseVertex.
+ *
+ * A mesh can come with a chain of simplified levels (see buildMeshLods), stored in the same arenas. Each pass
+ * picks the level of every instance (selectLods()), the instances of a mesh drawn at the same level share
+ * a command.
+ *
+ * A mesh can also come with its baked exposure (see bakeExposure), one more vertex attribute of the shading
+ * pass (SCENE_EXPOSURE_ATTRIBUTE). The vertices of meshes without it read (0, 0, 1): the shader evaluates
+ * their exposure itself.
+ *
+ * Meshes and materials are added before upload(), instances can be added and moved at any time.
+ * The shaders assume instance transforms without non-uniform scaling (normals are not re-orthogonalized).
+ */
+
+class Scene {
+private:
+	struct MeshPart {
+		GLuint firstIndex;
+		GLuint indexCount;
+		GLint baseVertex;
+	};
+
+	struct MeshLevel {
+		unsigned int firstPart;
+		unsigned int partCount;
+		float error;		// Of the simplified level, 0 at full detail
+	};
+
+	struct MeshInfo {
+		unsigned int firstLevel;
+		unsigned int levelCount;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	struct MaterialDraw {
+		unsigned int material;
+		unsigned int firstCommand;
+		unsigned int commandCount;
+	};
+
+	// Arenas, kept on the CPU until upload()
+	std::vector<PackedVertex> vertices;
+	std::vector<unsigned int> indices;		// Relative to the base vertex of their part
+	std::vector<glm::vec3> exposures;		// One per vertex, when a mesh has a baked exposure
+
+	std::vector<MeshPart> parts;
+	std::vector<MeshLevel> levels;
+	std::vector<MeshInfo> meshes;
+	std::vector<GLuint> materials;
+	std::vector<SceneInstance> instances;
+	bool splitLargeMeshes = false;
+	bool instancesChanged = true;
+	unsigned int version = 0;
+
+	// Instances sorted by material then mesh, sorted again when the instances change
+	std::vector<unsigned int> sortedInstances;
+
+	// Draw lists, rebuilt when the instances or the visible instances change
+	bool drawListsHoldAll = false;
+	std::vector<unsigned int> visibleInstances;
+	std::vector<glm::mat4> instanceTransforms;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<MaterialDraw> materialDraws;
+
+	GLuint vertexBuffer = 0;
+	GLuint positionBuffer = 0;
+	GLuint exposureBuffer = 0;
+	GLuint elementBuffer = 0;
+	GLuint instanceBuffer = 0;
+	GLuint indirectBuffer = 0;
+	GLuint shadingVertexArray = 0;
+	GLuint depthVertexArray = 0;
+	GLenum indexType = GL_UNSIGNED_SHORT;
+	size_t instanceCapacity = 0;
+	bool multiDrawIndirect = false;
+	unsigned int drawCalls = 0;
+	size_t drawnTriangles = 0;
+
+	void addLevel(const PackedVertex * vertices, const glm::vec3 * exposure, size_t vertexCount, const unsigned int * indices, size_t indexCount, float error, bool fullDetail);
+	void sortInstances();
+	void updateDrawLists(const std::vector<unsigned char> * visible, const std::vector<unsigned char> * lods);
+	void drawCommands(unsigned int firstCommand, unsigned int commandCount);
+
+public:
+
+	/**
+	 * @brief Creates an empty scene.
+	 * @param splitLargeMeshes Split meshes over MAX_VERTICES_16BIT vertices into 16-bit chunks instead of switching the arena to 32-bit indices.
+	 */
+
+	explicit Scene(bool splitLargeMeshes = false);
+
+	/**
+	 * @brief Copies an indexed mesh into the arenas.
+	 * @param vertices The unique interleaved vertices (see indexVBO), e.g. straight from a mapped mesh cache.
+	 * @param vertexCount The number of vertices.
+	 * @param indices Three indices per triangle.
+	 * @param indexCount The number of indices.
+	 * @param lodIndices The indices of the simplified levels of the mesh, referencing the same vertices.
+	 * @param lods The simplified levels, ranges of lodIndices from the finest to the coarsest.
+	 * @param lodCount The number of simplified levels, 0 for a mesh always drawn at full detail.
+	 * @param exposure The baked exposure of every vertex (see bakeExposure), NULL to evaluate it in the shader.
+	 * @return unsigned int The mesh, to be referenced by instances.
+	 */
+
+	unsigned int addMesh(const PackedVertex * vertices, size_t vertexCount, const unsigned int * indices, size_t indexCount,
+		const unsigned int * lodIndices = NULL, const MeshLod * lods = NULL, size_t lodCount = 0, const glm::vec3 * exposure = NULL);
+
+	/**
+	 * @brief Registers a material, the scene does not own the texture.
+	 * @param texture The diffuse texture, bound to texture unit 0 when the material is drawn.
+	 * @return unsigned int The material, to be referenced by instances.
+	 */
+
+	unsigned int addMaterial(GLuint texture);
+
+	/**
+	 * @brief Places a mesh in the scene.
+	 * @param mesh A mesh returned by addMesh().
+	 * @param material A material returned by addMaterial().
+	 * @param transform The model matrix of the instance.
+	 * @return unsigned int The instance.
+	 */
+
+	unsigned int addInstance(unsigned int mesh, unsigned int material, const glm::mat4 & transform);
+
+	/**
+	 * @brief Moves an instance, the instance buffer is refreshed before the next draw.
+	 */
+
+	void setTransform(unsigned int instance, const glm::mat4 & transform);
+
+	/**
+	 * @brief Uploads the arenas and configures the vertex array objects of both passes.
+	 * The CPU copies of the arenas are released afterwards, no mesh can be added anymore.
+	 */
+
+	void upload();
+
+	/**
+	 * @brief Picks for every instance the coarsest level whose error stays under a screen-space tolerance.
+	 *
+	 * The error of a level, scaled by the instance transform, is projected at the point of the instance
+	 * box closest to the eye: an instance covering a few hundred pixels is drawn with a fraction of its triangles.
+	 *
+	 * @param eyePosition The camera, ignored by orthographic projections.
+	 * @param pixelsPerUnit Pixels covered by one scene unit, at distance 1 for a perspective projection:
+	 * half the viewport height times the [1][1] element of the projection matrix, for both kinds of projections.
+	 * @param orthographic The projection is orthographic, the projected error does not depend on the distance.
+	 * @param maxPixelError The tolerance, in pixels. A larger tolerance picks coarser levels, e.g. for the occlusion map.
+	 * @param out_lods One level per instance, for draw().
+	 */
+
+	void selectLods(const glm::vec3 & eyePosition, float pixelsPerUnit, bool orthographic, float maxPixelError, std::vector<unsigned char> & out_lods) const;
+
+	/**
+	 * @brief Draws the instances with the VAO of a pass, the VAO stays bound afterwards.
+	 * @param pass The pass the current program belongs to. The shading pass binds the texture of each material to texture unit 0.
+	 * @param visible One flag per instance (see SceneCuller), NULL to draw every instance. The instance and indirect
+	 * buffers are refilled with the visible instances at every call with flags or levels.
+	 * @param lods The level of every instance (see selectLods()), NULL to draw every instance at full detail.
+	 */
+
+	void draw(MeshPass pass, const std::vector<unsigned char> * visible = NULL, const std::vector<unsigned char> * lods = NULL);
+
+	/**
+	 * @brief Deletes the buffers and the vertex array objects.
+	 */
+
+	void release();
+
+	/**
+	 * @brief Prints the number of meshes, instances, indirect commands, and the draw calls and triangles of the last pass.
+	 */
+
+	void printStatistics() const;
+
+	/**
+	 * @brief The axis-aligned box around an instance, in scene space (the box of its mesh, transformed).
+	 */
+
+	void instanceBounds(unsigned int instance, glm::vec3 & out_min, glm::vec3 & out_max) const;
+
+	/**
+	 * @brief Incremented whenever an instance is added or moved.
+	 */
+
+	unsigned int instanceVersion() const { return version; }
+
+	size_t meshCount() const { return meshes.size(); }
+	unsigned int meshLevelCount(unsigned int mesh) const { return meshes[mesh].levelCount; }
+	size_t instanceCount() const { return instances.size(); }
+	const SceneInstance & instance(unsigned int index) const { return instances[index]; }
+	GLuint materialTexture(unsigned int material) const { return materials[material]; }
+	glm::vec3 meshBoundsMin(unsigned int mesh) const { return meshes[mesh].boundsMin; }
+	glm::vec3 meshBoundsMax(unsigned int mesh) const { return meshes[mesh].boundsMax; }
+
+	/**
+	 * @brief The number of draw calls issued by the last draw().
+	 */
+
+	unsigned int lastDrawCalls() const { return drawCalls; }
+
+	/**
+	 * @brief The number of triangles drawn by the last draw(), all instances included.
+	 */
+
+	size_t lastTriangleCount() const { return drawnTriangles; }
+};
+
+#endif // SCENE_HPP
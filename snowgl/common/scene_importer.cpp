@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include <assimp/Importer.hpp>		// C++ importer interface
+#include <assimp/scene.h>			// Output data structure
+#include <assimp/postprocess.h>		// Post processing flags
+
+#include "mapped_file.hpp"
+#include "scene_importer.hpp"
+
+// Directory of a file, with its trailing separator ("" if the path has no directory)
+static std::string directoryOf(const std::string & path) {
+	size_t separator = path.find_last_of("/\\");
+	return (separator == std::string::npos) ? std::string() : path.substr(0, separator + 1);
+}
+
+static void importMaterial(const aiMaterial * material, const std::string & directory, SceneMaterial & out_material) {
+	aiString name;
+	if (material->Get(AI_MATKEY_NAME, name) == AI_SUCCESS) {
+		out_material.name = name.C_Str();
+	}
+
+	aiColor3D diffuse(1.0f, 1.0f, 1.0f);
+	material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+	out_material.diffuseColor = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+
+	aiString texture;
+	if (material->GetTextureCount(aiTextureType_DIFFUSE) == 0 || material->GetTexture(aiTextureType_DIFFUSE, 0, &texture) != AI_SUCCESS) {
+		return;
+	}
+
+	// Embedded textures ("*0", "*1", ...) are not supported
+	std::string texturePath = directory + texture.C_Str();
+	uint64_t size;
+	int64_t modificationTime;
+	if (texture.C_Str()[0] == '*' || !getFileStatus(texturePath.c_str(), size, modificationTime)) {
+		printf("Material %s: texture %s not found, using the default texture\n", out_material.name.c_str(), texture.C_Str());
+		return;
+	}
+	out_material.diffuseTexture = texturePath;
+}
+
+// Assimp matrices are row-major, glm matrices are column-major
+static glm::mat4 toGlm(const aiMatrix4x4 & matrix) {
+	return glm::mat4(
+		matrix.a1, matrix.b1, matrix.c1, matrix.d1,
+		matrix.a2, matrix.b2, matrix.c2, matrix.d2,
+		matrix.a3, matrix.b3, matrix.c3, matrix.d3,
+		matrix.a4, matrix.b4, matrix.c4, matrix.d4);
+}
+
+// Converts a mesh to interleaved vertices, in mesh space
+static void importMesh(const aiMesh * mesh, SceneMesh & out_mesh) {
+	out_mesh.material = mesh->mMaterialIndex;
+	out_mesh.vertices.resize(mesh->mNumVertices);
+
+	for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+		PackedVertex & vertex = out_mesh.vertices[i];
+
+		const aiVector3D & position = mesh->mVertices[i];
+		vertex.position = glm::vec3(position.x, position.y, position.z);
+
+		// Invert V coordinate like loadOBJ, the textures are DDS files
+		if (mesh->HasTextureCoords(0)) {
+			vertex.uv = glm::vec2(mesh->mTextureCoords[0][i].x, -mesh->mTextureCoords[0][i].y);
+		}
+		else {
+			vertex.uv = glm::vec2(0.0f);
+		}
+
+		// aiProcess_GenSmoothNormals doesn't guarantee normals, vertices without one point up
+		if (mesh->HasNormals()) {
+			const aiVector3D & normal = mesh->mNormals[i];
+			vertex.normal = glm::vec3(normal.x, normal.y, normal.z);
+		}
+		else {
+			vertex.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+	}
+
+	out_mesh.indices.resize(3 * mesh->mNumFaces);
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+		for (unsigned int k = 0; k < 3; k++) {
+			out_mesh.indices[3 * i + k] = mesh->mFaces[i].mIndices[k];
+		}
+	}
+}
+
+// Flattens the node hierarchy into instances of the imported meshes
+static void importNode(const aiNode * node, const glm::mat4 & parentTransform, const std::vector<int> & importedMesh, ImportedScene & out_scene) {
+	glm::mat4 transform = parentTransform * toGlm(node->mTransformation);
+
+	for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+		int mesh = importedMesh[node->mMeshes[i]];
+		if (mesh >= 0) {
+			SceneNodeInstance instance = {(unsigned int)mesh, transform};
+			out_scene.instances.push_back(instance);
+		}
+	}
+
+	for (unsigned int i = 0; i < node->mNumChildren; i++) {
+		importNode(node->mChildren[i], transform, importedMesh, out_scene);
+	}
+}
+
+bool importScene(const char * path, ImportedScene & out_scene) {
+	printf("Importing scene %s...\n", path);
+
+	Assimp::Importer importer;
+	const aiScene * scene = importer.ReadFile(path,
+		aiProcess_Triangulate |
+		aiProcess_SortByPType |
+		aiProcess_GenSmoothNormals |				// Only for meshes without normals
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_ImproveCacheLocality |
+		aiProcess_RemoveRedundantMaterials);
+
+	if (!scene || !scene->mRootNode) {
+		fprintf(stderr, "%s\n", importer.GetErrorString());
+		return false;
+	}
+
+	std::string directory = directoryOf(path);
+
+	out_scene.materials.resize(scene->mNumMaterials);
+	for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+		importMaterial(scene->mMaterials[i], directory, out_scene.materials[i]);
+	}
+
+	// aiProcess_SortByPType leaves points and lines in meshes of their own, they are not imported
+	out_scene.meshes.clear();
+	out_scene.instances.clear();
+	std::vector<int> importedMesh(scene->mNumMeshes, -1);
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		if (scene->mMeshes[i]->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) {
+			importedMesh[i] = out_scene.meshes.size();
+			out_scene.meshes.push_back(SceneMesh());
+			importMesh(scene->mMeshes[i], out_scene.meshes.back());
+		}
+	}
+	importNode(scene->mRootNode, glm::mat4(1.0f), importedMesh, out_scene);
+
+	if (out_scene.instances.empty()) {
+		fprintf(stderr, "%s contains no triangles\n", path);
+		return false;
+	}
+
+	size_t triangleCount = 0;
+	for (const SceneNodeInstance & instance : out_scene.instances) {
+		triangleCount += out_scene.meshes[instance.mesh].indices.size() / 3;
+	}
+
+	printf("Imported %zu meshes, %zu instances, %zu triangles\n", out_scene.meshes.size(), out_scene.instances.size(), triangleCount);
+	return true;
+}
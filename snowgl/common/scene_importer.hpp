@@ -0,0 +1,66 @@
+#ifndef SCENE_IMPORTER_HPP
+#define SCENE_IMPORTER_HPP
+
+#include <vector>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "vboindexer.hpp"
+
+/**
+ * @brief A material of an imported scene, only what the shading pass uses.
+ */
+
+struct SceneMaterial {
+	std::string name;
+	glm::vec3 diffuseColor = glm::vec3(1.0f);
+	std::string diffuseTexture;		// Path of the diffuse texture, empty if the material has none (or it can't be found)
+};
+
+/**
+ * @brief A mesh of an imported scene, in its own space, ready for Scene::addMesh().
+ */
+
+struct SceneMesh {
+	unsigned int material = 0;		// Index in ImportedScene::materials
+	std::vector<PackedVertex> vertices;
+	std::vector<unsigned int> indices;
+};
+
+/**
+ * @brief A node of the scene graph referencing a mesh, with the transform accumulated from the root.
+ */
+
+struct SceneNodeInstance {
+	unsigned int mesh;				// Index in ImportedScene::meshes
+	glm::mat4 transform;
+};
+
+/**
+ * @brief The meshes and materials of a scene file, and where the nodes of its graph place the meshes.
+ * A mesh referenced by several nodes is stored once and instanced.
+ */
+
+struct ImportedScene {
+	std::vector<SceneMaterial> materials;
+	std::vector<SceneMesh> meshes;
+	std::vector<SceneNodeInstance> instances;
+};
+
+/**
+ * @brief Loads every mesh and material of a scene file with Assimp (any format it supports: OBJ, 3DS, Collada, ...).
+ *
+ * Assimp triangulates the faces, joins identical vertices and reorders the triangles for the
+ * post-transform vertex cache. The node hierarchy is flattened into one instance per mesh reference,
+ * so repeated objects share their vertices. Points and lines are ignored.
+ * V coordinates are inverted like loadOBJ does.
+ *
+ * @param path The scene file, texture paths are resolved relative to its directory.
+ * @param out_scene The scene.
+ * @return bool True if the file has been loaded, false if Assimp can't read it or it contains no triangles.
+ */
+
+bool importScene(const char * path, ImportedScene & out_scene);
+
+#endif // SCENE_IMPORTER_HPP
@@ -13,12 +13,34 @@ using namespace std;
 #include <GL/glew.h>
 
 #include "shader.hpp"
+#include "program_cache.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+// Where LoadShaders looks for linked programs before compiling them, if set (see setProgramCache)
+static ProgramCache * programCache = NULL;
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+void setProgramCache(ProgramCache * cache){
+	programCache = cache;
+}
+
+// Inserts the definitions after the #version line, which must stay first. A #line directive gives the
+// following lines their number in the file back, for the compiler messages (GLSL 3.30 numbers the line
+// after "#line N" as N + 1).
+static void injectDefines(std::string & code, const char * defines){
+	if ( defines == NULL || defines[0] == '\0' ){
+		return;
+	}
+
+	size_t version = code.find("#version");
+	size_t insertAt = 0;
+	if ( version != std::string::npos ){
+		size_t lineEnd = code.find('\n', version);
+		insertAt = ( lineEnd != std::string::npos ) ? lineEnd + 1 : code.size();
+	}
+	int linesBefore = std::count(code.begin(), code.begin() + insertAt, '\n');
+	code.insert(insertAt, std::string(defines) + "#line " + std::to_string(linesBefore) + "\n");
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines){
 
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
@@ -44,6 +66,24 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		FragmentShaderStream.close();
 	}
 
+	injectDefines(VertexShaderCode, defines);
+	injectDefines(FragmentShaderCode, defines);
+
+	// A program linked from the same sources by the same driver is loaded instead of compiled
+	bool cached = ( programCache != NULL && programCache->isEnabled() );
+	uint64_t cacheKey = cached ? programCache->key(VertexShaderCode, FragmentShaderCode) : 0;
+	if ( cached ){
+		GLuint CachedProgramID = programCache->load(cacheKey);
+		if ( CachedProgramID != 0 ){
+			printf("Loaded cached program : %s, %s\n", vertex_file_path, fragment_file_path);
+			return CachedProgramID;
+		}
+	}
+
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
@@ -87,6 +127,9 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if ( cached ){
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -105,7 +148,136 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	if ( cached && Result == GL_TRUE ){
+		programCache->store(cacheKey, ProgramID);
+	}
+
 	return ProgramID;
 }
 
 
+
+bool ShaderProgram::load(const char * vertex_file_path, const char * fragment_file_path, const char * defines){
+
+	programID = LoadShaders(vertex_file_path, fragment_file_path, defines);
+	uniforms.clear();
+
+	GLint linked = GL_FALSE;
+	if ( programID != 0 ){
+		glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+	}
+	if ( linked != GL_TRUE ){
+		return false;
+	}
+
+	// Uniforms of a uniform block have no location and are skipped
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+
+	for ( GLint i=0 ; i<count ; i++ ){
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(programID, i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+
+		std::string uniformName(&name[0], length);
+		GLint location = glGetUniformLocation(programID, uniformName.c_str());
+		if ( location < 0 ){
+			continue;
+		}
+
+		uniforms[uniformName] = location;
+		size_t bracket = uniformName.find('[');
+		if ( bracket != std::string::npos ){
+			uniforms[uniformName.substr(0, bracket)] = location;
+		}
+	}
+
+	return true;
+}
+
+GLint ShaderProgram::getUniformLocation(const std::string & name) const{
+	std::map<std::string, GLint>::const_iterator it = uniforms.find(name);
+	return it != uniforms.end() ? it->second : -1;
+}
+
+void ShaderProgram::bindUniformBlock(const char * blockName, GLuint bindingPoint){
+	GLuint index = glGetUniformBlockIndex(programID, blockName);
+	if ( index != GL_INVALID_INDEX ){
+		glUniformBlockBinding(programID, index, bindingPoint);
+	}
+}
+
+GLuint ShaderProgram::getID() const{
+	return programID;
+}
+
+void ShaderProgram::use() const{
+	glUseProgram(programID);
+}
+
+void ShaderProgram::release(){
+	glDeleteProgram(programID);
+	programID = 0;
+	uniforms.clear();
+}
+
+ShaderDefines & ShaderDefines::set(const std::string & name, int value){
+	values[name] = std::to_string(value);
+	return *this;
+}
+
+ShaderDefines & ShaderDefines::set(const std::string & name, float value){
+	// Enough digits to give back the same float, and always a float literal for GLSL
+	char text[32];
+	snprintf(text, sizeof(text), "%.9g", value);
+	values[name] = text;
+	if ( strpbrk(text, ".eEn") == NULL ){
+		values[name] += ".0";
+	}
+	return *this;
+}
+
+std::string ShaderDefines::source() const{
+	std::string text;
+	for ( std::map<std::string, std::string>::const_iterator it = values.begin(); it != values.end(); ++it ){
+		text += "#define " + it->first + " " + it->second + "\n";
+	}
+	return text;
+}
+
+std::string ShaderDefines::description() const{
+	std::string text;
+	for ( std::map<std::string, std::string>::const_iterator it = values.begin(); it != values.end(); ++it ){
+		text += (text.empty() ? "" : " ") + it->first + "=" + it->second;
+	}
+	return text;
+}
+
+ShaderPermutations::ShaderPermutations(const char * vertex_file_path, const char * fragment_file_path, const std::function<void(ShaderProgram &)> & setup)
+	: vertexPath(vertex_file_path), fragmentPath(fragment_file_path), setup(setup){
+}
+
+ShaderProgram & ShaderPermutations::get(const ShaderDefines & defines){
+	std::map<ShaderDefines, ShaderProgram>::iterator it = variants.find(defines);
+	if ( it != variants.end() ){
+		return it->second;
+	}
+
+	printf("Shader variant : %s\n", defines.description().c_str());
+	ShaderProgram & program = variants[defines];
+	if ( program.load(vertexPath.c_str(), fragmentPath.c_str(), defines.source().c_str()) && setup ){
+		program.use();
+		setup(program);
+	}
+	return program;
+}
+
+void ShaderPermutations::release(){
+	for ( std::map<ShaderDefines, ShaderProgram>::iterator it = variants.begin(); it != variants.end(); ++it ){
+		it->second.release();
+	}
+	variants.clear();
+}
@@ -1,6 +1,121 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
+#include <string>
+#include <map>
+#include <functional>
+
+class ProgramCache;
+
+// Makes LoadShaders load the programs from a cache of linked binaries, and save the ones it compiles. NULL disables it.
+void setProgramCache(ProgramCache * cache);
+
+// Compiles and links a program. defines, if given, is inserted into both sources right after their #version line.
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines = NULL);
+
+/**
+ * @brief The preprocessor definitions of a shader variant, e.g. LIGHT_COUNT 1.
+ */
+
+class ShaderDefines {
+private:
+	std::map<std::string, std::string> values;		// GLSL literals
+
+public:
+	ShaderDefines & set(const std::string & name, int value);
+	ShaderDefines & set(const std::string & name, float value);
+
+	/**
+	 * @brief The "#define NAME VALUE" lines, sorted by name.
+	 */
+
+	std::string source() const;
+
+	/**
+	 * @brief "NAME=VALUE" pairs, for messages.
+	 */
+
+	std::string description() const;
+
+	bool operator<(const ShaderDefines & other) const { return values < other.values; }
+};
+
+/**
+ * @brief A linked program with the locations of all its active uniforms, reflected once at link time
+ * so nothing is looked up by name while rendering.
+ */
+
+class ShaderProgram {
+private:
+	GLuint programID = 0;
+	std::map<std::string, GLint> uniforms;
+
+public:
+
+	/**
+	 * @brief Compiles and links the program (see LoadShaders) and caches its uniform locations.
+	 * @return bool True if the program has been linked.
+	 */
+
+	bool load(const char * vertex_file_path, const char * fragment_file_path, const char * defines = NULL);
+
+	/**
+	 * @brief Returns the cached location of a uniform of the default block, -1 if it is not active.
+	 * Array uniforms can be looked up both as "name" and "name[0]".
+	 */
+
+	GLint getUniformLocation(const std::string & name) const;
+
+	/**
+	 * @brief Assigns a uniform block of the program to a binding point, if the program uses it.
+	 */
+
+	void bindUniformBlock(const char * blockName, GLuint bindingPoint);
+
+	GLuint getID() const;
+	void use() const;
+	void release();
+};
+
+/**
+ * @brief The variants of a program, compiled from the same sources with different definitions.
+ *
+ * The shaders test the definitions with #if, so a variant only contains the code it uses and loops
+ * over constants (e.g. the light count) can be unrolled by the compiler. A variant is compiled the
+ * first time it is asked for and kept until release(): switching between variants at runtime costs
+ * a glUseProgram.
+ */
+
+class ShaderPermutations {
+private:
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::function<void(ShaderProgram &)> setup;
+	std::map<ShaderDefines, ShaderProgram> variants;
+
+public:
+
+	/**
+	 * @param vertex_file_path The vertex shader of every variant.
+	 * @param fragment_file_path The fragment shader of every variant.
+	 * @param setup Called once for every new variant, with the program in use, to set the uniforms that never change (samplers, blocks).
+	 */
+
+	ShaderPermutations(const char * vertex_file_path, const char * fragment_file_path, const std::function<void(ShaderProgram &)> & setup = nullptr);
+
+	/**
+	 * @brief Returns the variant compiled with some definitions, compiling it first if needed.
+	 */
+
+	ShaderProgram & get(const ShaderDefines & defines);
+
+	size_t variantCount() const { return variants.size(); }
+
+	/**
+	 * @brief Deletes the programs of all the variants.
+	 */
+
+	void release();
+};
 
 #endif
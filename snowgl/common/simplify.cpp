@@ -0,0 +1,352 @@
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+#include "simplify.hpp"
+
+// Weight of the planes holding open borders in place, relative to the plane of a triangle
+#define BORDER_PLANE_WEIGHT 4.0
+
+// Symmetric 4x4 matrix giving the sum of the squared distances of a point to a set of planes
+struct Quadric {
+	double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+	double a11 = 0, a12 = 0, a13 = 0;
+	double a22 = 0, a23 = 0;
+	double a33 = 0;
+
+	void addPlane(const glm::dvec3 & n, double d, double weight) {
+		a00 += weight * n.x * n.x;	a01 += weight * n.x * n.y;	a02 += weight * n.x * n.z;	a03 += weight * n.x * d;
+		a11 += weight * n.y * n.y;	a12 += weight * n.y * n.z;	a13 += weight * n.y * d;
+		a22 += weight * n.z * n.z;	a23 += weight * n.z * d;
+		a33 += weight * d * d;
+	}
+
+	void add(const Quadric & q) {
+		a00 += q.a00;	a01 += q.a01;	a02 += q.a02;	a03 += q.a03;
+		a11 += q.a11;	a12 += q.a12;	a13 += q.a13;
+		a22 += q.a22;	a23 += q.a23;
+		a33 += q.a33;
+	}
+
+	double evaluate(const glm::dvec3 & p) const {
+		return a00 * p.x * p.x + 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a03 * p.x)
+			+ a11 * p.y * p.y + 2.0 * (a12 * p.y * p.z + a13 * p.y)
+			+ a22 * p.z * p.z + 2.0 * a23 * p.z
+			+ a33;
+	}
+};
+
+struct Collapse {
+	double cost;
+	unsigned int from;		// Position removed
+	unsigned int to;		// Position kept
+
+	bool operator>(const Collapse & other) const { return cost > other.cost; }
+};
+
+class Simplifier {
+private:
+	const unsigned int * vertexPosition;		// Welded position of every vertex
+	std::vector<glm::dvec3> positions;
+	std::vector<Quadric> quadrics;
+	std::vector<unsigned char> removed;
+
+	std::vector<unsigned int> triangles;		// Three vertices per triangle, updated by the collapses
+	std::vector<unsigned char> alive;
+	std::vector<std::vector<unsigned int> > incident;	// Triangles around every position, dead ones included
+	size_t liveTriangles = 0;
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > heap;
+
+	// Corner of a triangle at a position, -1 if the triangle does not touch it
+	int corner(unsigned int triangle, unsigned int position) const {
+		for (int k = 0; k < 3; k++) {
+			if (vertexPosition[triangles[3 * triangle + k]] == position) {
+				return k;
+			}
+		}
+		return -1;
+	}
+
+public:
+	Simplifier(const unsigned int * vertexPosition, const std::vector<glm::dvec3> & weldedPositions,
+		const unsigned int * indices, size_t indexCount) : vertexPosition(vertexPosition), positions(weldedPositions) {
+
+		quadrics.resize(positions.size());
+		removed.assign(positions.size(), 0);
+		incident.resize(positions.size());
+
+		// Triangles with a repeated position have no area and no plane, they are left out
+		for (size_t i = 0; i + 2 < indexCount; i += 3) {
+			unsigned int p0 = vertexPosition[indices[i]], p1 = vertexPosition[indices[i + 1]], p2 = vertexPosition[indices[i + 2]];
+			if (p0 == p1 || p1 == p2 || p2 == p0) {
+				continue;
+			}
+			triangles.insert(triangles.end(), indices + i, indices + i + 3);
+		}
+		size_t triangleCount = triangles.size() / 3;
+		alive.assign(triangleCount, 1);
+		liveTriangles = triangleCount;
+
+		// Every position starts with the planes of its triangles, edges used by one triangle are borders
+		std::unordered_map<uint64_t, unsigned int> edgeUses;
+		for (size_t t = 0; t < triangleCount; t++) {
+			const glm::dvec3 & v0 = positions[vertexPosition[triangles[3 * t]]];
+			glm::dvec3 n = glm::cross(positions[vertexPosition[triangles[3 * t + 1]]] - v0, positions[vertexPosition[triangles[3 * t + 2]]] - v0);
+			double length = glm::length(n);
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = vertexPosition[triangles[3 * t + k]];
+				unsigned int b = vertexPosition[triangles[3 * t + (k + 1) % 3]];
+				if (length > 0.0) {
+					quadrics[a].addPlane(n / length, -glm::dot(n / length, v0), 1.0);
+				}
+				incident[a].push_back(t);
+				edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+			}
+		}
+
+		for (size_t t = 0; t < triangleCount; t++) {
+			const glm::dvec3 & v0 = positions[vertexPosition[triangles[3 * t]]];
+			glm::dvec3 n = glm::cross(positions[vertexPosition[triangles[3 * t + 1]]] - v0, positions[vertexPosition[triangles[3 * t + 2]]] - v0);
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = vertexPosition[triangles[3 * t + k]];
+				unsigned int b = vertexPosition[triangles[3 * t + (k + 1) % 3]];
+				if (edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)] != 1) {
+					continue;
+				}
+
+				// Plane through the border, perpendicular to the triangle
+				glm::dvec3 side = glm::cross(positions[b] - positions[a], n);
+				double length = glm::length(side);
+				if (length > 0.0) {
+					side /= length;
+					quadrics[a].addPlane(side, -glm::dot(side, positions[a]), BORDER_PLANE_WEIGHT);
+					quadrics[b].addPlane(side, -glm::dot(side, positions[a]), BORDER_PLANE_WEIGHT);
+				}
+			}
+		}
+
+		for (const auto & edge : edgeUses) {
+			heap.push(cheapestCollapse((unsigned int)(edge.first >> 32), (unsigned int)edge.first));
+		}
+	}
+
+	// Collapsing an edge keeps one of its ends, the one that moves the surface the least
+	Collapse cheapestCollapse(unsigned int a, unsigned int b) const {
+		Quadric q = quadrics[a];
+		q.add(quadrics[b]);
+		double keepB = std::max(q.evaluate(positions[b]), 0.0);
+		double keepA = std::max(q.evaluate(positions[a]), 0.0);
+		Collapse collapse = {keepB, a, b};
+		if (keepA < keepB) {
+			collapse.cost = keepA;
+			collapse.from = b;
+			collapse.to = a;
+		}
+		return collapse;
+	}
+
+	// Moves the position 'from' onto 'to', false (and nothing changed) if it would damage the mesh
+	bool collapse(unsigned int from, unsigned int to) {
+
+		// Every vertex at 'from' needs a vertex at 'to' to become: the one across the collapsed edge
+		std::vector<std::pair<unsigned int, unsigned int> > wedges;
+		for (unsigned int t : incident[from]) {
+			int kFrom = corner(t, from), kTo = corner(t, to);
+			if (!alive[t] || kFrom < 0 || kTo < 0) {
+				continue;
+			}
+			unsigned int vFrom = triangles[3 * t + kFrom], vTo = triangles[3 * t + kTo];
+			bool known = false;
+			for (const auto & wedge : wedges) {
+				if (wedge.first == vFrom) {
+					if (wedge.second != vTo) {
+						return false;	// A seam crosses the edge
+					}
+					known = true;
+				}
+			}
+			if (!known) {
+				wedges.push_back(std::make_pair(vFrom, vTo));
+			}
+		}
+		if (wedges.empty()) {
+			return false;	// The edge is gone
+		}
+
+		// The other triangles keep their orientation, and their vertices all have a destination
+		for (unsigned int t : incident[from]) {
+			int kFrom = corner(t, from);
+			if (!alive[t] || kFrom < 0 || corner(t, to) >= 0) {
+				continue;
+			}
+			unsigned int vFrom = triangles[3 * t + kFrom];
+			if (std::find_if(wedges.begin(), wedges.end(), [vFrom](const std::pair<unsigned int, unsigned int> & w) { return w.first == vFrom; }) == wedges.end()) {
+				return false;	// A seam runs through 'from' away from the edge
+			}
+
+			glm::dvec3 p[3];
+			for (int k = 0; k < 3; k++) {
+				p[k] = positions[vertexPosition[triangles[3 * t + k]]];
+			}
+			glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			p[kFrom] = positions[to];
+			glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+			if (glm::dot(before, after) <= 0.0) {
+				return false;
+			}
+		}
+
+		for (unsigned int t : incident[from]) {
+			int kFrom = corner(t, from);
+			if (!alive[t] || kFrom < 0) {
+				continue;
+			}
+			if (corner(t, to) >= 0) {
+				alive[t] = 0;
+				liveTriangles--;
+				continue;
+			}
+			unsigned int & v = triangles[3 * t + kFrom];
+			for (const auto & wedge : wedges) {
+				if (wedge.first == v) {
+					v = wedge.second;
+					break;
+				}
+			}
+			incident[to].push_back(t);
+		}
+
+		quadrics[to].add(quadrics[from]);
+		removed[from] = 1;
+		std::vector<unsigned int>().swap(incident[from]);
+
+		// Drop the dead triangles around 'to' and queue its edges again with their new cost
+		std::vector<unsigned int> & around = incident[to];
+		around.erase(std::remove_if(around.begin(), around.end(), [this](unsigned int t) { return !alive[t]; }), around.end());
+		std::vector<unsigned int> neighbours;
+		for (unsigned int t : around) {
+			for (int k = 0; k < 3; k++) {
+				unsigned int p = vertexPosition[triangles[3 * t + k]];
+				if (p != to) {
+					neighbours.push_back(p);
+				}
+			}
+		}
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		for (unsigned int p : neighbours) {
+			heap.push(cheapestCollapse(to, p));
+		}
+		return true;
+	}
+
+	void appendTriangles(std::vector<unsigned int> & out_indices) const {
+		for (size_t t = 0; t < alive.size(); t++) {
+			if (alive[t]) {
+				out_indices.insert(out_indices.end(), triangles.begin() + 3 * t, triangles.begin() + 3 * t + 3);
+			}
+		}
+	}
+
+	size_t triangleCount() const { return liveTriangles; }
+
+	// Applies the cheapest valid collapse costing at most maxCost, false when there is none
+	bool step(double maxCost, double & out_cost) {
+		while (!heap.empty()) {
+			Collapse candidate = heap.top();
+			heap.pop();
+			if (removed[candidate.from] || removed[candidate.to]) {
+				continue;
+			}
+
+			// Costs only grow: an entry queued before its ends changed is a lower bound, queue it again
+			Collapse current = cheapestCollapse(candidate.from, candidate.to);
+			if (current.cost > candidate.cost * (1.0 + 1e-9) + 1e-30) {
+				heap.push(current);
+				continue;
+			}
+			if (current.cost > maxCost) {
+				return false;
+			}
+			if (collapse(current.from, current.to)) {
+				out_cost = current.cost;
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+void buildMeshLods(const PackedVertex * vertices, size_t vertexCount, const unsigned int * indices, size_t indexCount,
+	unsigned int maxLevels, float reduction, float maxError,
+	std::vector<unsigned int> & out_indices, std::vector<MeshLod> & out_lods) {
+
+	out_indices.clear();
+	out_lods.clear();
+	if (maxLevels == 0 || vertexCount == 0 || indexCount < 3) {
+		return;
+	}
+
+	// Vertices with the same position are one point of the surface, whatever their UV and normal
+	std::vector<unsigned int> order(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) {
+		order[i] = i;
+	}
+	auto positionLess = [vertices](unsigned int a, unsigned int b) {
+		const glm::vec3 & pa = vertices[a].position, & pb = vertices[b].position;
+		if (pa.x != pb.x) return pa.x < pb.x;
+		if (pa.y != pb.y) return pa.y < pb.y;
+		return pa.z < pb.z;
+	};
+	std::sort(order.begin(), order.end(), positionLess);
+
+	std::vector<unsigned int> vertexPosition(vertexCount);
+	std::vector<glm::dvec3> positions;
+	glm::vec3 boundsMin = vertices[order[0]].position, boundsMax = boundsMin;
+	for (size_t i = 0; i < vertexCount; i++) {
+		if (i == 0 || positionLess(order[i - 1], order[i])) {
+			positions.push_back(glm::dvec3(vertices[order[i]].position));
+		}
+		vertexPosition[order[i]] = positions.size() - 1;
+		boundsMin = glm::min(boundsMin, vertices[order[i]].position);
+		boundsMax = glm::max(boundsMax, vertices[order[i]].position);
+	}
+
+	Simplifier simplifier(vertexPosition.data(), positions, indices, indexCount);
+
+	double diagonal = glm::length(glm::dvec3(boundsMax - boundsMin));
+	double maxCost = (maxError * diagonal) * (maxError * diagonal);
+	size_t previousCount = simplifier.triangleCount();
+	size_t target = (size_t)(previousCount * reduction);
+	double error = 0.0;
+
+	while (out_lods.size() < maxLevels) {
+		double cost;
+		bool simplified = simplifier.step(maxCost, cost);
+		if (simplified) {
+			error = std::max(error, cost);
+			if (simplifier.triangleCount() > target) {
+				continue;
+			}
+		}
+
+		// Out of collapses: the last level is only worth it if it got at least halfway to its target
+		else if (simplifier.triangleCount() > (previousCount + target) / 2) {
+			break;
+		}
+
+		MeshLod lod = {out_indices.size(), 0, (float)sqrt(error)};
+		simplifier.appendTriangles(out_indices);
+		lod.indexCount = out_indices.size() - lod.firstIndex;
+		out_lods.push_back(lod);
+
+		previousCount = simplifier.triangleCount();
+		target = (size_t)(previousCount * reduction);
+		if (!simplified || previousCount <= 1) {
+			break;
+		}
+	}
+}
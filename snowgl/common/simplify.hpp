@@ -0,0 +1,45 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include <vector>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+#include "vboindexer.hpp"
+
+/**
+ * @brief A simplified version of a mesh: a range of the index list of its LOD chain.
+ */
+
+struct MeshLod {
+	size_t firstIndex;
+	size_t indexCount;
+	float error;		// Estimated distance between this level and the full-detail surface, in mesh units
+};
+
+/**
+ * @brief Builds a chain of coarser versions of an indexed mesh with quadric error metrics (Garland & Heckbert).
+ *
+ * Edges are collapsed cheapest first, every vertex accumulating the planes of the triangles it absorbed;
+ * a level is recorded each time the triangle count drops below reduction times the previous level.
+ * Collapses only move a vertex onto one of its neighbours, so every level indexes the original vertices
+ * and shares their buffer. Vertices sharing a position with different UVs or normals (seams) only
+ * collapse along the seam, and collapses that would fold a triangle over are rejected.
+ *
+ * @param vertices The unique interleaved vertices (see indexVBO).
+ * @param vertexCount The number of vertices.
+ * @param indices Three indices per triangle.
+ * @param indexCount The number of indices.
+ * @param maxLevels The maximum number of levels, the full-detail mesh excluded.
+ * @param reduction The fraction of the triangles of a level kept by the next one, e.g. 0.5.
+ * @param maxError Simplification stops once the error exceeds this fraction of the diagonal of the mesh bounds.
+ * @param out_indices The indices of all levels, one after the other.
+ * @param out_lods The levels, from the finest to the coarsest. Fewer than maxLevels when the mesh can't be simplified further.
+ */
+
+void buildMeshLods(const PackedVertex * vertices, size_t vertexCount, const unsigned int * indices, size_t indexCount,
+	unsigned int maxLevels, float reduction, float maxError,
+	std::vector<unsigned int> & out_indices, std::vector<MeshLod> & out_lods);
+
+#endif // SIMPLIFY_HPP
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "snow_depth.hpp"
+#include "shader.hpp"
+#include "global.hpp"
+
+void SnowDepthMap::create(int mapResolution) {
+	resolution = mapResolution;
+
+	glGenTextures(2, textures);
+	glGenFramebuffers(2, framebuffers);
+	for (int i = 0; i < 2; i++) {
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, resolution, resolution, 0, GL_RED, GL_FLOAT, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textures[i], 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "The snow depth framebuffer is incomplete.\n");
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	program = LoadShaders("shaders/FullScreenTriangle.vert", "shaders/SnowDepthUpdate.frag");
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "previousDepth"), 0);
+	glUniform1i(glGetUniformLocation(program, "occlusionMap"), 1);
+	occlusionExtentLocation = glGetUniformLocation(program, "occlusionExtent");
+	accumulationLocation = glGetUniformLocation(program, "accumulation");
+	meltLocation = glGetUniformLocation(program, "melt");
+	maxDepthLocation = glGetUniformLocation(program, "maxDepth");
+
+	// The occlusion map texture compares depths, the update needs the depths themselves
+	glGenSamplers(1, &occlusionSampler);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// The full-screen triangle is generated from gl_VertexID, but a VAO must be bound to draw
+	glGenVertexArrays(1, &vertexArray);
+
+	reset();
+}
+
+void SnowDepthMap::reset() {
+	GLfloat bare[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	for (int i = 0; i < 2; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+		glClearBufferfv(GL_COLOR, 0, bare);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	current = 0;
+	simulatedTime = -1.0;
+}
+
+void SnowDepthMap::step(float snowAmount, float temperature, double minutes) {
+	int next = 1 - current;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[next]);
+	glUniform1f(accumulationLocation, (float)(SNOW_FALL_RATE * snowAmount * minutes));
+	glUniform1f(meltLocation, (float)(SNOW_MELT_RATE * fmax(temperature, 0.0) * minutes));
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, textures[current]);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	current = next;
+	passes++;
+	simulatedMinutes += minutes;
+}
+
+void SnowDepthMap::advance(const EnvironmentColumns & data, double time, GLuint occlusionMap, const glm::vec3 & occlusionBoundsMin, const glm::vec3 & occlusionBoundsMax) {
+	if (simulatedTime >= 0.0 && time < simulatedTime) {
+		reset();
+	}
+	if (simulatedTime < 0.0 || data.empty()) {
+		simulatedTime = time;
+		return;
+	}
+	if (time == simulatedTime) {
+		return;
+	}
+
+	GLint previousVertexArray;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+
+	glViewport(0, 0, resolution, resolution);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glUseProgram(program);
+	glBindVertexArray(vertexArray);
+	glm::vec3 occlusionExtent = occlusionBoundsMax - occlusionBoundsMin;
+	glUniform3fv(occlusionExtentLocation, 1, &occlusionExtent[0]);
+	glUniform1f(maxDepthLocation, SNOW_MAX_DEPTH);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, occlusionMap);
+	glBindSampler(1, occlusionSampler);
+
+	// Every row holds the weather of one minute, a step never spans two rows
+	const float * snowAmounts = data.column(DataColumn::SnowAmount);
+	const float * temperatures = data.column(DataColumn::Temperature);
+	while (simulatedTime < time) {
+		size_t row = std::min((size_t)simulatedTime, data.size() - 1);
+		double stepEnd = fmin(floor(simulatedTime) + 1.0, time);
+		step(snowAmounts[row], temperatures[row], stepEnd - simulatedTime);
+		simulatedTime = stepEnd;
+	}
+
+	glBindSampler(1, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindVertexArray(previousVertexArray);
+	if (depthTest) {
+		glEnable(GL_DEPTH_TEST);
+	}
+	if (cullFace) {
+		glEnable(GL_CULL_FACE);
+	}
+}
+
+void SnowDepthMap::printStatistics() const {
+	printf("Snow depth: %u update passes for %.0f simulated minutes\n", passes, simulatedMinutes);
+}
+
+void SnowDepthMap::release() {
+	glDeleteTextures(2, textures);
+	glDeleteFramebuffers(2, framebuffers);
+	glDeleteProgram(program);
+	glDeleteVertexArrays(1, &vertexArray);
+	glDeleteSamplers(1, &occlusionSampler);
+	textures[0] = textures[1] = 0;
+	framebuffers[0] = framebuffers[1] = 0;
+	program = vertexArray = occlusionSampler = 0;
+}
@@ -0,0 +1,91 @@
+#ifndef SNOW_DEPTH_HPP
+#define SNOW_DEPTH_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "csv_reader.hpp"
+
+/**
+ * @brief The thickness of the snow lying on the scene, seen from the direction the snow falls from.
+ *
+ * The map covers the same orthographic box as the occlusion map, so a point of the scene finds its snow
+ * at the same coordinates (DepthBiasMVP). It persists across frames in a pair of R32F textures: every
+ * time step renders the next state from the previous one (ping-pong), adding the snow that fell on the
+ * exposed surfaces and removing what melted. The cost of a frame is one pass per row of the weather
+ * data it crosses, whatever the length of the history.
+ *
+ * The snowfall of a row (snow_amount) accumulates on the top surface of every texel, less on steep
+ * slopes (measured on the occlusion map); a temperature above zero melts the snow everywhere.
+ */
+
+class SnowDepthMap {
+private:
+	int resolution = 0;
+	GLuint textures[2] = {0, 0};
+	GLuint framebuffers[2] = {0, 0};
+	int current = 0;						// Texture holding the current state
+
+	GLuint program = 0;
+	GLuint vertexArray = 0;
+	GLuint occlusionSampler = 0;			// Reads the occlusion map as plain depth values
+	GLint occlusionExtentLocation = -1;
+	GLint accumulationLocation = -1;
+	GLint meltLocation = -1;
+	GLint maxDepthLocation = -1;
+
+	double simulatedTime = -1.0;			// Row of the weather data the map is at, negative before the first advance()
+	unsigned int passes = 0;
+	double simulatedMinutes = 0.0;
+
+	void step(float snowAmount, float temperature, double minutes);
+
+public:
+
+	/**
+	 * @brief Creates the textures, framebuffers and update program, the map starts without snow.
+	 * @param resolution The width and height of the map in texels.
+	 */
+
+	void create(int resolution);
+
+	/**
+	 * @brief Removes all the snow, the next advance() starts from bare ground.
+	 */
+
+	void reset();
+
+	/**
+	 * @brief Runs the simulation from the last simulated time up to a new time, one pass per row of the data crossed.
+	 *
+	 * The first call only sets the start time. Going back in time (scrolling back, or wrapping around
+	 * the end of the data) starts again from bare ground, since melted snow can't be recovered.
+	 * Changes the framebuffer, viewport, program and texture unit 0 bindings.
+	 *
+	 * @param data The weather data, one row per minute. Only the snow amount and temperature columns are read.
+	 * @param time The fractional row to simulate up to (f_daytime_index).
+	 * @param occlusionMap The depth texture of the occlusion map, read without comparison.
+	 * @param occlusionBoundsMin The orthographic box of the occlusion map, in light space.
+	 * @param occlusionBoundsMax
+	 */
+
+	void advance(const EnvironmentColumns & data, double time, GLuint occlusionMap, const glm::vec3 & occlusionBoundsMin, const glm::vec3 & occlusionBoundsMax);
+
+	/**
+	 * @brief The current snow depth, in scene units, to be sampled with the occlusion map coordinates.
+	 */
+
+	GLuint texture() const { return textures[current]; }
+
+	/**
+	 * @brief Prints the number of update passes and the simulated time they covered.
+	 */
+
+	void printStatistics() const;
+
+	void release();
+};
+
+#endif // SNOW_DEPTH_HPP
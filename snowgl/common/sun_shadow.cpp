@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "sun_shadow.hpp"
+
+void SunShadowCascades::create(int cascadeResolution, int count, float lambda, float shadowDistance, float cascadeMargin, float sunTolerance) {
+	resolution = cascadeResolution;
+	cascadeCount = std::min(std::max(count, 1), SUN_SHADOW_MAX_CASCADES);
+	splitLambda = lambda;
+	distance = shadowDistance;
+	margin = cascadeMargin;
+	tolerance = glm::radians(sunTolerance);
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, cascadeCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "The sun shadow framebuffer is incomplete.\n");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SunShadowCascades::update(const glm::vec3 & sunDirection, const glm::mat4 & view, const glm::mat4 & projection,
+	const glm::vec3 & casterMin, const glm::vec3 & casterMax, unsigned int geometryVersion,
+	const std::function<void(const glm::mat4 & depthMVP)> & renderDepth) {
+
+	glm::mat4 biasMatrix(
+		0.5, 0.0, 0.0, 0.0,
+		0.0, 0.5, 0.0, 0.0,
+		0.0, 0.0, 0.5, 0.0,
+		0.5, 0.5, 0.5, 1.0
+	);
+
+	// Near and far planes of the camera, the cascades end at the shadow distance
+	float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+	float farPlane = std::min(projection[3][2] / (projection[2][2] + 1.0f), distance);
+	for (int i = 0; i < cascadeCount; i++) {
+		float t = (float)(i + 1) / cascadeCount;
+		float logarithmic = nearPlane * powf(farPlane / nearPlane, t);
+		float uniform = nearPlane + (farPlane - nearPlane) * t;
+		splits[i] = splitLambda * logarithmic + (1.0f - splitLambda) * uniform;
+	}
+
+	// A rotation towards the sun, the same for all the cascades
+	glm::vec3 sun = glm::normalize(sunDirection);
+	glm::vec3 up = (fabsf(sun.z) < 0.99f) ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), -sun, up);
+	glm::mat4 cameraToWorld = glm::inverse(view);
+
+	GLboolean polygonOffset = glIsEnabled(GL_POLYGON_OFFSET_FILL);
+	bool bound = false;
+	for (int i = 0; i < cascadeCount; i++) {
+		updates++;
+
+		// Bounding sphere of the slice of the view frustum. Its radius only depends on the projection,
+		// rounded so it doesn't flicker with the floating point error of the corners.
+		float depths[2] = {(i == 0) ? nearPlane : splits[i - 1], splits[i]};
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (int k = 0; k < 8; k++) {
+			float depth = depths[k >> 2];
+			float x = (k & 1) ? 1.0f : -1.0f, y = (k & 2) ? 1.0f : -1.0f;
+			glm::vec4 point(depth * (x + projection[2][0]) / projection[0][0], depth * (y + projection[2][1]) / projection[1][1], -depth, 1.0f);
+			corners[k] = glm::vec3(cameraToWorld * point);
+			center += corners[k] / 8.0f;
+		}
+		float radius = 0.0f;
+		for (int k = 0; k < 8; k++) {
+			radius = std::max(radius, glm::length(corners[k] - center));
+		}
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		// The cascade is kept while its slice stays inside and the sun and geometry don't change
+		Cascade & cascade = cascades[i];
+		if (cascade.valid && cascade.geometryVersion == geometryVersion && glm::dot(cascade.sunDirection, sun) >= cosf(tolerance)) {
+			glm::vec3 inCascade = glm::vec3(cascade.lightView * glm::vec4(center, 1.0f));
+			if (fabsf(inCascade.x - cascade.center.x) + radius <= cascade.halfExtent
+				&& fabsf(inCascade.y - cascade.center.y) + radius <= cascade.halfExtent
+				&& inCascade.z - radius >= cascade.zMin && inCascade.z + radius <= cascade.zMax) {
+				continue;
+			}
+		}
+
+		// Centered on whole texels of the light space, so the shadows don't move with the camera
+		float halfExtent = radius * (1.0f + margin);
+		float texel = 2.0f * halfExtent / resolution;
+		glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+		glm::vec2 snapped = glm::floor(glm::vec2(lightCenter) / texel) * texel;
+
+		// The depth range holds every shadow caster and the cascade itself
+		float zMin = lightCenter.z - halfExtent, zMax = lightCenter.z + halfExtent;
+		for (int k = 0; k < 8; k++) {
+			glm::vec3 corner((k & 1) ? casterMax.x : casterMin.x, (k & 2) ? casterMax.y : casterMin.y, (k & 4) ? casterMax.z : casterMin.z);
+			float z = (lightView * glm::vec4(corner, 1.0f)).z;
+			zMin = std::min(zMin, z);
+			zMax = std::max(zMax, z);
+		}
+		glm::mat4 lightProjection = glm::ortho(snapped.x - halfExtent, snapped.x + halfExtent, snapped.y - halfExtent, snapped.y + halfExtent, -zMax, -zMin);
+		glm::mat4 depthMVP = lightProjection * lightView;
+
+		cascade.valid = true;
+		cascade.geometryVersion = geometryVersion;
+		cascade.sunDirection = sun;
+		cascade.lightView = lightView;
+		cascade.center = snapped;
+		cascade.halfExtent = halfExtent;
+		cascade.zMin = zMin;
+		cascade.zMax = zMax;
+		cascade.matrix = biasMatrix * depthMVP;
+
+		if (!bound) {
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			glViewport(0, 0, resolution, resolution);
+			glEnable(GL_POLYGON_OFFSET_FILL);
+			glPolygonOffset(2.0f, 4.0f);
+			bound = true;
+		}
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		renderDepth(depthMVP);
+		renders++;
+	}
+
+	if (bound) {
+		if (!polygonOffset) {
+			glDisable(GL_POLYGON_OFFSET_FILL);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+}
+
+glm::vec4 SunShadowCascades::splitDepths() const {
+	glm::vec4 depths(0.0f);
+	for (int i = 0; i < cascadeCount; i++) {
+		depths[i] = splits[i];
+	}
+	return depths;
+}
+
+void SunShadowCascades::printStatistics() const {
+	printf("Sun shadows: %u of %u cascade updates rendered, the others reused\n", renders, updates);
+}
+
+void SunShadowCascades::release() {
+	glDeleteTextures(1, &texture);
+	glDeleteFramebuffers(1, &framebuffer);
+	texture = framebuffer = 0;
+	for (int i = 0; i < SUN_SHADOW_MAX_CASCADES; i++) {
+		cascades[i].valid = false;
+	}
+}
@@ -0,0 +1,110 @@
+#ifndef SUN_SHADOW_HPP
+#define SUN_SHADOW_HPP
+
+#include <functional>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#define SUN_SHADOW_MAX_CASCADES 4
+
+/**
+ * @brief Shadow maps of the sun, split into cascades along the view depth of the camera.
+ *
+ * The view frustum is cut at depths between the practical split scheme (a mix of logarithmic and uniform
+ * splits) and every slice gets its own orthographic depth map, a layer of a depth texture array. A cascade
+ * covers the bounding sphere of its slice, so its size doesn't change when the camera turns, and its
+ * center is snapped to whole texels of the light space, so its shadows don't shimmer when the camera moves.
+ *
+ * A cascade is rendered with a margin around the sphere and kept as long as the sphere of its slice stays
+ * inside, the sun moves less than a tolerance and the geometry doesn't change: a slowly moving sun or
+ * camera only re-renders the cascades it has to.
+ */
+
+class SunShadowCascades {
+private:
+
+	// What the depth map of a cascade was rendered with
+	struct Cascade {
+		bool valid = false;
+		unsigned int geometryVersion = 0;
+		glm::vec3 sunDirection;
+		glm::mat4 lightView;
+		glm::vec2 center;				// Snapped center of the cascade, light space
+		float halfExtent = 0.0f;		// Half-width of the map, light space
+		float zMin = 0.0f;				// Depth range of the map, light space
+		float zMax = 0.0f;
+		glm::mat4 matrix;				// World space to the [0, 1] coordinates of the map
+	};
+
+	int resolution = 0;
+	int cascadeCount = 0;
+	float splitLambda = 0.0f;
+	float distance = 0.0f;
+	float margin = 0.0f;
+	float tolerance = 0.0f;
+
+	GLuint texture = 0;
+	GLuint framebuffer = 0;
+	Cascade cascades[SUN_SHADOW_MAX_CASCADES];
+	float splits[SUN_SHADOW_MAX_CASCADES] = {0};
+
+	unsigned int updates = 0;
+	unsigned int renders = 0;
+
+public:
+
+	/**
+	 * @brief Creates the depth texture array and its framebuffer.
+	 * @param resolution The width and height of each cascade in texels.
+	 * @param cascadeCount The number of cascades, at most SUN_SHADOW_MAX_CASCADES.
+	 * @param splitLambda 1 for logarithmic splits, 0 for uniform splits.
+	 * @param distance View depth the last cascade ends at, nothing is shadowed beyond (clamped to the far plane).
+	 * @param margin Extra size of a cascade around its slice, as a fraction of its radius.
+	 * @param tolerance Degrees the sun can move before the cascades are rendered again.
+	 */
+
+	void create(int resolution, int cascadeCount, float splitLambda, float distance, float margin, float tolerance);
+
+	/**
+	 * @brief Renders the cascades that are missing or out of date.
+	 *
+	 * Changes the framebuffer, viewport and polygon offset.
+	 *
+	 * @param sunDirection The direction towards the sun, world space.
+	 * @param view The view matrix of the camera.
+	 * @param projection The perspective projection matrix of the camera.
+	 * @param casterMin The box holding everything that casts a shadow, world space.
+	 * @param casterMax
+	 * @param geometryVersion Changes whenever the geometry drawn into the cascades does, instances or levels of detail.
+	 * @param renderDepth Draws the depth pass of the scene with a given depthMVP, into the bound framebuffer.
+	 */
+
+	void update(const glm::vec3 & sunDirection, const glm::mat4 & view, const glm::mat4 & projection,
+		const glm::vec3 & casterMin, const glm::vec3 & casterMax, unsigned int geometryVersion,
+		const std::function<void(const glm::mat4 & depthMVP)> & renderDepth);
+
+	/**
+	 * @brief World space to the [0, 1] coordinates and depth of a cascade.
+	 */
+
+	const glm::mat4 & matrix(int cascade) const { return cascades[cascade].matrix; }
+
+	/**
+	 * @brief The view depths the cascades end at, 0 past the last cascade.
+	 */
+
+	glm::vec4 splitDepths() const;
+
+	GLuint depthTexture() const { return texture; }
+
+	/**
+	 * @brief Prints the number of cascades rendered and reused.
+	 */
+
+	void printStatistics() const;
+
+	void release();
+};
+
+#endif // SUN_SHADOW_HPP
@@ -13,108 +13,129 @@ using namespace glm;
 #include "text2D.hpp"
 
 unsigned int Text2DTextureID;
-unsigned int Text2DVertexBufferID;
-unsigned int Text2DUVBufferID;
+unsigned int Text2DVertexArrayID;
+unsigned int Text2DQuadBufferID;
+unsigned int Text2DGlyphBufferID;
 unsigned int Text2DShaderID;
 unsigned int Text2DUniformID;
+unsigned int Text2DScreenSizeID;
+unsigned int Text2DColorID;
 
-void initText2D(const char * texturePath){
+// Queued glyphs: x, y (top-left, in pixels), height (in pixels) and character code.
+// Reserved once, the per-frame text never reallocates.
+std::vector<glm::vec4> Text2DGlyphs;
 
-	// Initialize texture
-	Text2DTextureID = loadDDS(texturePath);
+void initText2D(const char * texturePath){
 
-	// Initialize VBO
-	glGenBuffers(1, &Text2DVertexBufferID);
-	glGenBuffers(1, &Text2DUVBufferID);
+	// Initialize texture, the glyphs are drawn 1:1 so mipmaps are not wanted
+	Text2DTextureID = loadBMP_custom(texturePath);
+	glBindTexture(GL_TEXTURE_2D, Text2DTextureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
 	// Initialize Shader
-	Text2DShaderID = LoadShaders( "TextVertexShader.vertexshader", "TextVertexShader.fragmentshader" );
+	Text2DShaderID = LoadShaders( "shaders/Text2D.vert", "shaders/Text2D.frag" );
 
 	// Initialize uniforms' IDs
-	Text2DUniformID = glGetUniformLocation( Text2DShaderID, "myTextureSampler" );
+	Text2DUniformID = glGetUniformLocation( Text2DShaderID, "fontSampler" );
+	Text2DScreenSizeID = glGetUniformLocation( Text2DShaderID, "screenSize" );
+	Text2DColorID = glGetUniformLocation( Text2DShaderID, "textColor" );
+
+	// The VAO is configured once, the text has its own so the caller's VAO is left untouched
+	GLint previousVertexArray;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+	glGenVertexArrays(1, &Text2DVertexArrayID);
+	glBindVertexArray(Text2DVertexArrayID);
+
+	// 1rst attribute buffer : corners of the glyph quad, shared by all glyphs.
+	// Pixel y goes down, the strip starts at the bottom so it is counter-clockwise on screen (back faces are culled).
+	static const GLfloat quad[] = {
+		0.0f, 1.0f,
+		1.0f, 1.0f,
+		0.0f, 0.0f,
+		1.0f, 0.0f,
+	};
+	glGenBuffers(1, &Text2DQuadBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, Text2DQuadBufferID);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
 
+	// 2nd attribute buffer : one vec4 per glyph (instance), allocated once at full capacity
+	glGenBuffers(1, &Text2DGlyphBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, Text2DGlyphBufferID);
+	glBufferData(GL_ARRAY_BUFFER, TEXT2D_MAX_GLYPHS * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)0 );
+	glVertexAttribDivisor(1, 1);
+
+	glBindVertexArray(previousVertexArray);
+	Text2DGlyphs.reserve(TEXT2D_MAX_GLYPHS);
 }
 
 void printText2D(const char * text, int x, int y, int size){
 
 	unsigned int length = strlen(text);
 
-	// Fill buffers
-	std::vector<glm::vec2> vertices;
-	std::vector<glm::vec2> UVs;
-	for ( unsigned int i=0 ; i<length ; i++ ){
-		
-		glm::vec2 vertex_up_left    = glm::vec2( x+i*size     , y+size );
-		glm::vec2 vertex_up_right   = glm::vec2( x+i*size+size, y+size );
-		glm::vec2 vertex_down_right = glm::vec2( x+i*size+size, y      );
-		glm::vec2 vertex_down_left  = glm::vec2( x+i*size     , y      );
-
-		vertices.push_back(vertex_up_left   );
-		vertices.push_back(vertex_down_left );
-		vertices.push_back(vertex_up_right  );
-
-		vertices.push_back(vertex_down_right);
-		vertices.push_back(vertex_up_right);
-		vertices.push_back(vertex_down_left);
-
-		char character = text[i];
-		float uv_x = (character%16)/16.0f;
-		float uv_y = (character/16)/16.0f;
-
-		glm::vec2 uv_up_left    = glm::vec2( uv_x           , uv_y );
-		glm::vec2 uv_up_right   = glm::vec2( uv_x+1.0f/16.0f, uv_y );
-		glm::vec2 uv_down_right = glm::vec2( uv_x+1.0f/16.0f, (uv_y + 1.0f/16.0f) );
-		glm::vec2 uv_down_left  = glm::vec2( uv_x           , (uv_y + 1.0f/16.0f) );
-		UVs.push_back(uv_up_left   );
-		UVs.push_back(uv_down_left );
-		UVs.push_back(uv_up_right  );
-
-		UVs.push_back(uv_down_right);
-		UVs.push_back(uv_up_right);
-		UVs.push_back(uv_down_left);
+	for ( unsigned int i=0 ; i<length && Text2DGlyphs.size()<TEXT2D_MAX_GLYPHS ; i++ ){
+		unsigned char character = text[i];
+		if ( character != ' ' ){
+			Text2DGlyphs.push_back(glm::vec4(x + i*size/2, y, size, character));
+		}
+	}
+}
+
+void drawText2D(int screenWidth, int screenHeight){
+
+	if ( Text2DGlyphs.empty() ){
+		return;
 	}
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), &vertices[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-	glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs[0], GL_STATIC_DRAW);
+
+	// Orphan the buffer and fill it, the driver does not have to wait for the previous frame
+	glBindBuffer(GL_ARRAY_BUFFER, Text2DGlyphBufferID);
+	glBufferData(GL_ARRAY_BUFFER, TEXT2D_MAX_GLYPHS * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, Text2DGlyphs.size() * sizeof(glm::vec4), &Text2DGlyphs[0]);
 
 	// Bind shader
 	glUseProgram(Text2DShaderID);
+	glUniform2f(Text2DScreenSizeID, (float)screenWidth, (float)screenHeight);
+	glUniform3f(Text2DColorID, 1.0f, 1.0f, 1.0f);
 
 	// Bind texture
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, Text2DTextureID);
-	// Set our "myTextureSampler" sampler to use Texture Unit 0
+	// Set our "fontSampler" sampler to use Texture Unit 0
 	glUniform1i(Text2DUniformID, 0);
 
-	// 1rst attribute buffer : vertices
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
-
-	// 2nd attribute buffer : UVs
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
+	GLint previousVertexArray;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+	glBindVertexArray(Text2DVertexArrayID);
 
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// Draw call
-	glDrawArrays(GL_TRIANGLES, 0, vertices.size() );
+	// Draw call : one quad per glyph
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, Text2DGlyphs.size());
 
 	glDisable(GL_BLEND);
+	if ( depthTest ){
+		glEnable(GL_DEPTH_TEST);
+	}
 
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
-
+	glBindVertexArray(previousVertexArray);
+	Text2DGlyphs.clear();
 }
 
 void cleanupText2D(){
 
 	// Delete buffers
-	glDeleteBuffers(1, &Text2DVertexBufferID);
-	glDeleteBuffers(1, &Text2DUVBufferID);
+	glDeleteBuffers(1, &Text2DQuadBufferID);
+	glDeleteBuffers(1, &Text2DGlyphBufferID);
+	glDeleteVertexArrays(1, &Text2DVertexArrayID);
 
 	// Delete texture
 	glDeleteTextures(1, &Text2DTextureID);
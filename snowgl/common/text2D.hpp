@@ -1,8 +1,34 @@
 #ifndef TEXT2D_HPP
 #define TEXT2D_HPP
 
+// Maximum number of glyphs drawn per frame, the size of the persistent glyph buffer
+#define TEXT2D_MAX_GLYPHS 1024
+
+/**
+ * @brief Loads the glyph atlas and creates the shader, the VAO and the glyph buffer.
+ * @param texturePath A 16 x 16 grid of 8 x 16 glyphs (see models/font_atlas.py).
+ */
+
 void initText2D(const char * texturePath);
+
+/**
+ * @brief Queues a line of text, nothing is drawn until drawText2D().
+ * @param text The text to print.
+ * @param x The left of the text in pixels, from the left of the screen.
+ * @param y The top of the text in pixels, from the top of the screen.
+ * @param size The height of a glyph in pixels, glyphs are half as wide.
+ */
+
 void printText2D(const char * text, int x, int y, int size);
+
+/**
+ * @brief Draws all queued glyphs with a single instanced draw call and empties the queue.
+ * @param screenWidth The width of the screen the pixel coordinates refer to.
+ * @param screenHeight The height of the screen the pixel coordinates refer to.
+ */
+
+void drawText2D(int screenWidth, int screenHeight);
+
 void cleanupText2D();
 
-#endif
\ No newline at end of file
+#endif
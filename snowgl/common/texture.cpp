@@ -1,11 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+#include <chrono>
 
 #include <GL/glew.h>
 
 #include <GLFW/glfw3.h>
 
+#include "texture.hpp"
+#include "image.hpp"
+
 
 GLuint loadBMP_custom(const char * imagepath){
 
@@ -123,63 +130,148 @@ GLuint loadBMP_custom(const char * imagepath){
 #define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
 #define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
 #define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+#define FOURCC_DX10 0x30315844 // Equivalent to "DX10" in ASCII, a DDS_HEADER_DXT10 follows the header
+
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DXGI_FORMAT_BC7_UNORM      98
+#define DXGI_FORMAT_BC7_UNORM_SRGB 99
+
+// GLEW 1.13 only reads the extension string, which a core profile context doesn't have
+static bool hasExtension(const char * name){
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++){
+		const char * extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if (extension != NULL && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
 
-GLuint loadDDS(const char * imagepath){
+// What the blocks of a DDS file need, from its headers
+struct DDSInfo {
+	unsigned int width;
+	unsigned int height;
+	unsigned int mipMapCount;
+	GLenum format;
+	unsigned int blockSize;
+	long dataOffset;			// The blocks of the levels follow each other from there, the finest first
+};
+
+static size_t compressedLevelSize(unsigned int width, unsigned int height, unsigned int blockSize){
+	return (size_t)((width+3)/4)*((height+3)/4)*blockSize;
+}
+
+// Reads the headers of an open DDS file, false if it isn't one the driver can sample
+static bool readDDSHeader(FILE * fp, const char * imagepath, DDSInfo & out_info){
 
 	unsigned char header[124];
 
-	FILE *fp; 
- 
-	/* try to open the file */ 
-	fp = fopen(imagepath, "rb"); 
-	if (fp == NULL){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
-		return 0;
-	}
-   
 	/* verify the type of file */ 
 	char filecode[4]; 
-	fread(filecode, 1, 4, fp); 
-	if (strncmp(filecode, "DDS ", 4) != 0) { 
-		fclose(fp); 
-		return 0; 
+	if (fread(filecode, 1, 4, fp) != 4 || strncmp(filecode, "DDS ", 4) != 0) { 
+		printf("%s is not a DDS file\n", imagepath);
+		return false; 
 	}
 	
 	/* get the surface desc */ 
-	fread(&header, 124, 1, fp); 
+	if (fread(&header, 124, 1, fp) != 1) {
+		printf("%s is truncated\n", imagepath);
+		return false;
+	}
 
-	unsigned int height      = *(unsigned int*)&(header[8 ]);
-	unsigned int width	     = *(unsigned int*)&(header[12]);
-	unsigned int linearSize	 = *(unsigned int*)&(header[16]);
-	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
+	unsigned int flags       = *(unsigned int*)&(header[4 ]);
+	out_info.height          = *(unsigned int*)&(header[8 ]);
+	out_info.width	         = *(unsigned int*)&(header[12]);
+	out_info.mipMapCount     = *(unsigned int*)&(header[24]);
 	unsigned int fourCC      = *(unsigned int*)&(header[80]);
 
- 
-	unsigned char * buffer;
-	unsigned int bufsize;
-	/* how big is it going to be including all mipmaps? */ 
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char)); 
-	fread(buffer, 1, bufsize, fp); 
-	/* close the file pointer */ 
-	fclose(fp);
+	// Without the flag the count is meaningless, there is only the top level
+	if (!(flags & DDSD_MIPMAPCOUNT) || out_info.mipMapCount == 0)
+		out_info.mipMapCount = 1;
 
-	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
-	unsigned int format;
+	bool supported;
 	switch(fourCC) 
 	{ 
 	case FOURCC_DXT1: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
+		out_info.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
+		supported = GLEW_EXT_texture_compression_s3tc || hasExtension("GL_EXT_texture_compression_s3tc");
 		break; 
 	case FOURCC_DXT3: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
+		out_info.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
+		supported = GLEW_EXT_texture_compression_s3tc || hasExtension("GL_EXT_texture_compression_s3tc");
 		break; 
 	case FOURCC_DXT5: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
+		out_info.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
+		supported = GLEW_EXT_texture_compression_s3tc || hasExtension("GL_EXT_texture_compression_s3tc");
+		break; 
+	case FOURCC_DX10: {
+		// Only BC7 is read from the extension header, see tools/texture_converter.cpp
+		unsigned char header10[20];
+		unsigned int dxgiFormat = 0;
+		if (fread(header10, 20, 1, fp) == 1)
+			dxgiFormat = *(unsigned int*)&(header10[0]);
+		if (dxgiFormat != DXGI_FORMAT_BC7_UNORM && dxgiFormat != DXGI_FORMAT_BC7_UNORM_SRGB) {
+			printf("%s: DXGI format %u is not supported, only BC7\n", imagepath, dxgiFormat);
+			return false;
+		}
+		out_info.format = (dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB) ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB : GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+		supported = GLEW_ARB_texture_compression_bptc || GLEW_VERSION_4_2 || hasExtension("GL_ARB_texture_compression_bptc");
 		break; 
+	}
 	default: 
-		free(buffer); 
-		return 0; 
+		printf("%s: only DXT1, DXT3, DXT5 and BC7 DDS files are supported\n", imagepath);
+		return false; 
+	}
+	if (!supported) {
+		printf("%s: the driver can't sample this compressed format\n", imagepath);
+		return false;
+	}
+
+	out_info.blockSize = (out_info.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
+	out_info.dataOffset = ftell(fp);
+	return true;
+}
+
+GLuint loadDDS(const char * imagepath){
+
+	printf("Reading image %s\n", imagepath);
+
+	FILE *fp; 
+ 
+	/* try to open the file */ 
+	fp = fopen(imagepath, "rb"); 
+	if (fp == NULL){
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
+		return 0;
+	}
+
+	DDSInfo info;
+	if (!readDDSHeader(fp, imagepath, info)) {
+		fclose(fp);
+		return 0;
+	}
+	unsigned int width = info.width;
+	unsigned int height = info.height;
+	unsigned int mipMapCount = info.mipMapCount;
+	GLenum format = info.format;
+	unsigned int blockSize = info.blockSize;
+
+	/* how big is it going to be including all mipmaps? */ 
+	size_t bufsize = 0;
+	for (unsigned int level = 0, w = width, h = height; level < mipMapCount; ++level) {
+		bufsize += compressedLevelSize(w, h, blockSize);
+		w = (w > 1) ? w / 2 : 1;
+		h = (h > 1) ? h / 2 : 1;
+	}
+	unsigned char * buffer = (unsigned char*)malloc(bufsize); 
+	size_t read = (buffer != NULL) ? fread(buffer, 1, bufsize, fp) : 0; 
+	/* close the file pointer */ 
+	fclose(fp);
+	if (read != bufsize) {
+		printf("%s is truncated, %u levels need %zu bytes of blocks\n", imagepath, mipMapCount, bufsize);
+		free(buffer);
+		return 0;
 	}
 
 	// Create one OpenGL texture
@@ -188,15 +280,18 @@ GLuint loadDDS(const char * imagepath){
 
 	// "Bind" the newly created texture : all future texture functions will modify this texture
 	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	// Restored after the upload, the later uploads keep their own alignment
+	GLint previousAlignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
 	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
 	
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
-	unsigned int offset = 0;
+	size_t offset = 0;
 
-	/* load the mipmaps */ 
-	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) 
+	/* load the mipmaps, uploaded as they are: nothing is decompressed or generated here */ 
+	for (unsigned int level = 0; level < mipMapCount; ++level) 
 	{ 
-		unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize; 
+		unsigned int size = compressedLevelSize(width, height, blockSize); 
 		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,  
 			0, size, buffer + offset); 
 	 
@@ -209,10 +304,457 @@ GLuint loadDDS(const char * imagepath){
 		if(height < 1) height = 1;
 
 	} 
+	glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
 
 	free(buffer); 
 
+	// The same filtering as loadBMP_custom, limited to the levels of the file so a short chain stays complete
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipMapCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
 	return textureID;
 
 
-}
\ No newline at end of file
+}
+GLuint loadTexture(const char * imagepath){
+
+	// Pick the loader from the file extension
+	const char * extension = strrchr(imagepath, '.');
+	if (extension != NULL && (strcmp(extension, ".dds") == 0 || strcmp(extension, ".DDS") == 0)){
+		return loadDDS(imagepath);
+	}
+	if (extension != NULL && (strcmp(extension, ".bmp") == 0 || strcmp(extension, ".BMP") == 0)){
+		return loadBMP_custom(imagepath);
+	}
+
+	printf("%s: only BMP and DDS textures are supported\n", imagepath);
+	return 0;
+}
+
+static const std::chrono::microseconds POLL_INTERVAL(200);
+
+TextureStreamer::TextureStreamer(size_t budget, size_t uploadBytesPerFrame, int tailSize, int maxLoads)
+	: budget(budget), uploadBytesPerFrame(uploadBytesPerFrame), tailSize(tailSize), maxLoads(std::max(maxLoads, 1)),
+	loads(this->maxLoads), loaded(this->maxLoads), stopping(false) {
+	worker = std::thread(&TextureStreamer::workerLoop, this);
+}
+
+TextureStreamer::~TextureStreamer() {
+	stopping.store(true);
+	if (worker.joinable()) {
+		worker.join();
+	}
+}
+
+GLuint TextureStreamer::add(const char * imagepath) {
+	StreamedTexture texture;
+	texture.path = imagepath;
+
+	// Only the headers are read here, the levels come from the worker
+	const char * extension = strrchr(imagepath, '.');
+	if (extension != NULL && (strcmp(extension, ".dds") == 0 || strcmp(extension, ".DDS") == 0)) {
+		FILE * fp = fopen(imagepath, "rb");
+		DDSInfo info;
+		if (fp == NULL || !readDDSHeader(fp, imagepath, info)) {
+			if (fp == NULL) {
+				printf("%s could not be opened\n", imagepath);
+			}
+			else {
+				fclose(fp);
+			}
+			return 0;
+		}
+		fclose(fp);
+
+		texture.compressed = true;
+		texture.format = info.format;
+		size_t offset = info.dataOffset;
+		for (unsigned int level = 0, w = info.width, h = info.height; level < info.mipMapCount; level++) {
+			Level l = {offset, compressedLevelSize(w, h, info.blockSize), (int)w, (int)h};
+			texture.levels.push_back(l);
+			offset += l.size;
+			w = (w > 1) ? w / 2 : 1;
+			h = (h > 1) ? h / 2 : 1;
+		}
+	}
+	else if (extension != NULL && (strcmp(extension, ".bmp") == 0 || strcmp(extension, ".BMP") == 0)) {
+		int w, h;
+		if (!readBMPSize(imagepath, w, h)) {
+			return 0;
+		}
+
+		// The whole chain, filtered by the worker like the converter does
+		texture.format = GL_RGBA8;
+		size_t offset = 0;
+		while (true) {
+			Level l = {offset, (size_t)w * h * 4, w, h};
+			texture.levels.push_back(l);
+			offset += l.size;
+			if (w == 1 && h == 1) {
+				break;
+			}
+			w = std::max(w / 2, 1);
+			h = std::max(h / 2, 1);
+		}
+	}
+	else {
+		printf("%s: only BMP and DDS textures can be streamed\n", imagepath);
+		return 0;
+	}
+
+	int levelCount = (int)texture.levels.size();
+	texture.tailLevel = levelCount - 1;
+	while (texture.tailLevel > 0 && std::max(texture.levels[texture.tailLevel - 1].width, texture.levels[texture.tailLevel - 1].height) <= tailSize) {
+		texture.tailLevel--;
+	}
+	texture.residentLevel = levelCount;
+	texture.wantedLevel = levelCount;
+
+	// Nothing is sampled until the tail arrives
+	glGenTextures(1, &texture.name);
+	glBindTexture(GL_TEXTURE_2D, texture.name);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+	printf("Streaming image %s (%dx%d, %d levels)\n", imagepath, texture.levels[0].width, texture.levels[0].height, levelCount);
+	textureIndices[texture.name] = (unsigned int)textures.size();
+	textures.push_back(texture);
+	return texture.name;
+}
+
+void TextureStreamer::request(GLuint name, float screenPixels) {
+	std::unordered_map<GLuint, unsigned int>::const_iterator found = textureIndices.find(name);
+	if (found == textureIndices.end()) {
+		return;
+	}
+	StreamedTexture & texture = textures[found->second];
+
+	// The finest level with at least one pixel per texel
+	int levelCount = (int)texture.levels.size();
+	float texels = (float)std::max(texture.levels[0].width, texture.levels[0].height);
+	int level = (screenPixels > 0.0f) ? (int)floorf(log2f(texels / screenPixels)) : levelCount - 1;
+	level = std::min(std::max(level, 0), levelCount - 1);
+	texture.wantedLevel = std::min(texture.wantedLevel, level);
+	texture.lastRequest = frame;
+}
+
+void TextureStreamer::update() {
+	uploadLoaded(false);
+	scheduleLoads();
+
+	// Requests only last one frame
+	frame++;
+	for (StreamedTexture & texture : textures) {
+		texture.wantedLevel = (int)texture.levels.size();
+	}
+}
+
+void TextureStreamer::flush() {
+	do {
+		while (buffers.size() > freeBuffers.size()) {
+			uploadLoaded(true);
+			if (buffers.size() > freeBuffers.size()) {
+				std::this_thread::sleep_for(POLL_INTERVAL);
+			}
+		}
+	} while (scheduleLoads() > 0);
+
+	frame++;
+	for (StreamedTexture & texture : textures) {
+		texture.wantedLevel = (int)texture.levels.size();
+	}
+}
+
+void TextureStreamer::uploadLoaded(bool all) {
+	Load load;
+	while (loaded.tryPop(load)) {
+		uploads.push_back(std::move(load));
+	}
+
+	size_t uploaded = 0;
+	while (!uploads.empty() && (all || uploaded == 0 || uploaded + uploads.front().size <= uploadBytesPerFrame)) {
+		uploaded += uploads.front().size;
+		finishLoad(uploads.front());
+		uploads.pop_front();
+	}
+}
+
+size_t TextureStreamer::scheduleLoads() {
+	// Textures without any level first, then the furthest from the level they were asked for
+	std::vector<unsigned int> candidates;
+	for (unsigned int i = 0; i < textures.size(); i++) {
+		const StreamedTexture & texture = textures[i];
+		if (!texture.loading && !texture.failed && (texture.residentLevel == (int)texture.levels.size() || texture.wantedLevel < texture.residentLevel)) {
+			candidates.push_back(i);
+		}
+	}
+	auto deficit = [this](unsigned int i) {
+		const StreamedTexture & texture = textures[i];
+		return (texture.residentLevel == (int)texture.levels.size()) ? INT_MAX : texture.residentLevel - texture.wantedLevel;
+	};
+	std::sort(candidates.begin(), candidates.end(), [&deficit](unsigned int a, unsigned int b) {
+		return deficit(a) > deficit(b);
+	});
+
+	size_t scheduled = 0;
+	for (unsigned int i : candidates) {
+		StreamedTexture & texture = textures[i];
+		if (texture.residentLevel == (int)texture.levels.size()) {
+			// The tail is loaded even beyond the budget, it is a few kilobytes
+			size_t size = texture.levels.back().offset + texture.levels.back().size - texture.levels[texture.tailLevel].offset;
+			makeRoom(size, i);
+			if (!schedule(i, texture.tailLevel, (int)texture.levels.size() - 1)) {
+				break;
+			}
+		}
+		else {
+			int level = texture.residentLevel - 1;
+			if (!makeRoom(texture.levels[level].size, i)) {
+				continue;
+			}
+			if (!schedule(i, level, level)) {
+				break;
+			}
+		}
+		scheduled++;
+	}
+	return scheduled;
+}
+
+bool TextureStreamer::schedule(unsigned int index, int firstLevel, int lastLevel) {
+	if (freeBuffers.empty()) {
+		if (buffers.size() >= maxLoads) {
+			return false;
+		}
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		buffers.push_back(buffer);
+		freeBuffers.push_back(buffer);
+	}
+
+	StreamedTexture & texture = textures[index];
+	Load load;
+	load.texture = index;
+	load.firstLevel = firstLevel;
+	load.lastLevel = lastLevel;
+	load.path = texture.path;
+	load.compressed = texture.compressed;
+	load.fileOffset = texture.levels[firstLevel].offset;
+	load.size = texture.levels[lastLevel].offset + texture.levels[lastLevel].size - texture.levels[firstLevel].offset;
+	load.buffer = freeBuffers.back();
+
+	// Orphaned then mapped here, written by the worker while the render thread goes on
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, load.buffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, load.size, NULL, GL_STREAM_DRAW);
+	load.destination = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, load.size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (load.destination == NULL) {
+		return false;
+	}
+
+	freeBuffers.pop_back();
+	texture.loading = true;
+	loadingBytes += load.size;
+	loads.tryPush(load);
+	return true;
+}
+
+void TextureStreamer::finishLoad(Load & load) {
+	StreamedTexture & texture = textures[load.texture];
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, load.buffer);
+
+	// The contents of a buffer can be lost while it is mapped, the level is then loaded again
+	bool unmapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+	if (load.succeeded && unmapped) {
+		glBindTexture(GL_TEXTURE_2D, texture.name);
+		GLint previousAlignment;
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		size_t offset = 0;
+		for (int level = load.firstLevel; level <= load.lastLevel; level++) {
+			const Level & l = texture.levels[level];
+			if (texture.compressed) {
+				glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.format, l.width, l.height, 0, (GLsizei)l.size, (void*)offset);
+			}
+			else {
+				glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, l.width, l.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+			}
+			offset += l.size;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, load.firstLevel);
+
+		texture.residentLevel = load.firstLevel;
+		residentBytes += load.size;
+		peakResidentBytes = std::max(peakResidentBytes, residentBytes);
+		uploadedBytes += load.size;
+		loadedLevels += load.lastLevel - load.firstLevel + 1;
+	}
+	else if (!load.succeeded) {
+		texture.failed = true;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	texture.loading = false;
+	loadingBytes -= load.size;
+	freeBuffers.push_back(load.buffer);
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, unsigned int requester) {
+	while (residentBytes + loadingBytes + bytes > budget) {
+		// The finest level of the texture asked for the longest ago, finer than it was asked for
+		StreamedTexture * victim = NULL;
+		for (unsigned int i = 0; i < textures.size(); i++) {
+			StreamedTexture & texture = textures[i];
+			if (i == requester || texture.loading || texture.residentLevel >= std::min(texture.wantedLevel, texture.tailLevel)) {
+				continue;
+			}
+			if (victim == NULL || texture.lastRequest < victim->lastRequest
+				|| (texture.lastRequest == victim->lastRequest && texture.levels[texture.residentLevel].size > victim->levels[victim->residentLevel].size)) {
+				victim = &texture;
+			}
+		}
+		if (victim == NULL) {
+			return false;
+		}
+		evict(*victim);
+	}
+	return true;
+}
+
+void TextureStreamer::evict(StreamedTexture & texture) {
+	int level = texture.residentLevel;
+	glBindTexture(GL_TEXTURE_2D, texture.name);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+
+	// An empty level gives its memory back, the levels above the base don't count for completeness
+	if (texture.compressed) {
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.format, 0, 0, 0, 0, NULL);
+	}
+	else {
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	}
+
+	texture.residentLevel++;
+	residentBytes -= texture.levels[level].size;
+	evictedLevels++;
+}
+
+void TextureStreamer::workerLoop() {
+	Load load;
+	for (;;) {
+		if (!loads.tryPop(load)) {
+			if (stopping.load()) {
+				return;
+			}
+			std::this_thread::sleep_for(POLL_INTERVAL);
+			continue;
+		}
+
+		load.succeeded = readLevels(load);
+
+		// There is room, the queues hold every load in flight
+		while (!loaded.tryPush(load)) {
+			std::this_thread::sleep_for(POLL_INTERVAL);
+		}
+	}
+}
+
+bool TextureStreamer::readLevels(Load & load) {
+	if (load.compressed) {
+		// The blocks of the levels are contiguous in the file
+		FILE * fp = fopen(load.path.c_str(), "rb");
+		bool read = fp != NULL && fseek(fp, (long)load.fileOffset, SEEK_SET) == 0 && fread(load.destination, 1, load.size, fp) == load.size;
+		if (fp != NULL) {
+			fclose(fp);
+		}
+		if (!read) {
+			printf("%s: levels %d to %d could not be read\n", load.path.c_str(), load.firstLevel, load.lastLevel);
+		}
+		return read;
+	}
+
+	// The whole chain at the first load of the texture, the later loads only copy their levels
+	std::vector<Image> & levels = bmpLevels[load.texture];
+	if (levels.empty()) {
+		levels.emplace_back();
+		if (!readBMP(load.path.c_str(), levels[0])) {
+			bmpLevels.erase(load.texture);
+			return false;
+		}
+		while (levels.back().width > 1 || levels.back().height > 1) {
+			Image half;
+			downsampleImage(levels.back(), half);
+			levels.push_back(std::move(half));
+		}
+	}
+	if (load.lastLevel >= (int)levels.size()) {
+		printf("%s: levels %d to %d could not be read\n", load.path.c_str(), load.firstLevel, load.lastLevel);
+		return false;
+	}
+
+	// Rows from the bottom, like loadBMP_custom uploads them
+	unsigned char * destination = load.destination;
+	for (int level = load.firstLevel; level <= load.lastLevel; level++) {
+		const Image & image = levels[level];
+		size_t rowSize = (size_t)image.width * 4;
+		for (int y = 0; y < image.height; y++) {
+			memcpy(destination + rowSize * y, &image.pixels[rowSize * (image.height - 1 - y)], rowSize);
+		}
+		destination += rowSize * image.height;
+	}
+
+	// Every level is resident now, an eviction reads the file again
+	if (load.firstLevel == 0) {
+		bmpLevels.erase(load.texture);
+	}
+	return true;
+}
+
+void TextureStreamer::printStatistics() const {
+	size_t streamed = 0;
+	for (const StreamedTexture & texture : textures) {
+		streamed += (texture.residentLevel < (int)texture.levels.size()) ? 1 : 0;
+	}
+	printf("Texture streaming: %zu textures (%zu with levels), %.1f MB resident of a %.1f MB budget (peak %.1f MB), %u levels loaded (%.1f MB), %u evicted\n",
+		textures.size(), streamed, residentBytes / 1048576.0, budget / 1048576.0, peakResidentBytes / 1048576.0, loadedLevels, uploadedBytes / 1048576.0, evictedLevels);
+}
+
+void TextureStreamer::release() {
+	stopping.store(true);
+	if (worker.joinable()) {
+		worker.join();
+	}
+
+	// The loads the worker finished still hold a mapped buffer
+	Load load;
+	while (loaded.tryPop(load)) {
+		uploads.push_back(std::move(load));
+	}
+	for (Load & pending : uploads) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pending.buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	uploads.clear();
+
+	if (!buffers.empty()) {
+		glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
+	}
+	for (const StreamedTexture & texture : textures) {
+		glDeleteTextures(1, &texture.name);
+	}
+	buffers.clear();
+	freeBuffers.clear();
+	textures.clear();
+	textureIndices.clear();
+	residentBytes = loadingBytes = 0;
+}
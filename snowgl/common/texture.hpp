@@ -1,6 +1,18 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
 
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+#include "bounded_queue.hpp"
+#include "image.hpp"
+
 // Load a .BMP file using our custom loader
 GLuint loadBMP_custom(const char * imagepath);
 
@@ -9,8 +21,157 @@ GLuint loadBMP_custom(const char * imagepath);
 //// Load a .TGA file using GLFW's own loader
 //GLuint loadTGA_glfw(const char * imagepath);
 
-// Load a .DDS file using GLFW's own loader
+// Load a compressed .DDS file (DXT1, DXT3, DXT5 or BC7) with all the mip levels it holds, nothing is generated at runtime
 GLuint loadDDS(const char * imagepath);
 
+// Load a .BMP or .DDS file with the loader matching its extension, 0 for other formats
+GLuint loadTexture(const char * imagepath);
+
+/**
+ * @brief Streams the mip levels of BMP and DDS textures from a background thread, within a budget of video memory.
+ *
+ * A texture can be drawn as soon as add() returns, it shows its coarsest levels first: the worker thread
+ * reads every level up to the tail size at once, then one finer level at a time for the textures the render
+ * loop asks for with request(). DDS levels are the blocks of the file, BMP levels are filtered from the image.
+ * The worker writes the levels straight into mapped pixel unpack buffers, the render thread only unmaps them
+ * and issues the uploads, within a number of bytes per frame. GL_TEXTURE_BASE_LEVEL hides the levels that
+ * aren't there (yet).
+ *
+ * Beyond the budget, the finest levels of the textures not asked for lately, then of those finer than asked
+ * for, are given back before a new level is loaded.
+ */
+
+class TextureStreamer {
+private:
+	struct Level {
+		size_t offset;			// In the DDS file
+		size_t size;
+		int width;
+		int height;
+	};
+
+	struct StreamedTexture {
+		std::string path;
+		GLuint name = 0;
+		bool compressed = false;
+		GLenum format = 0;
+		std::vector<Level> levels;
+		int tailLevel = 0;			// The coarsest levels from this one on are loaded together
+		int residentLevel = 0;		// The finest level uploaded, levels.size() before the first upload
+		int wantedLevel = 0;		// The finest level asked for since the last update, levels.size() if none
+		unsigned int lastRequest = 0;
+		bool loading = false;
+		bool failed = false;
+	};
+
+	// The levels firstLevel to lastLevel of a texture, read by the worker into a mapped buffer
+	struct Load {
+		unsigned int texture = 0;
+		int firstLevel = 0;
+		int lastLevel = 0;
+		std::string path;
+		bool compressed = false;
+		size_t fileOffset = 0;
+		GLuint buffer = 0;
+		unsigned char * destination = NULL;
+		size_t size = 0;
+		bool succeeded = false;
+	};
+
+	size_t budget;
+	size_t uploadBytesPerFrame;
+	int tailSize;
+	size_t maxLoads;
+
+	std::vector<StreamedTexture> textures;
+	std::unordered_map<GLuint, unsigned int> textureIndices;
+	std::vector<GLuint> buffers;
+	std::vector<GLuint> freeBuffers;
+
+	BoundedQueue<Load> loads;		// Render thread to worker
+	BoundedQueue<Load> loaded;		// Worker to render thread
+	std::deque<Load> uploads;		// Loaded, waiting for the upload budget of a frame
+	std::thread worker;
+	std::atomic<bool> stopping;
+
+	size_t residentBytes = 0;
+	size_t loadingBytes = 0;
+	unsigned int frame = 0;
+
+	size_t peakResidentBytes = 0;
+	size_t uploadedBytes = 0;
+	unsigned int loadedLevels = 0;
+	unsigned int evictedLevels = 0;
+
+	// Worker only: the filtered levels of the BMP textures whose finest level hasn't been read yet,
+	// the image is decoded and filtered once and not again for every level
+	std::unordered_map<unsigned int, std::vector<Image>> bmpLevels;
+
+	void workerLoop();
+	bool readLevels(Load & load);
+	void uploadLoaded(bool all);
+	size_t scheduleLoads();
+	bool schedule(unsigned int texture, int firstLevel, int lastLevel);
+	void finishLoad(Load & load);
+	bool makeRoom(size_t bytes, unsigned int requester);
+	void evict(StreamedTexture & texture);
+
+public:
+
+	/**
+	 * @brief Starts the worker thread, the buffers are created when needed.
+	 * @param budget The video memory of all the streamed levels, in bytes.
+	 * @param uploadBytesPerFrame The levels uploaded by an update(), at least one load.
+	 * @param tailSize The levels up to this width and height are loaded together, first.
+	 * @param maxLoads The number of loads in flight, each one has its own pixel unpack buffer.
+	 */
+
+	TextureStreamer(size_t budget, size_t uploadBytesPerFrame, int tailSize, int maxLoads);
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer &) = delete;
+	TextureStreamer & operator=(const TextureStreamer &) = delete;
+
+	/**
+	 * @brief Creates a texture for a BMP or DDS file, only its size is read here.
+	 * @return GLuint The texture, owned by the streamer, or 0 if the file can't be streamed.
+	 */
+
+	GLuint add(const char * imagepath);
+
+	/**
+	 * @brief Asks for the level of a texture that gives about one texel per pixel, called by the render loop every frame.
+	 * @param texture A texture returned by add(), others are ignored.
+	 * @param screenPixels The size on screen the texture is stretched over, in pixels (e.g. the projected size of an instance).
+	 */
+
+	void request(GLuint texture, float screenPixels);
+
+	/**
+	 * @brief Uploads the loaded levels, then evicts and schedules loads for the levels asked for. Once per frame.
+	 * Changes the texture bound to the active unit.
+	 */
+
+	void update();
+
+	/**
+	 * @brief Like update(), but waits until every level asked for is uploaded, so a frame doesn't depend on the speed of the worker.
+	 */
+
+	void flush();
+
+	/**
+	 * @brief Prints the resident memory and the number of levels loaded and evicted.
+	 */
+
+	void printStatistics() const;
+
+	/**
+	 * @brief Stops the worker and deletes the textures and buffers.
+	 */
+
+	void release();
+};
+
 
 #endif
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "util.hpp"
 
+#include <stdio.h>
+#include <chrono>
+
 // On Windows OS with VC++ compiler, windows.h needs to be included before gl.h!
 // https://stackoverflow.com/q/430413
 #ifdef IS_WINDOWS_OS
@@ -10,17 +13,36 @@
 
 #ifdef USE_OPENCV
 cv::Mat frameBufferToCVMat(const int width, const int height) {
-    std::vector<unsigned char> buffer(width * height * 3);
-    glReadPixels(0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, buffer.data());
+    cv::Mat resultMat(height, width, CV_8UC3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, resultMat.data);
 
-    cv::Mat tempMat(height, width, CV_8UC3, buffer.data());
-    cv::Mat resultMat;
-    cv::flip(tempMat, resultMat, 0);
+    // OpenGL returns the rows bottom-up, flip them in place.
+    cv::flip(resultMat, resultMat, 0);
 
     return resultMat;
 }
 #endif
 
+bool writePPM(const char * path, const std::vector<unsigned char> & pixels, const int width, const int height) {
+    FILE * file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "%s could not be opened for writing.\n", path);
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    size_t size = size_t(width) * height * 3;
+    bool written = fwrite(pixels.data(), 1, size, file) == size;
+    fclose(file);
+    return written;
+}
+
+double getTimeInSeconds() {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
 std::string floatToString(float value) {
     std::ostringstream stream;
     stream << std::fixed << std::setprecision(2) << value;
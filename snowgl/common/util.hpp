@@ -4,6 +4,7 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <vector>
 #include "global.hpp"
 
 #ifdef USE_OPENCV
@@ -19,6 +20,24 @@
 cv::Mat frameBufferToCVMat(const int width, const int height);
 #endif
 
+/**
+ * @brief Writes a top-down RGB buffer into a binary PPM (P6) image file.
+ * @param path The path of the image file.
+ * @param pixels The RGB pixels, top-down rows without padding.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @return bool True if the whole image has been written, false otherwise.
+ */
+
+bool writePPM(const char * path, const std::vector<unsigned char> & pixels, const int width, const int height);
+
+/**
+ * @brief Returns a monotonic time stamp in seconds. Unlike glfwGetTime(), it works without GLFW.
+ * @return double The number of seconds elapsed since the first call.
+ */
+
+double getTimeInSeconds();
+
 /**
  * @brief Converts a floating point number to a string with fixed precision.
  * @param value The floating point number to convert to string.
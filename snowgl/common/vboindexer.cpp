@@ -1,99 +1,249 @@
 #include <vector>
-#include <map>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+#include <stdint.h>
+#include <string.h> // for memcmp and memcpy
+#include <math.h>
 
 #include <glm/glm.hpp>
 
 #include "vboindexer.hpp"
 
-#include <string.h> // for memcmp
+// The 8 components of a vertex, either the bits of the floats or their quantised values.
+// Quantised values are 64-bit: a small epsilon on large coordinates overflows 32 bits.
+struct VertexKey{
+	uint64_t components[8];
 
+	bool operator==(const VertexKey & that) const{
+		return memcmp(components, that.components, sizeof(components))==0;
+	}
+};
 
-// Returns true iif v1 can be considered equal to v2
-bool is_near(float v1, float v2){
-	return fabs( v1-v2 ) < 0.01f;
+static VertexKey makeKey(const glm::vec3 & vertex, const glm::vec2 & uv, const glm::vec3 & normal, float inv_epsilon){
+	float values[8] = {vertex.x, vertex.y, vertex.z, uv.x, uv.y, normal.x, normal.y, normal.z};
+	VertexKey key;
+	if ( inv_epsilon == 0.0f ){
+		for ( int k=0; k<8; k++ ){
+			uint32_t bits;
+			memcpy(&bits, &values[k], sizeof(bits));
+			key.components[k] = bits;
+		}
+	}else{
+		// Clamped into the int64 range, the cast is undefined outside of it (NaN goes to the upper bound)
+		const double lowest = -9223372036854775808.0;	// -2^63
+		const double highest = 9223372036854774784.0;	// The largest double below 2^63
+		for ( int k=0; k<8; k++ ){
+			double quantised = floor((double)values[k] * inv_epsilon + 0.5);
+			key.components[k] = (uint64_t)(int64_t)fmax(lowest, fmin(quantised, highest));
+		}
+	}
+	return key;
 }
 
-// Searches through all already-exported vertices
-// for a similar one.
-// Similar = same position + same UVs + same normal
-bool getSimilarVertexIndex( 
-	glm::vec3 & in_vertex, 
-	glm::vec2 & in_uv, 
-	glm::vec3 & in_normal, 
-	std::vector<glm::vec3> & out_vertices,
-	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals,
-	unsigned short & result
+static uint32_t hashKey(const VertexKey & key){
+	uint64_t hash = 0x9E3779B97F4A7C15ull;
+	for ( int k=0; k<8; k++ ){
+		hash ^= key.components[k];	// Both halves, the fold below brings the high one down
+		hash *= 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 32;
+	}
+	return (uint32_t)hash;
+}
+
+// Open-addressing (linear probing) table from keys to unique vertex ids.
+// The keys themselves are stored once, in the order the unique vertices were found.
+class VertexHashTable{
+private:
+	struct Slot{
+		uint32_t id;	// EMPTY if the slot is free
+		uint32_t hash;
+	};
+	static const uint32_t EMPTY = 0xFFFFFFFFu;
+
+	std::vector<Slot> slots;
+	size_t mask;
+
+public:
+	std::vector<VertexKey> keys;
+
+	explicit VertexHashTable(size_t expected){
+		size_t capacity = 16;
+		while ( capacity < expected * 2 ){
+			capacity *= 2;
+		}
+		Slot empty = {EMPTY, 0};
+		slots.assign(capacity, empty);
+		mask = capacity - 1;
+	}
+
+	// Returns the id of the key, adding it as keys.size() if it is new
+	uint32_t findOrInsert(const VertexKey & key, uint32_t hash, bool & inserted){
+		size_t i = hash & mask;
+		for (;;){
+			Slot & slot = slots[i];
+			if ( slot.id == EMPTY ){
+				slot.id = (uint32_t)keys.size();
+				slot.hash = hash;
+				keys.push_back(key);
+				inserted = true;
+
+				// Keep the load factor under 1/2
+				if ( keys.size() * 2 > slots.size() ){
+					grow();
+				}
+				return (uint32_t)keys.size() - 1;
+			}
+			if ( slot.hash == hash && keys[slot.id] == key ){
+				inserted = false;
+				return slot.id;
+			}
+			i = (i + 1) & mask;
+		}
+	}
+
+private:
+	void grow(){
+		std::vector<Slot> old_slots;
+		old_slots.swap(slots);
+		Slot empty = {EMPTY, 0};
+		slots.assign(old_slots.size() * 2, empty);
+		mask = slots.size() - 1;
+
+		for ( size_t k=0; k<old_slots.size(); k++ ){
+			if ( old_slots[k].id != EMPTY ){
+				size_t i = old_slots[k].hash & mask;
+				while ( slots[i].id != EMPTY ){
+					i = (i + 1) & mask;
+				}
+				slots[i] = old_slots[k];
+			}
+		}
+	}
+};
+
+// Deduplicates the input range [begin, end): indices receives the local unique id of every vertex,
+// unique the input vertex of every local unique id (in order of first occurrence).
+static void weldRange(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	float inv_epsilon,
+	size_t begin, size_t end,
+
+	VertexHashTable & table,
+	std::vector<unsigned int> & indices,
+	std::vector<unsigned int> & unique
 ){
-	// Lame linear search
-	for ( unsigned int i=0; i<out_vertices.size(); i++ ){
-		if (
-			is_near( in_vertex.x , out_vertices[i].x ) &&
-			is_near( in_vertex.y , out_vertices[i].y ) &&
-			is_near( in_vertex.z , out_vertices[i].z ) &&
-			is_near( in_uv.x     , out_uvs     [i].x ) &&
-			is_near( in_uv.y     , out_uvs     [i].y ) &&
-			is_near( in_normal.x , out_normals [i].x ) &&
-			is_near( in_normal.y , out_normals [i].y ) &&
-			is_near( in_normal.z , out_normals [i].z )
-		){
-			result = i;
-			return true;
+	for ( size_t i=begin; i<end; i++ ){
+		VertexKey key = makeKey(in_vertices[i], in_uvs[i], in_normals[i], inv_epsilon);
+		bool inserted;
+		uint32_t id = table.findOrInsert(key, hashKey(key), inserted);
+		if ( inserted ){
+			unique.push_back( (unsigned int)i );
 		}
+		indices[i] = id;
 	}
-	// No other vertex could be used instead.
-	// Looks like we'll have to add it to the VBO.
-	return false;
 }
 
-void indexVBO_slow(
+void weldVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
+	float epsilon,
 
-	std::vector<unsigned short> & out_indices,
-	std::vector<glm::vec3> & out_vertices,
-	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
+	std::vector<unsigned int> & out_indices,
+	std::vector<unsigned int> & out_unique
 ){
-	// For each input vertex
-	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+	size_t count = in_vertices.size();
+	float inv_epsilon = (epsilon > 0.0f) ? 1.0f / epsilon : 0.0f;
+
+	out_indices.resize(count);
+	out_unique.clear();
+
+	// Most meshes share every vertex between several triangles, the tables grow if needed
+	size_t threads = VBO_INDEXER_THREADS > 0 ? VBO_INDEXER_THREADS : std::thread::hardware_concurrency();
+	if ( count < VBO_PARALLEL_MIN_VERTICES || threads < 2 ){
+		VertexHashTable table(count / 4);
+		weldRange(in_vertices, in_uvs, in_normals, inv_epsilon, 0, count, table, out_indices, out_unique);
+		return;
+	}
+	threads = std::min(threads, count / (VBO_PARALLEL_MIN_VERTICES / 4));
+
+	// 1. Every thread deduplicates a contiguous range on its own
+	std::vector<VertexHashTable> tables;
+	std::vector<std::vector<unsigned int> > uniques(threads);
+	size_t range = (count + threads - 1) / threads;
+	for ( size_t t=0; t<threads; t++ ){
+		tables.push_back(VertexHashTable(range / 4));
+	}
+
+	std::vector<std::thread> workers;
+	for ( size_t t=0; t<threads; t++ ){
+		size_t begin = std::min(count, t * range), end = std::min(count, begin + range);
+		workers.push_back(std::thread(weldRange, std::ref(in_vertices), std::ref(in_uvs), std::ref(in_normals),
+			inv_epsilon, begin, end, std::ref(tables[t]), std::ref(out_indices), std::ref(uniques[t])));
+	}
+	for ( size_t t=0; t<threads; t++ ){
+		workers[t].join();
+	}
+
+	// 2. Merge the local unique vertices in range order, so the unique vertices keep the order of
+	// their first occurrence in the whole input, exactly as a single thread would number them
+	size_t local_total = 0;
+	for ( size_t t=0; t<threads; t++ ){
+		local_total += uniques[t].size();
+	}
+	VertexHashTable merged(local_total);
+	std::vector<std::vector<unsigned int> > remap(threads);
 
-		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
-
-		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
-		}else{ // If not, it needs to be added in the output data.
-			out_vertices.push_back( in_vertices[i]);
-			out_uvs     .push_back( in_uvs[i]);
-			out_normals .push_back( in_normals[i]);
-			out_indices .push_back( (unsigned short)out_vertices.size() - 1 );
+	for ( size_t t=0; t<threads; t++ ){
+		remap[t].resize(uniques[t].size());
+		for ( size_t k=0; k<uniques[t].size(); k++ ){
+			const VertexKey & key = tables[t].keys[k];
+			bool inserted;
+			remap[t][k] = merged.findOrInsert(key, hashKey(key), inserted);
+			if ( inserted ){
+				out_unique.push_back( uniques[t][k] );
+			}
 		}
+		tables[t] = VertexHashTable(0);
+	}
+
+	// 3. Translate the local ids into global ones
+	workers.clear();
+	for ( size_t t=0; t<threads; t++ ){
+		size_t begin = std::min(count, t * range), end = std::min(count, begin + range);
+		workers.push_back(std::thread([&out_indices, &remap, t, begin, end](){
+			for ( size_t i=begin; i<end; i++ ){
+				out_indices[i] = remap[t][ out_indices[i] ];
+			}
+		}));
+	}
+	for ( size_t t=0; t<threads; t++ ){
+		workers[t].join();
 	}
 }
 
-struct PackedVertex{
-	glm::vec3 position;
-	glm::vec2 uv;
-	glm::vec3 normal;
-	bool operator<(const PackedVertex that) const{
-		return memcmp((void*)this, (void*)&that, sizeof(PackedVertex))>0;
-	};
-};
+void indexVBO_slow(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
 
-bool getSimilarVertexIndex_fast( 
-	PackedVertex & packed, 
-	std::map<PackedVertex,unsigned short> & VertexToOutIndex,
-	unsigned short & result
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
 ){
-	std::map<PackedVertex,unsigned short>::iterator it = VertexToOutIndex.find(packed);
-	if ( it == VertexToOutIndex.end() ){
-		return false;
-	}else{
-		result = it->second;
-		return true;
+	// Similar = same position + same UVs + same normal, up to VBO_WELD_EPSILON
+	std::vector<unsigned int> unique;
+	weldVBO(in_vertices, in_uvs, in_normals, VBO_WELD_EPSILON, out_indices, unique);
+
+	for ( unsigned int k=0; k<unique.size(); k++ ){
+		out_vertices.push_back( in_vertices[unique[k]]);
+		out_uvs     .push_back( in_uvs[unique[k]]);
+		out_normals .push_back( in_normals[unique[k]]);
 	}
 }
 
@@ -102,41 +252,98 @@ void indexVBO(
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<unsigned int> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 ){
-	std::map<PackedVertex,unsigned short> VertexToOutIndex;
+	std::vector<unsigned int> unique;
+	weldVBO(in_vertices, in_uvs, in_normals, 0.0f, out_indices, unique);
 
-	// For each input vertex
-	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+	for ( unsigned int k=0; k<unique.size(); k++ ){
+		out_vertices.push_back( in_vertices[unique[k]]);
+		out_uvs     .push_back( in_uvs[unique[k]]);
+		out_normals .push_back( in_normals[unique[k]]);
+	}
+}
 
-		PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
-		
-
-		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex_fast( packed, VertexToOutIndex, index);
-
-		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
-		}else{ // If not, it needs to be added in the output data.
-			out_vertices.push_back( in_vertices[i]);
-			out_uvs     .push_back( in_uvs[i]);
-			out_normals .push_back( in_normals[i]);
-			unsigned short newindex = (unsigned short)out_vertices.size() - 1;
-			out_indices .push_back( newindex );
-			VertexToOutIndex[ packed ] = newindex;
-		}
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<PackedVertex> & out_vertices
+){
+	std::vector<unsigned int> unique;
+	weldVBO(in_vertices, in_uvs, in_normals, 0.0f, out_indices, unique);
+
+	out_vertices.resize(unique.size());
+	for ( unsigned int k=0; k<unique.size(); k++ ){
+		PackedVertex packed = {in_vertices[unique[k]], in_uvs[unique[k]], in_normals[unique[k]]};
+		out_vertices[k] = packed;
 	}
 }
 
+void splitVBO16(
+	std::vector<unsigned int> & in_indices,
+	std::vector<PackedVertex> & in_vertices,
 
+	std::vector<unsigned short> & out_indices,
+	std::vector<PackedVertex> & out_vertices,
+	std::vector<IndexChunk> & out_chunks,
+	std::vector<unsigned int> * out_sourceVertices
+){
+	// Index of every input vertex in the current chunk, or -1 if it is not part of it yet
+	std::vector<int> chunkIndex(in_vertices.size(), -1);
+	std::vector<unsigned int> chunkVertices;
+
+	IndexChunk chunk = {0, 0, 0, 0};
 
+	for ( unsigned int i=0; i+2<in_indices.size(); i+=3 ){
 
+		// Vertices of the triangle that are not in the chunk yet
+		unsigned int added = 0;
+		for ( int k=0; k<3; k++ ){
+			if ( chunkIndex[ in_indices[i+k] ] < 0 ){
+				added++;
+			}
+		}
 
+		// Close the chunk if the triangle does not fit anymore
+		if ( chunkVertices.size() + added > MAX_VERTICES_16BIT ){
+			chunk.vertexCount = chunkVertices.size();
+			out_chunks.push_back(chunk);
+			for ( unsigned int k=0; k<chunkVertices.size(); k++ ){
+				chunkIndex[ chunkVertices[k] ] = -1;
+			}
+			chunkVertices.clear();
 
+			chunk.firstIndex = out_indices.size();
+			chunk.indexCount = 0;
+			chunk.baseVertex = out_vertices.size();
+		}
+
+		for ( int k=0; k<3; k++ ){
+			unsigned int vertex = in_indices[i+k];
+			if ( chunkIndex[vertex] < 0 ){
+				chunkIndex[vertex] = chunkVertices.size();
+				chunkVertices.push_back(vertex);
+				out_vertices.push_back(in_vertices[vertex]);
+				if ( out_sourceVertices != NULL ){
+					out_sourceVertices->push_back(vertex);
+				}
+			}
+			out_indices.push_back( (unsigned short)chunkIndex[vertex] );
+		}
+		chunk.indexCount += 3;
+	}
+
+	if ( chunk.indexCount > 0 ){
+		chunk.vertexCount = chunkVertices.size();
+		out_chunks.push_back(chunk);
+	}
+}
 
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
@@ -145,33 +352,28 @@ void indexVBO_TBN(
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<unsigned int> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
 	std::vector<glm::vec3> & out_tangents,
 	std::vector<glm::vec3> & out_bitangents
 ){
-	// For each input vertex
-	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+	std::vector<unsigned int> unique;
+	weldVBO(in_vertices, in_uvs, in_normals, VBO_WELD_EPSILON, out_indices, unique);
 
-		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
-
-		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
-
-			// Average the tangents and the bitangents
-			out_tangents[index] += in_tangents[i];
-			out_bitangents[index] += in_bitangents[i];
-		}else{ // If not, it needs to be added in the output data.
-			out_vertices.push_back( in_vertices[i]);
-			out_uvs     .push_back( in_uvs[i]);
-			out_normals .push_back( in_normals[i]);
-			out_tangents .push_back( in_tangents[i]);
-			out_bitangents .push_back( in_bitangents[i]);
-			out_indices .push_back( (unsigned short)out_vertices.size() - 1 );
-		}
+	size_t first = out_vertices.size();
+	for ( unsigned int k=0; k<unique.size(); k++ ){
+		out_vertices.push_back( in_vertices[unique[k]]);
+		out_uvs     .push_back( in_uvs[unique[k]]);
+		out_normals .push_back( in_normals[unique[k]]);
+		out_tangents .push_back( glm::vec3(0.0f));
+		out_bitangents .push_back( glm::vec3(0.0f));
+	}
+
+	// Average the tangents and the bitangents of the merged vertices
+	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+		out_tangents[first + out_indices[i]] += in_tangents[i];
+		out_bitangents[first + out_indices[i]] += in_bitangents[i];
 	}
 }
@@ -1,17 +1,91 @@
 #ifndef VBOINDEXER_HPP
 #define VBOINDEXER_HPP
 
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Interleaved vertex, the layout of the shading vertex buffer (see common/scene.hpp)
+struct PackedVertex{
+	glm::vec3 position;
+	glm::vec2 uv;
+	glm::vec3 normal;
+};
+
+// A range of triangles whose vertices fit 16-bit indices, drawn with baseVertex added to every index
+struct IndexChunk{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	unsigned int baseVertex;
+	unsigned int vertexCount;
+};
+
+// Number of vertices 16-bit indices can address
+#define MAX_VERTICES_16BIT 65536
+
+// Tolerance of indexVBO_slow and indexVBO_TBN: vertices whose components are this close are merged
+#define VBO_WELD_EPSILON 0.01f
+
+// Inputs smaller than this are deduplicated on the calling thread only
+#define VBO_PARALLEL_MIN_VERTICES 65536
+
+// Number of threads deduplicating large inputs, 0 for one per hardware thread
+#ifndef VBO_INDEXER_THREADS
+#define VBO_INDEXER_THREADS 0
+#endif
+
+// Finds the unique vertices with an open-addressing hash table.
+// With epsilon == 0, vertices are merged if they are bit-identical. Otherwise every component is
+// quantised to a grid of epsilon, which approximates the |a - b| < epsilon test of the former linear
+// search: values closer than epsilon are merged unless a grid line falls between them.
+// out_indices[i] is the unique vertex of input vertex i, out_unique[k] is the input vertex the unique
+// vertex k was first seen at. Large inputs are split across threads, the result is the same as serial.
+void weldVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	float epsilon,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<unsigned int> & out_unique
+);
+
 void indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<unsigned int> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 );
 
+// Same as above, but the unique vertices are written interleaved
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<PackedVertex> & out_vertices
+);
+
+
+// Splits an indexed mesh into chunks of at most MAX_VERTICES_16BIT vertices. The vertices of every chunk
+// are contiguous in out_vertices (vertices shared by several chunks are duplicated) and out_indices are
+// relative to the baseVertex of their chunk. out_sourceVertices, if given, receives the input vertex of
+// every output vertex, to split per-vertex data kept outside PackedVertex the same way.
+void splitVBO16(
+	std::vector<unsigned int> & in_indices,
+	std::vector<PackedVertex> & in_vertices,
+
+	std::vector<unsigned short> & out_indices,
+	std::vector<PackedVertex> & out_vertices,
+	std::vector<IndexChunk> & out_chunks,
+	std::vector<unsigned int> * out_sourceVertices = NULL
+);
+
 
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
@@ -20,7 +94,7 @@ void indexVBO_TBN(
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<unsigned int> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
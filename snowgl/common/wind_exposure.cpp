@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <math.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "wind_exposure.hpp"
+#include "shader.hpp"
+
+// Distance a surface point can lie below the depth of a direction map and still count as seen, in scene units
+#define WIND_EXPOSURE_BIAS  0.3f
+
+glm::vec3 windSnowfallDirection(float windSpeed, float windDirection, float fallSpeed) {
+
+	// The snow drifts with the wind while it falls, it comes from up and upwind
+	float azimuth = glm::radians(windDirection);
+	glm::vec3 direction(sinf(azimuth) * windSpeed, cosf(azimuth) * windSpeed, fallSpeed);
+	return glm::normalize(direction);
+}
+
+void WindExposureMap::create(int mapResolution, int mapDepthResolution, int mapDirectionCount, float mapConeAngle, float mapTolerance) {
+	resolution = mapResolution;
+	depthResolution = mapDepthResolution;
+	directionCount = mapDirectionCount > 0 ? mapDirectionCount : 1;
+	coneAngle = glm::radians(mapConeAngle);
+	tolerance = glm::radians(mapTolerance);
+
+	glGenTextures(2, textures);
+	glGenFramebuffers(2, framebuffers);
+	GLfloat untested[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	for (int i = 0; i < 2; i++) {
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, resolution, resolution, 0, GL_RG, GL_FLOAT, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textures[i], 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "The wind exposure framebuffer is incomplete.\n");
+		}
+		glClearBufferfv(GL_COLOR, 0, untested);
+	}
+
+	// Depth map of one direction, compared like the occlusion map
+	glGenTextures(1, &depthTexture);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT16, depthResolution, depthResolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+
+	glGenFramebuffers(1, &depthFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, depthFramebuffer);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "The wind depth framebuffer is incomplete.\n");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	program = LoadShaders("shaders/FullScreenTriangle.vert", "shaders/WindExposure.frag");
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "occlusionMap"), 0);
+	glUniform1i(glGetUniformLocation(program, "directionMap"), 1);
+	occlusionToDirectionLocation = glGetUniformLocation(program, "occlusionToDirection");
+
+	// The occlusion map texture compares depths, the top surface is rebuilt from the depths themselves
+	glGenSamplers(1, &occlusionSampler);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(occlusionSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// The full-screen triangle is generated from gl_VertexID, but a VAO must be bound to draw
+	glGenVertexArrays(1, &vertexArray);
+}
+
+glm::vec3 WindExposureMap::coneDirection(int index) const {
+
+	// Directions evenly spread over the cap of the cone (equal solid angles, Vogel's spiral)
+	const float goldenAngle = 2.39996323f;
+	float cosTheta = 1.0f - (1.0f - cosf(coneAngle)) * (index + 0.5f) / directionCount;
+	float sinTheta = sqrtf(fmaxf(0.0f, 1.0f - cosTheta * cosTheta));
+	float phi = index * goldenAngle;
+
+	glm::vec3 axis = key.direction;
+	glm::vec3 tangent = glm::normalize(glm::cross(fabsf(axis.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0), axis));
+	glm::vec3 bitangent = glm::cross(axis, tangent);
+	return glm::normalize(axis * cosTheta + (tangent * cosf(phi) + bitangent * sinf(phi)) * sinTheta);
+}
+
+void WindExposureMap::update(const OcclusionMapKey & occlusion, GLuint occlusionMap, const glm::mat4 & occlusionMVP, int maxDirections,
+	const std::function<void(const glm::mat4 & depthMVP)> & renderDepth) {
+
+	// A small change of the snowfall direction keeps the current map, so a slowly veering wind doesn't restart it every frame
+	bool sameDirection = started && glm::dot(occlusion.direction, key.direction) >= cosf(tolerance);
+	if (!started || occlusion.geometryVersion != key.geometryVersion || occlusion.boundsMin != key.boundsMin
+		|| occlusion.boundsMax != key.boundsMax || !sameDirection) {
+
+		if (started) {
+			restarts++;
+		}
+		key = occlusion;
+		started = true;
+		nextDirection = 0;
+
+		GLfloat untested[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[building]);
+		glClearBufferfv(GL_COLOR, 0, untested);
+	}
+	if (nextDirection >= directionCount || maxDirections <= 0) {
+		return;
+	}
+
+	GLint previousVertexArray;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+
+	glm::mat4 biasMatrix(
+		0.5, 0.0, 0.0, 0.0,
+		0.0, 0.5, 0.0, 0.0,
+		0.0, 0.0, 0.5, 0.0,
+		0.5, 0.5, 0.5, 1.0
+	);
+
+	// Every direction sees the sphere around the occlusion box
+	glm::mat4 occlusionToWorld = glm::inverse(biasMatrix * occlusionMVP);
+	glm::vec3 center = glm::vec3(glm::inverse(occlusionMVP) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	float radius = 0.5f * glm::length(key.boundsMax - key.boundsMin);
+	glm::mat4 directionProjection = glm::ortho<float>(-radius, radius, -radius, radius, -radius, radius);
+	glm::mat4 depthBias = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -WIND_EXPOSURE_BIAS / (2.0f * radius)));
+
+	for (int rendered = 0; rendered < maxDirections && nextDirection < directionCount; rendered++, nextDirection++) {
+		glm::vec3 direction = coneDirection(nextDirection);
+		glm::vec3 up = (fabsf(direction.y) < 0.99f) ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+		glm::mat4 directionMVP = directionProjection * glm::lookAt(center + direction, center, up);
+
+		// Depth of the scene seen from this direction
+		glBindFramebuffer(GL_FRAMEBUFFER, depthFramebuffer);
+		glViewport(0, 0, depthResolution, depthResolution);
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_BACK);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		renderDepth(directionMVP);
+
+		// The top surface points this direction sees are added to the map
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[building]);
+		glViewport(0, 0, resolution, resolution);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_CULL_FACE);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glUseProgram(program);
+		glBindVertexArray(vertexArray);
+		glm::mat4 occlusionToDirection = depthBias * biasMatrix * directionMVP * occlusionToWorld;
+		glUniformMatrix4fv(occlusionToDirectionLocation, 1, GL_FALSE, &occlusionToDirection[0][0]);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, occlusionMap);
+		glBindSampler(0, occlusionSampler);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindSampler(0, 0);
+		glDisable(GL_BLEND);
+
+		passes++;
+	}
+
+	// A complete map replaces the previous one, the next restart accumulates into the other texture
+	if (nextDirection == directionCount) {
+		hasComplete = true;
+		building = 1 - building;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindVertexArray(previousVertexArray);
+	if (depthTest) {
+		glEnable(GL_DEPTH_TEST);
+	}
+	if (cullFace) {
+		glEnable(GL_CULL_FACE);
+	}
+}
+
+void WindExposureMap::printStatistics() const {
+	printf("Wind exposure: %u depth passes, accumulated again %u times\n", passes, restarts);
+}
+
+void WindExposureMap::release() {
+	glDeleteTextures(2, textures);
+	glDeleteFramebuffers(2, framebuffers);
+	glDeleteTextures(1, &depthTexture);
+	glDeleteFramebuffers(1, &depthFramebuffer);
+	glDeleteProgram(program);
+	glDeleteVertexArrays(1, &vertexArray);
+	glDeleteSamplers(1, &occlusionSampler);
+	textures[0] = textures[1] = 0;
+	framebuffers[0] = framebuffers[1] = 0;
+	depthTexture = depthFramebuffer = program = vertexArray = occlusionSampler = 0;
+}
@@ -0,0 +1,110 @@
+#ifndef WIND_EXPOSURE_HPP
+#define WIND_EXPOSURE_HPP
+
+#include <functional>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "occlusion_cache.hpp"
+
+/**
+ * @brief The direction the snow falls from, tilted against the wind.
+ * @param windSpeed The wind speed, in m/s.
+ * @param windDirection The direction the wind blows from, in degrees clockwise from north (+y), east is +x.
+ * @param fallSpeed The speed of the snow falling in still air, in m/s.
+ * @return glm::vec3 The normalized direction towards the snowfall, (0, 0, 1) without wind.
+ */
+
+glm::vec3 windSnowfallDirection(float windSpeed, float windDirection, float fallSpeed);
+
+/**
+ * @brief The fraction of the snowfall reaching the top surface of the scene, for snow falling from a cone of directions.
+ *
+ * The occlusion map only sees the scene from one direction, so the exposure it gives is all or nothing.
+ * Here the scene is rendered into a depth map from each direction of a cone around the snowfall direction.
+ * Every map is tested against the top surface of the occlusion map: the points it sees are added to
+ * the exposure map, which covers the same box and uses the same coordinates (DepthBiasMVP). The result
+ * is a soft exposure with penumbrae, shifted downwind.
+ *
+ * The directions are spread over several frames (a few depth passes per frame). The last complete map is
+ * used until a new one is complete, and a complete map is used until the geometry, the occlusion box or
+ * the snowfall direction changes. The first map is used while it is accumulated.
+ *
+ * The map holds (exposed directions, tested directions) in an RG texture, the shader divides them.
+ */
+
+class WindExposureMap {
+private:
+	int resolution = 0;
+	int depthResolution = 0;
+	int directionCount = 0;
+	float coneAngle = 0.0f;					// Half-angle of the cone, in radians
+	float tolerance = 0.0f;					// Angle the snowfall direction can move without restarting, in radians
+
+	GLuint textures[2] = {0, 0};
+	GLuint framebuffers[2] = {0, 0};
+	int building = 0;						// Texture the directions are added to
+	bool hasComplete = false;				// The other texture holds a complete map
+
+	GLuint depthTexture = 0;				// Depth map of the current direction
+	GLuint depthFramebuffer = 0;
+
+	GLuint program = 0;
+	GLuint vertexArray = 0;
+	GLuint occlusionSampler = 0;			// Reads the occlusion map as plain depth values
+	GLint occlusionToDirectionLocation = -1;
+
+	OcclusionMapKey key;					// What the building map is accumulated for, direction included
+	bool started = false;
+	int nextDirection = 0;
+
+	unsigned int passes = 0;
+	unsigned int restarts = 0;
+
+	glm::vec3 coneDirection(int index) const;
+
+public:
+
+	/**
+	 * @brief Creates the textures, framebuffers and accumulation program.
+	 * @param resolution The width and height of the exposure map in texels.
+	 * @param depthResolution The width and height of the depth map of each direction.
+	 * @param directionCount Directions of the cone accumulated into a complete map.
+	 * @param coneAngle Half-angle of the cone, in degrees.
+	 * @param tolerance Degrees the snowfall direction can move before the map is accumulated again.
+	 */
+
+	void create(int resolution, int depthResolution, int directionCount, float coneAngle, float tolerance);
+
+	/**
+	 * @brief Renders the next directions of the cone, if the map is not complete.
+	 *
+	 * Changes the framebuffer, viewport, program, and the texture units 0 and 1 bindings.
+	 *
+	 * @param occlusion The inputs of the occlusion map. The direction is the axis of the cone (see windSnowfallDirection).
+	 * @param occlusionMap The depth texture of the occlusion map, rendered from straight above with occlusion.boundsMin/boundsMax.
+	 * @param occlusionMVP The matrix the occlusion map was rendered with.
+	 * @param maxDirections Directions to render at most during this call.
+	 * @param renderDepth Draws the depth pass of the scene with a given depthMVP, into the bound framebuffer.
+	 */
+
+	void update(const OcclusionMapKey & occlusion, GLuint occlusionMap, const glm::mat4 & occlusionMVP, int maxDirections,
+		const std::function<void(const glm::mat4 & depthMVP)> & renderDepth);
+
+	/**
+	 * @brief The exposure map to sample with the occlusion map coordinates: exposed / tested directions, 1 where nothing was tested yet.
+	 */
+
+	GLuint texture() const { return textures[hasComplete ? 1 - building : building]; }
+
+	/**
+	 * @brief Prints the number of depth passes and how many times the accumulation restarted.
+	 */
+
+	void printStatistics() const;
+
+	void release();
+};
+
+#endif // WIND_EXPOSURE_HPP
@@ -29,6 +29,11 @@ sky_color_night    = np.array([0.10, 0.05, 0.10])
 times_segments = np.array([ 0,  1,  2,  3,   4,   5,   6,   7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23]) * 60
 temps_segments = np.array([-7, -8, -8, -9, -11, -12, -13, -10, -9, -5, -1,  2,  4,  6,  9,  7,  6,  4,  1, -1, -3, -4, -5, -6])
 
+# Wind speed (m/s) segments in a day, and the direction it blows from (degrees clockwise from north) at midnight and at the end of the day
+winds_segments = np.array([0.5, 0.5, 0.4, 0.4, 0.3, 0.3, 0.5, 0.8, 1.0, 1.2, 1.5, 1.8, 2.0, 2.2, 2.0, 1.8, 1.5, 1.2, 1.0, 0.8, 0.7, 0.6, 0.6, 0.5])
+wind_direction_start = 225.0
+wind_direction_end = 270.0
+
 # Location
 latitude = -35.0
 azimuth = 0
@@ -284,6 +289,10 @@ minute_temperatures = cs(minute_times)
 # Calculate snow amounts based on temperature values
 snow_amounts = np.vectorize(snow_amount)(minute_temperatures)
 
+# The wind strengthens in the afternoon and slowly veers through the day
+wind_speeds = np.interp(minute_times, times_segments, winds_segments)
+wind_directions = np.interp(minute_times, [0, 1440], [wind_direction_start, wind_direction_end])
+
 # Calculate solar elevation angle and the corresponding light directions
 sun_elevations = [solar_elevation(latitude, declination, minute) for minute in minute_times]
 light_directions = [solar_to_light_direction(elevation, azimuth) for elevation in sun_elevations]
@@ -329,7 +338,10 @@ data = pd.DataFrame({
 
     'SunColorR': sun_color_r,
     'SunColorG': sun_color_g,
-    'SunColorB': sun_color_b
+    'SunColorB': sun_color_b,
+
+    'WindSpeed': wind_speeds,
+    'WindDirection': wind_directions
 })
 
 # Round values
@@ -352,6 +364,9 @@ data['SunColorR'] = data['SunColorR'].round(2)
 data['SunColorG'] = data['SunColorG'].round(2)
 data['SunColorB'] = data['SunColorB'].round(2)
 
+data['WindSpeed']     = data['WindSpeed'].round(2)
+data['WindDirection'] = data['WindDirection'].round(2)
+
 # Output format
 data['Time']            = data['Minute'].apply(minutes_to_time)
 data['Temperature']     = data['Temperature'].apply(lambda x: f"{x:.2f}")
@@ -372,6 +387,9 @@ data['SunColorR'] = data['SunColorR'].apply(lambda x: f"{x:.2f}")
 data['SunColorG'] = data['SunColorG'].apply(lambda x: f"{x:.2f}")
 data['SunColorB'] = data['SunColorB'].apply(lambda x: f"{x:.2f}")
 
+data['WindSpeed']     = data['WindSpeed'].apply(lambda x: f"{x:.2f}")
+data['WindDirection'] = data['WindDirection'].apply(lambda x: f"{x:.2f}")
+
 # Save to CSV for OpenGL C++ renderer
 data = data[[
     'Time', 
@@ -392,7 +410,10 @@ data = data[[
 
     'SunColorR',
     'SunColorG',
-    'SunColorB'
+    'SunColorB',
+
+    'WindSpeed',
+    'WindDirection'
 ]]
 
 data.to_csv('data.csv', index=False)
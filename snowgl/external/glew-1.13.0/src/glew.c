@@ -13111,6 +13111,8 @@ GLenum glxewInit (GLXEW_CONTEXT_ARG_DEF_LIST)
   GLXEW_VERSION_1_2 = GL_TRUE;
   GLXEW_VERSION_1_3 = GL_TRUE;
   GLXEW_VERSION_1_4 = GL_TRUE;
+  /* no current GLX display, e.g. a headless EGL context: nothing else to load */
+  if (glXGetCurrentDisplay() == NULL) return GLEW_OK;
   /* query GLX version */
   glXQueryVersion(glXGetCurrentDisplay(), &major, &minor);
   if (major == 1 && minor <= 3)
@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
 #include <vector>
+#include <memory>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -11,13 +14,31 @@ GLFWwindow* window;
 using namespace glm;
 
 #include <common/shader.hpp>
+#include <common/program_cache.hpp>
 #include <common/texture.hpp>
 #include <common/controls.hpp>
 #include <common/objloader.hpp>
 #include <common/vboindexer.hpp>
+#include <common/mesh_cache.hpp>
+#include <common/scene_importer.hpp>
+#include <common/scene.hpp>
+#include <common/simplify.hpp>
+#include <common/exposure_bake.hpp>
+#include <common/culling.hpp>
+#include <common/snow_depth.hpp>
+#include <common/wind_exposure.hpp>
 #include <common/global.hpp>
 #include <common/csv_reader.hpp>
+#include <common/environment_table.hpp>
 #include <common/util.hpp>
+#include <common/headless.hpp>
+#include <common/readback.hpp>
+#include <common/output_pipeline.hpp>
+#include <common/text2D.hpp>
+#include <common/occlusion_cache.hpp>
+#include <common/environment.hpp>
+#include <common/clustered_lights.hpp>
+#include <common/sun_shadow.hpp>
 
 #ifdef USE_OPENCV
 #include <opencv2/opencv.hpp>
@@ -49,17 +70,35 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
     }
 }
 
-int main(void){
+int main(int argc, char ** argv){
 
-	// Read generated data file from day_time_simulator.py
-	csv_reader reader("data/data.csv");
-    if(!reader.read_csv()){
-		fprintf(stderr, "Failed to read data file.\n" );
-		getchar();
-		return -1;
+	// Headless mode renders every row of the data file into an offscreen framebuffer,
+	// without any window or OpenCV GUI, and writes the frames to disk.
+	bool headless = HEADLESS_RENDERING;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+		}
 	}
 
-    auto daytime_data = reader.getData();
+	// Read generated data file from day_time_simulator.py, or its binary columns if they are up to date
+	csv_reader reader(DATA_LOCATION);
+	EnvironmentTable environmentTable;
+	std::string environmentTablePath = std::string(DATA_LOCATION) + ENVIRONMENT_TABLE_EXTENSION;
+	EnvironmentColumns daytime_data;
+	if(USE_ENVIRONMENT_TABLE && environmentTable.open(environmentTablePath.c_str(), DATA_LOCATION)){
+		daytime_data = environmentTable.getData();
+	}else{
+		if(!reader.read_csv()){
+			fprintf(stderr, "Failed to read data file.\n" );
+			getchar();
+			return -1;
+		}
+		daytime_data = reader.getData();
+		if(USE_ENVIRONMENT_TABLE){
+			writeEnvironmentTable(environmentTablePath.c_str(), DATA_LOCATION, daytime_data);
+		}
+	}
 	daytime_size = daytime_data.size();
 
 	if(daytime_size <= 0){
@@ -68,55 +107,90 @@ int main(void){
 		return -1;
 	}
 
-	// Setup VideoWriter
+    int windowWidth = WINDOW_WIDTH;
+    int windowHeight = WINDOW_HEIGHT;
+
+	if(headless){
+		if(!createHeadlessContext()){
+			fprintf(stderr, "Failed to create headless OpenGL context.\n" );
+			return -1;
+		}
+	}
+
+	else{
+		if(!glfwInit()){
+			fprintf(stderr, "Failed to initialize GLFW.\n" );
+			getchar();
+			return -1;
+		}
+		
+		glfwWindowHint(GLFW_SAMPLES, MSAA_SAMPLES);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_DECORATED, WINDOW_BORDER);		// borderless window
+
+		window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, GL_WINDOW_NAME, NULL, NULL);
+		if(window == NULL ){
+			fprintf( stderr, "Failed to open GLFW window.\n" );
+			getchar();
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+		glfwSetWindowPos(window, 0, 0);
+		glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
+	}
+
+	// Setup VideoWriter, at the size of the framebuffer (larger than the window on HiDPI screens)
 	#ifdef USE_OPENCV
-    cv::VideoWriter video(OUTPUT_VIDEO_FILENAME, cv::VideoWriter::fourcc('W','M','V','2'), OUTPUT_VIDEO_FPS, cv::Size(WINDOW_WIDTH, WINDOW_HEIGHT));
-    if (!video.isOpened()) {
+    std::unique_ptr<VideoSink> video(new VideoSink(OUTPUT_VIDEO_FILENAME, OUTPUT_VIDEO_FPS, windowWidth, windowHeight));
+    if (!video->isOpened()) {
         std::cerr << "Error: Could not open the video file for output\n";
-		getchar();
+		if(headless){
+			destroyHeadlessContext();
+		}else{
+			getchar();
+			glfwTerminate();
+		}
         return -1;
     }
 	#endif
-    
-	if(!glfwInit()){
-		fprintf(stderr, "Failed to initialize GLFW.\n" );
-		getchar();
-		return -1;
-	}
-	
-	glfwWindowHint(GLFW_SAMPLES, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_DECORATED, WINDOW_BORDER);		// borderless window
-
-	window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, GL_WINDOW_NAME, NULL, NULL);
-	if(window == NULL ){
-		fprintf( stderr, "Failed to open GLFW window.\n" );
-		getchar();
-		glfwTerminate();
-		return -1;
-	}
-	glfwMakeContextCurrent(window);
-	glfwSetWindowPos(window, 0, 0);
-    
-    int windowWidth = WINDOW_WIDTH;
-    int windowHeight = WINDOW_HEIGHT;
-    glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
 
 	glewExperimental = true;
 	if (glewInit() != GLEW_OK) {
 		fprintf(stderr, "Failed to initialize GLEW.\n");
-		getchar();
-		glfwTerminate();
+		if(!headless){
+			getchar();
+			glfwTerminate();
+		}
 		return -1;
 	}
 
-	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwPollEvents();
-    glfwSetCursorPos(window, WINDOW_WIDTH/2, WINDOW_HEIGHT/2);
+	// The programs linked by the previous launches are loaded instead of compiled
+	ProgramCache programCache;
+	if(USE_PROGRAM_CACHE && programCache.open(PROGRAM_CACHE_DIRECTORY)){
+		setProgramCache(&programCache);
+	}
+
+	// In headless mode the scene is rendered into this framebuffer instead of the window.
+	OffscreenTarget offscreen;
+	GLuint screenFramebuffer = 0;
+	if(headless){
+		if(!createOffscreenTarget(offscreen, windowWidth, windowHeight, MSAA_SAMPLES)){
+			destroyHeadlessContext();
+			return -1;
+		}
+		screenFramebuffer = offscreen.framebuffer;
+	}
+
+	else{
+		glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		glfwPollEvents();
+		glfwSetCursorPos(window, WINDOW_WIDTH/2, WINDOW_HEIGHT/2);
+	}
 
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS); 
@@ -126,43 +200,159 @@ int main(void){
 	glGenVertexArrays(1, &VertexArrayID);
 	glBindVertexArray(VertexArrayID);
 
-	GLuint depthProgramID = LoadShaders( "shaders/DepthRTT.vert", "shaders/DepthRTT.frag" );
-	GLuint depthMatrixID = glGetUniformLocation(depthProgramID, "depthMVP");
+	ShaderProgram depthProgram;
+	depthProgram.load( "shaders/DepthRTT.vert", "shaders/DepthRTT.frag" );
 
-	// Load model and texture
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals;
+	// Load model and texture. The indexed model comes from its binary cache when it is up to date,
+	// otherwise the OBJ file is parsed and indexed, and the cache is written for the next run.
+	// With the scene importer, every mesh of the file is placed by the nodes that reference it.
+	// Streamed textures start with their coarsest levels, the finer ones come with the instances drawn larger.
+	std::unique_ptr<TextureStreamer> textureStreamer;
+	if(TEXTURE_STREAMING){
+		textureStreamer.reset(new TextureStreamer((size_t)TEXTURE_BUDGET_MB << 20, (size_t)TEXTURE_UPLOAD_KB << 10, TEXTURE_STREAM_TAIL, TEXTURE_STREAM_LOADS));
+	}
+	GLuint Texture = textureStreamer ? textureStreamer->add(TEXTURE_LOCATION) : loadTexture(TEXTURE_LOCATION);
+
+	// The box the occlusion map covers, the exposure bake reproduces its taps
+	const glm::vec3 occlusionBoundsMin(-0.5f * OCCLUSION_BOX_SIZE);
+	const glm::vec3 occlusionBoundsMax(0.5f * OCCLUSION_BOX_SIZE);
+
+	Scene scene(SPLIT_LARGE_MESHES);
+	std::vector<SceneNodeInstance> modelInstances;
+	std::vector<unsigned int> modelMaterials;
+	std::vector<GLuint> sceneTextures;
+	double loadStart = getTimeInSeconds();
+
+	ImportedScene imported;
+	if(USE_SCENE_IMPORTER && importScene(MODEL_LOCATION, imported)){
+		for(size_t i = 0; i < imported.meshes.size(); i++){
+			const SceneMesh & mesh = imported.meshes[i];
+			std::vector<unsigned int> lodIndices;
+			std::vector<MeshLod> lods;
+			buildMeshLods(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), LOD_LEVELS, LOD_REDUCTION, LOD_MAX_ERROR, lodIndices, lods);
+			scene.addMesh(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), lodIndices.data(), lods.data(), lods.size());
+		}
 
-	bool res = loadOBJ(MODEL_LOCATION, vertices, uvs, normals);
-	GLuint Texture = loadBMP_custom(TEXTURE_LOCATION);
+		// Materials without a texture of their own use the default one
+		for(size_t i = 0; i < imported.materials.size(); i++){
+			GLuint texture = 0;
+			if(!imported.materials[i].diffuseTexture.empty()){
+				const char * path = imported.materials[i].diffuseTexture.c_str();
+				texture = textureStreamer ? textureStreamer->add(path) : loadTexture(path);
+			}
+			if(texture != 0){
+				sceneTextures.push_back(texture);
+			}
+			scene.addMaterial(texture != 0 ? texture : Texture);
+		}
 
-	std::vector<unsigned short> indices;
-	std::vector<glm::vec3> indexed_vertices;
-	std::vector<glm::vec2> indexed_uvs;
-	std::vector<glm::vec3> indexed_normals;
-	indexVBO(vertices, uvs, normals, indices, indexed_vertices, indexed_uvs, indexed_normals);
+		modelInstances = imported.instances;
+		for(size_t i = 0; i < imported.instances.size(); i++){
+			modelMaterials.push_back(imported.meshes[imported.instances[i].mesh].material);
+		}
+		imported = ImportedScene();
+	}
 
-	// Load it into a VBO
-	GLuint vertexbuffer;
-	glGenBuffers(1, &vertexbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
+	else{
+		std::string meshCachePath = std::string(MODEL_LOCATION) + MESH_CACHE_EXTENSION;
+		MeshCache meshCache;
+		unsigned int mesh;
+
+		// A cache built with other settings is rebuilt like an outdated one
+		MeshCacheSettings meshCacheSettings = {};
+		if(LOD_LEVELS > 0){
+			meshCacheSettings.lodLevels = LOD_LEVELS;
+			meshCacheSettings.lodReduction = LOD_REDUCTION;
+			meshCacheSettings.lodMaxError = LOD_MAX_ERROR;
+		}
+		if(USE_EXPOSURE_BAKE){
+			meshCacheSettings.exposureSamples = EXPOSURE_BAKE_SAMPLES;
+			meshCacheSettings.exposureTexels = EXPOSURE_BAKE_TEXELS;
+			meshCacheSettings.occlusionBoxSize = OCCLUSION_BOX_SIZE;
+			meshCacheSettings.occlusionTapSpread = OCCLUSION_TAP_SPREAD;
+			meshCacheSettings.occlusionDepthBias = OCCLUSION_DEPTH_BIAS;
+		}
+		uint64_t meshCacheSettingsHash = hashMeshCacheSettings(meshCacheSettings);
 
-	GLuint uvbuffer;
-	glGenBuffers(1, &uvbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
+		if(USE_MESH_CACHE && meshCache.open(meshCachePath.c_str(), MODEL_LOCATION, meshCacheSettingsHash)){
+			mesh = scene.addMesh(meshCache.vertices(), meshCache.vertexCount(), meshCache.indices(), meshCache.indexCount(),
+				meshCache.lodIndices(), meshCache.lods(), meshCache.lodCount(), meshCache.exposure());
+			meshCache.close();
+		}
 
-	GLuint normalbuffer;
-	glGenBuffers(1, &normalbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
+		else{
+			meshCache.close();
+
+			std::vector<glm::vec3> vertices;
+			std::vector<glm::vec2> uvs;
+			std::vector<glm::vec3> normals;
+			// Nothing is indexed nor cached from a model that could not be read
+			if(!loadOBJ(MODEL_LOCATION, vertices, uvs, normals) || vertices.empty()){
+				fprintf(stderr, "Failed to load model %s.\n", MODEL_LOCATION);
+				if(headless){
+					destroyHeadlessContext();
+				}else{
+					getchar();
+					glfwTerminate();
+				}
+				return -1;
+			}
+
+			// Interleaved vertices, uploaded with a VAO per pass
+			std::vector<unsigned int> indices;
+			std::vector<PackedVertex> indexed_vertices;
+			indexVBO(vertices, uvs, normals, indices, indexed_vertices);
+
+			// Simplified levels of the model, stored in the cache with it
+			std::vector<unsigned int> lodIndices;
+			std::vector<MeshLod> lods;
+			buildMeshLods(indexed_vertices.data(), indexed_vertices.size(), indices.data(), indices.size(), LOD_LEVELS, LOD_REDUCTION, LOD_MAX_ERROR, lodIndices, lods);
+
+			// Exposure of the vertices to the snowfall, also stored in the cache
+			std::vector<glm::vec3> exposure;
+			if(USE_EXPOSURE_BAKE){
+				double bakeStart = getTimeInSeconds();
+				bakeExposure(indexed_vertices.data(), indexed_vertices.size(), indices.data(), indices.size(), occlusionBoundsMin, occlusionBoundsMax,
+					EXPOSURE_BAKE_TEXELS, EXPOSURE_BAKE_SAMPLES, exposure);
+				printf("Exposure baked in %.2f s\n", getTimeInSeconds() - bakeStart);
+			}
+
+			mesh = scene.addMesh(indexed_vertices.data(), indexed_vertices.size(), indices.data(), indices.size(), lodIndices.data(), lods.data(), lods.size(),
+				exposure.empty() ? NULL : exposure.data());
+
+			if(USE_MESH_CACHE){
+				writeMeshCache(meshCachePath.c_str(), MODEL_LOCATION, indexed_vertices, indices, lodIndices, lods, exposure, EXPOSURE_BAKE_SAMPLES, meshCacheSettingsHash);
+			}
+		}
+
+		SceneNodeInstance instance = {mesh, glm::mat4(1.0f)};
+		modelInstances.push_back(instance);
+		modelMaterials.push_back(scene.addMaterial(Texture));
+	}
+
+	// The model is repeated on a SCENE_GRID_SIZE x SCENE_GRID_SIZE grid, every copy is an instance
+	for(int x = 0; x < SCENE_GRID_SIZE; x++){
+		for(int y = 0; y < SCENE_GRID_SIZE; y++){
+			glm::vec3 offset = SCENE_GRID_SPACING * glm::vec3(x - (SCENE_GRID_SIZE - 1) * 0.5f, y - (SCENE_GRID_SIZE - 1) * 0.5f, 0.0f);
+			for(size_t i = 0; i < modelInstances.size(); i++){
+				scene.addInstance(modelInstances[i].mesh, modelMaterials[i], glm::translate(glm::mat4(1.0f), offset) * modelInstances[i].transform);
+			}
+		}
+	}
+	scene.upload();
 
-	GLuint elementbuffer;
-	glGenBuffers(1, &elementbuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+	// Culling of the instances against the camera and the occlusion map volume, through a BVH
+	SceneCuller culler(USE_OCCLUSION_QUERIES);
+	std::vector<unsigned char> shadingVisible;
+	std::vector<unsigned char> depthVisible;
+	CullingCounts shadingCulling;
+	CullingCounts depthCulling;
+	double shadingVisibleSum = 0.0;
+
+	// Level of detail of every instance, picked for each pass from its projected size
+	std::vector<unsigned char> shadingLods;
+	std::vector<unsigned char> depthLods;
+	printf("Model loaded in %.2f s\n", getTimeInSeconds() - loadStart);
 
 	// Render to Texture
 	GLuint FramebufferName = 0;
@@ -186,6 +376,12 @@ int main(void){
 	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		return false;
 
+	// The occlusion map only depends on the geometry, the occlusion direction and the bounds of the depth pass,
+	// it is re-rendered when one of them changes. The meshes don't change once uploaded, the geometry changes
+	// with the instances, so the scene instance version is the geometry version of the occlusion map, the
+	// wind exposure and the sun cascades.
+	OcclusionMapCache occlusionCache;
+
 	static const GLfloat g_quad_vertex_buffer_data[] = { 
 		-1.0f, -1.0f, 0.0f,
 		 1.0f, -1.0f, 0.0f,
@@ -202,28 +398,127 @@ int main(void){
 
 	GLuint quad_programID = LoadShaders( "shaders/Passthrough.vert", "shaders/SimpleTexture.frag" );
 	GLuint texID = glGetUniformLocation(quad_programID, "texture");
-	GLuint programID = LoadShaders( "shaders/ShadowMapping.vert", "shaders/ShadowMapping.frag" );
-	GLuint TextureID  = glGetUniformLocation(programID, "myTextureSampler");
 
-	GLuint MatrixID = glGetUniformLocation(programID, "MVP");
-	GLuint ViewMatrixID = glGetUniformLocation(programID, "V");
-	GLuint ModelMatrixID = glGetUniformLocation(programID, "M");
-	GLuint DepthBiasID = glGetUniformLocation(programID, "DepthBiasMVP");
-	GLuint ShadowMapID = glGetUniformLocation(programID, "shadowMap");
+	// The shading program is compiled for the lights, shadow taps, debug view and snow effects in use (one variant each).
+	// The samplers of a variant never change, the environment and camera state is uploaded once per frame into a uniform buffer.
+	ShaderPermutations shadingPrograms( "shaders/ShadowMapping.vert", "shaders/ShadowMapping.frag", [](ShaderProgram & program){
+		glUniform1i(program.getUniformLocation("myTextureSampler"), 0);
+		glUniform1i(program.getUniformLocation("shadowMap"), 1);
+		glUniform1i(program.getUniformLocation("snowDepthMap"), 2);
+		glUniform1i(program.getUniformLocation("windExposureMap"), 3);
+		glUniform1i(program.getUniformLocation("clusterGrid"), 4);
+		glUniform1i(program.getUniformLocation("clusterLightIndices"), 5);
+		glUniform1i(program.getUniformLocation("clusterLights"), 6);
+		glUniform1i(program.getUniformLocation("sunShadowMap"), 7);
+		program.bindUniformBlock("Environment", ENVIRONMENT_BLOCK_BINDING);
+	});
+	auto shadingVariant = [](int lightCount, int debugView){
+		ShaderDefines defines;
+		defines.set("LIGHT_COUNT", lightCount).set("SHADOW_TAPS", SHADOW_TAPS).set("DEBUG_VIEW", debugView)
+			.set("DAYTIME_SIMULATION", DAYTIME_SIMULATION).set("SNOW_DEPTH_MAP", SNOW_DEPTH_MAP).set("WIND_EXPOSURE", WIND_EXPOSURE)
+			.set("CLUSTERED_LIGHTS", STREET_LAMP_COUNT > 0).set("SUN_SHADOWS", SUN_SHADOWS).set("SUN_CASCADES", SUN_CASCADES)
+			.set("OCCLUSION_TAP_SPREAD", OCCLUSION_TAP_SPREAD).set("OCCLUSION_DEPTH_BIAS", OCCLUSION_DEPTH_BIAS);
+		return defines;
+	};
+
+	// Only the sun lights the scene (lightInvDirs[0]), the debug view can be changed with the V key
+	int lightCount = 1;
+	int debugView = DEBUG_VIEW;
+	bool debugKeyHeld = false;
+	shadingPrograms.get(shadingVariant(lightCount, debugView));
+
+	depthProgram.bindUniformBlock("Environment", ENVIRONMENT_BLOCK_BINDING);
+	EnvironmentBuffer environmentBuffer;
+	environmentBuffer.create();
+
+	// The snow lying on the scene, carried from one time step to the next
+	SnowDepthMap snowDepth;
+	if(SNOW_DEPTH_MAP){
+		snowDepth.create(SNOW_DEPTH_RESOLUTION);
+	}
+
+	// The occlusion from a cone of snowfall directions, accumulated over a few frames
+	WindExposureMap windExposure;
+	std::vector<unsigned char> passVisible;
+	if(WIND_EXPOSURE){
+		windExposure.create(WIND_MAP_RESOLUTION, WINDOW_WIDTH, WIND_CONE_DIRECTIONS, WIND_CONE_ANGLE, WIND_TOLERANCE);
+	}
+
+	// The shadows of the sun, cascades fit to the camera frustum and rendered again only when out of date
+	SunShadowCascades sunShadows;
+	std::vector<unsigned char> sunShadowLods;		// The levels the cascades were rendered with
+	unsigned int sunShadowLodVersion = 0;			// Changes with them, the cascades are then rendered again
+	if(SUN_SHADOWS){
+		sunShadows.create(SUN_SHADOW_RESOLUTION, SUN_CASCADES, SUN_CASCADE_LAMBDA, SUN_SHADOW_DISTANCE, SUN_CASCADE_MARGIN, SUN_TOLERANCE);
+	}
+
+	// The street lamps, sorted every frame into the clusters of the view frustum
+	std::vector<LocalLight> localLights;
+	placeLightRing(STREET_LAMP_COUNT, STREET_LAMP_RING, STREET_LAMP_HEIGHT, STREET_LAMP_RADIUS, glm::vec3(1.0f, 0.8f, 0.55f), localLights);
+	LightClusters lightClusters;
+	if(!localLights.empty()){
+		lightClusters.create(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTER_SLICES);
+	}
+
+	if(GPU_STATISTICS_OVERLAY){
+		initText2D(FONT_TEXTURE_LOCATION);
+	}
 
  	// The mouse scroll callback
-    glfwSetScrollCallback(window, scroll_callback);
+	if(!headless){
+    	glfwSetScrollCallback(window, scroll_callback);
+	}
 	
 	// Data for FPS calculation
-	double lastTime = glfwGetTime();
+	double lastTime = getTimeInSeconds();
  	int nbFrames = 0;
 	double fps = 0;
 	int frame_count = 0;
+	bool running = true;
+
+	// Frames are read back asynchronously, READBACK_RING_SIZE frames after they were rendered.
+	// Without OpenCV there is nothing to do with the pixels unless they are written to disk.
+	#ifdef USE_OPENCV
+	bool capturing = true;
+	GLenum readbackFormat = GL_BGR;
+	#else
+	bool capturing = headless;
+	GLenum readbackFormat = GL_RGB;
+	#endif
+
+	std::unique_ptr<FrameReadback> readback;
+	if(capturing){
+		readback.reset(new FrameReadback(windowWidth, windowHeight, READBACK_RING_SIZE, readbackFormat, !headless));
+	}
+
+	// Overlay and encoding run on background threads, fed through a bounded queue. The preview window is shown by the render loop.
+	// A batch must not lose frames, an interactive session should rather drop them than stall.
+	std::unique_ptr<OutputPipeline> output;
+	#ifdef USE_OPENCV
+	PreviewSink * preview = NULL;		// Owned by the pipeline, shown by the render loop (HighGUI wants the main thread)
+	#endif
+	if(capturing){
+		BackpressurePolicy policy = (headless || !OUTPUT_DROP_FRAMES) ? BackpressurePolicy::Block : BackpressurePolicy::Drop;
+		output.reset(new OutputPipeline(readback->pool(), OUTPUT_QUEUE_CAPACITY, OUTPUT_WORKER_THREADS, policy, !GPU_STATISTICS_OVERLAY));
+
+		#ifdef USE_OPENCV
+		output->addSink(std::move(video));
+		if(!headless){
+			preview = new PreviewSink(CV_WINDOW_NAME, OUTPUT_IMAGE_FILENAME);
+			output->addSink(std::unique_ptr<FrameSink>(preview));
+		}
+		#endif
+
+		if(headless){
+			output->addSink(std::unique_ptr<FrameSink>(new ImageSequenceSink(HEADLESS_FRAME_PATTERN)));
+		}
+		output->start();
+	}
 
 	do {
 
 		// FPS Calculation
-		double currentTime = glfwGetTime();
+		double currentTime = getTimeInSeconds();
      	nbFrames++;
      	if (currentTime - lastTime >= 1.0 ){
 			fps = 1000.0 / double(nbFrames);
@@ -231,56 +526,34 @@ int main(void){
         	lastTime += 1.0;
      	}
 
-		// Increase time
-		f_daytime_index += FRAME_MICRO_STEP;
+		// Increase time, a headless batch walks through every row of the data file
+		if(headless){
+			f_daytime_index = frame_count;
+		}
+		else{
+			f_daytime_index += FRAME_MICRO_STEP;
+		}
+
 		if(f_daytime_index > daytime_size - 1.0){
 			f_daytime_index = 0;
 		}
 
 		int daytime_index = (int)f_daytime_index;
-		auto current_time = daytime_data[daytime_index];
-
-		//glUniform3f(glGetUniformLocation(programID, "snow_color"), 1.0f , 1.0f, 1.0f);
-		glUniform3f(glGetUniformLocation(programID, "snow_color"), SNOW_COLOR_R, SNOW_COLOR_G, SNOW_COLOR_B);
-		glUniform1f(glGetUniformLocation(programID, "distortion_scalar"), DISTORTION_SCALAR);
-
-		// Render to framebuffer
-		glBindFramebuffer(GL_FRAMEBUFFER, FramebufferName);
-		glViewport(0,0,WINDOW_WIDTH,WINDOW_WIDTH);
-	
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glUseProgram(depthProgramID);
+		Data current_time = daytime_data.row(daytime_index);
 
 		// A virtual "light" to get the occlusion map
 		// Typically the light source is right above the object if no wind.
-		glm::vec3 snow_occlusion_light_direction = glm::vec3(0.0f, 0.0, 1.0);
+		OcclusionMapKey occlusion;
+		occlusion.geometryVersion = scene.instanceVersion();
+		occlusion.direction = glm::vec3(0.0f, 0.0, 1.0);
+		occlusion.boundsMin = occlusionBoundsMin;
+		occlusion.boundsMax = occlusionBoundsMax;
 
 		// Compute the MVP matrix from the light's point of view
-		glm::mat4 depthProjectionMatrix = glm::ortho<float>(-30, 30, -30, 30, -30, 30);
-		glm::mat4 depthViewMatrix = glm::lookAt(snow_occlusion_light_direction, glm::vec3(0,0,0), glm::vec3(0,1,0));
+		glm::mat4 depthProjectionMatrix = glm::ortho<float>(occlusion.boundsMin.x, occlusion.boundsMax.x, occlusion.boundsMin.y, occlusion.boundsMax.y, occlusion.boundsMin.z, occlusion.boundsMax.z);
+		glm::mat4 depthViewMatrix = glm::lookAt(occlusion.direction, glm::vec3(0,0,0), glm::vec3(0,1,0));
 		glm::mat4 depthModelMatrix = glm::mat4(1.0);
 		glm::mat4 depthMVP = depthProjectionMatrix * depthViewMatrix * depthModelMatrix;
-		glUniformMatrix4fv(depthMatrixID, 1, GL_FALSE, &depthMVP[0][0]);
-
-		// 1st attribute buffer: vertices
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-		glDisableVertexAttribArray(0);
-
-		// Render to the screen
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glViewport(0, 0, windowWidth, windowHeight);
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
-
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glUseProgram(programID);
 
 		// Compute the MVP matrix from keyboard and mouse input
 		glm::vec3 eye_pos = computeMatricesFromInputs();
@@ -296,19 +569,26 @@ int main(void){
 			0.5, 0.5, 0.5, 1.0
 		);
 
-		glm::mat4 depthBiasMVP = biasMatrix*depthMVP;
-		glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-		glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-		glUniformMatrix4fv(DepthBiasID, 1, GL_FALSE, &depthBiasMVP[0][0]);
+		// All the per-frame state of the depth and shading programs, uploaded once
+		EnvironmentBlock environment;
+		environment.MVP = MVP;
+		environment.V = ViewMatrix;
+		environment.M = ModelMatrix;
+		environment.DepthBiasMVP = biasMatrix*depthMVP;
+		environment.depthMVP = depthMVP;
+		environment.snowColor = glm::vec3(SNOW_COLOR_R, SNOW_COLOR_G, SNOW_COLOR_B);
+		environment.distortionScalar = DISTORTION_SCALAR;
+		environment.numLights = lightCount;
+		environment.snowDisplacement = (SNOW_DEPTH_MAP && DAYTIME_SIMULATION) ? 1.0f : 0.0f;
+		environment.windExposure = WIND_EXPOSURE ? 1.0f : 0.0f;
 
 		// Set some parameters based on time
-		glm::vec3 lightInvDirs[6];
+		glm::vec3 lightInvDirs[ENVIRONMENT_MAX_LIGHTS];
 		if(DAYTIME_SIMULATION){
 			glClearColor(current_time.sky_color_r, current_time.sky_color_g, current_time.sky_color_b, 0.0f);
-			glUniform3f(glGetUniformLocation(programID, "sun_color"), current_time.sun_color_r, current_time.sun_color_g, current_time.sun_color_b);
-			glUniform1f(glGetUniformLocation(programID, "snow_amount"), current_time.snow_amount);
-			glUniform1f(glGetUniformLocation(programID, "light_intensity"), current_time.light_intensity);
+			environment.sunColor = glm::vec3(current_time.sun_color_r, current_time.sun_color_g, current_time.sun_color_b);
+			environment.snowAmount = current_time.snow_amount;
+			environment.lightIntensity = current_time.light_intensity;
 			
 			lightInvDirs[0] = glm::vec3(current_time.light_direction_x, current_time.light_direction_y,  current_time.light_direction_z);
 		}
@@ -316,9 +596,9 @@ int main(void){
 		else{
 
 			glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-			glUniform3f(glGetUniformLocation(programID, "sun_color"), 		1.0f, 1.0f, 1.0f);
-			glUniform1f(glGetUniformLocation(programID, "snow_amount"), 	MANUAL_SNOW_AMOUNT);
-			glUniform1f(glGetUniformLocation(programID, "light_intensity"), MANUAL_LIGHT_INTENSITY);
+			environment.sunColor = glm::vec3(1.0f, 1.0f, 1.0f);
+			environment.snowAmount = MANUAL_SNOW_AMOUNT;
+			environment.lightIntensity = MANUAL_LIGHT_INTENSITY;
 
 			lightInvDirs[0] = glm::vec3(0.00f, -0.85f,  0.52f);
 			//lightInvDirs[1] = glm::vec3( 0.0f,  0.0f, -1.0f);
@@ -328,41 +608,165 @@ int main(void){
 			//lightInvDirs[5] = glm::vec3(-1.0f,  0.0f,  0.0f);
 		}
 
-		GLuint lightInvDirID = glGetUniformLocation(programID, "LightInvDirection_worldspace");
-		glUniform3fv(lightInvDirID, 6, &lightInvDirs[0][0]);
-		GLuint numLightsID = glGetUniformLocation(programID, "numLights");
-		glUniform1i(numLightsID, 6);
+		for(int i = 0; i < ENVIRONMENT_MAX_LIGHTS; i++){
+			environment.lightInvDirections[i] = glm::vec4(lightInvDirs[i], 0.0f);
+		}
 
-		// Texture binding
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, Texture);
-		glUniform1i(TextureID, 0);
+		// The lamps fade in at dusk
+		if(!localLights.empty()){
+			float lampPower = STREET_LAMP_POWER * glm::clamp(1.0f - environment.lightIntensity / STREET_LAMP_DUSK, 0.0f, 1.0f);
+			for(LocalLight & lamp : localLights){
+				lamp.intensity = lampPower;
+			}
+			lightClusters.update(localLights, ViewMatrix * ModelMatrix, ProjectionMatrix, windowWidth, windowHeight);
+		}
+		environment.clusterGrid = lightClusters.gridSize();
+		environment.clusterParams = lightClusters.parameters();
+		environmentBuffer.upload(environment);
+
+		// Instances the camera sees, minus those the occlusion queries of the previous frames found hidden
+		culler.update(scene);
+		if(USE_FRUSTUM_CULLING){
+			shadingCulling = culler.cullFrustum(MVP, shadingVisible);
+			culler.cullOccluded(shadingVisible, shadingCulling);
+		}
+		else{
+			shadingCulling.visible = scene.instanceCount();
+		}
+		shadingVisibleSum += shadingCulling.visible;
+		scene.selectLods(eye_pos, ProjectionMatrix[1][1] * windowHeight * 0.5f, false, LOD_SHADING_PIXEL_ERROR, shadingLods);
+
+		// Texture levels for the size of the visible instances on screen, a headless frame waits for them
+		if(textureStreamer){
+			float pixelsPerUnit = ProjectionMatrix[1][1] * windowHeight * 0.5f;
+			for(unsigned int i = 0; i < scene.instanceCount(); i++){
+				if(USE_FRUSTUM_CULLING && !shadingVisible[i]){
+					continue;
+				}
+				glm::vec3 boundsMin, boundsMax;
+				scene.instanceBounds(i, boundsMin, boundsMax);
+				float distance = glm::length(eye_pos - glm::clamp(eye_pos, boundsMin, boundsMax));
+				float screenPixels = glm::length(boundsMax - boundsMin) * pixelsPerUnit / std::max(distance, 1e-3f);
+				textureStreamer->request(scene.materialTexture(scene.instance(i).material), screenPixels);
+			}
+			glActiveTexture(GL_TEXTURE0);
+			if(headless){
+				textureStreamer->flush();
+			}
+			else{
+				textureStreamer->update();
+			}
+		}
 
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, depthTexture);
-		glUniform1i(ShadowMapID, 1);
+		// Render to framebuffer, only when the cached occlusion map is out of date
+		if(occlusionCache.needsUpdate(occlusion)){
+			glBindFramebuffer(GL_FRAMEBUFFER, FramebufferName);
+			glViewport(0,0,WINDOW_WIDTH,WINDOW_WIDTH);
+
+			glEnable(GL_CULL_FACE);
+			glCullFace(GL_BACK);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			depthProgram.use();
+			scene.selectLods(occlusion.direction, depthProjectionMatrix[1][1] * WINDOW_WIDTH * 0.5f, true, LOD_DEPTH_PIXEL_ERROR, depthLods);
+			if(USE_FRUSTUM_CULLING){
+				depthCulling = culler.cullFrustum(depthMVP, depthVisible);
+				scene.draw(MeshPass::Depth, &depthVisible, &depthLods);
+			}
+			else{
+				depthCulling.visible = scene.instanceCount();
+				scene.draw(MeshPass::Depth, NULL, &depthLods);
+			}
+		}
 
-		// 1st attribute buffer: vertices
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,	0, (void*)0);
+		// A depth pass with its own depthMVP and levels of detail, for the directions of the wind cone and the sun cascades
+		bool passRendered = false;
+		auto renderDepthPass = [&](const glm::mat4 & passMVP, const std::vector<unsigned char> & passLods){
+			EnvironmentBlock passEnvironment = environment;
+			passEnvironment.depthMVP = passMVP;
+			environmentBuffer.upload(passEnvironment);
+			passRendered = true;
+			depthProgram.use();
+			if(USE_FRUSTUM_CULLING){
+				culler.cullFrustum(passMVP, passVisible);
+				scene.draw(MeshPass::Depth, &passVisible, &passLods);
+			}
+			else{
+				scene.draw(MeshPass::Depth, NULL, &passLods);
+			}
+		};
+
+		if(WIND_EXPOSURE){
+			OcclusionMapKey wind = occlusion;
+			wind.direction = DAYTIME_SIMULATION ? windSnowfallDirection(current_time.wind_speed, current_time.wind_direction, WIND_FALL_SPEED) : occlusion.direction;
+			windExposure.update(wind, depthTexture, depthMVP, headless ? WIND_CONE_DIRECTIONS : WIND_PASSES_PER_FRAME,
+				[&](const glm::mat4 & passMVP){ renderDepthPass(passMVP, depthLods); });
+		}
 
-		// 2nd attribute buffer: UVs
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		// The sun casts shadows on everything inside the occlusion box, nothing to render while it is down.
+		// The casters use the levels the camera shades: a coarser caster under its own receiver shadows itself.
+		if(SUN_SHADOWS){
+			if(environment.lightIntensity > 0.0f){
+				if(shadingLods != sunShadowLods){
+					sunShadowLods = shadingLods;
+					sunShadowLodVersion++;
+				}
+				sunShadows.update(lightInvDirs[0], ViewMatrix * ModelMatrix, ProjectionMatrix, occlusion.boundsMin, occlusion.boundsMax, scene.instanceVersion() + sunShadowLodVersion,
+					[&](const glm::mat4 & passMVP){ renderDepthPass(passMVP, shadingLods); });
+			}
+			for(int i = 0; i < SUN_CASCADES; i++){
+				environment.sunShadowMatrices[i] = sunShadows.matrix(i);
+			}
+			environment.sunCascadeSplits = sunShadows.splitDepths();
+			passRendered = true;
+		}
+
+		// The passes changed depthMVP, and the sun cascades are part of the environment
+		if(passRendered){
+			environmentBuffer.upload(environment);
+		}
 
-		// 3rd attribute buffer: normals
-		glEnableVertexAttribArray(2);
-		glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-		glVertexAttribPointer(2, 3,	GL_FLOAT, GL_FALSE, 0, (void*)0);
+		// Snow fallen and melted since the previous frame, on the surfaces the occlusion map sees
+		if(SNOW_DEPTH_MAP && DAYTIME_SIMULATION){
+			snowDepth.advance(daytime_data, f_daytime_index, depthTexture, occlusion.boundsMin, occlusion.boundsMax);
+		}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, (void*)0);
+		// Render to the screen (or the offscreen framebuffer in headless mode)
+		glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+		glViewport(0, 0, windowWidth, windowHeight);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_BACK);
 
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(2);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		shadingPrograms.get(shadingVariant(lightCount, debugView)).use();
+
+		// Texture binding, the scene binds the diffuse texture of each material to unit 0
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		if(SNOW_DEPTH_MAP){
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_2D, snowDepth.texture());
+		}
+		if(WIND_EXPOSURE){
+			glActiveTexture(GL_TEXTURE3);
+			glBindTexture(GL_TEXTURE_2D, windExposure.texture());
+		}
+		if(!localLights.empty()){
+			lightClusters.bind(4);
+		}
+		if(SUN_SHADOWS){
+			glActiveTexture(GL_TEXTURE7);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, sunShadows.depthTexture());
+		}
+
+		scene.draw(MeshPass::Shading, USE_FRUSTUM_CULLING ? &shadingVisible : NULL, &shadingLods);
+
+		// Test the boxes of the instances against this frame's depth, the results are used by the next frames
+		if(USE_FRUSTUM_CULLING){
+			culler.queryOcclusion(scene, MVP, eye_pos);
+		}
+
+		// The debug quad below still uses the default VAO
+		glBindVertexArray(VertexArrayID);
 		glViewport(0, 0, 512, 512);
 		glUseProgram(quad_programID);
 
@@ -376,77 +780,198 @@ int main(void){
 		glBindBuffer(GL_ARRAY_BUFFER, quad_vertexbuffer);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 		glDisableVertexAttribArray(0);
-		
-		// Convert the OpenGL Framebuffer to OpenCV Mat
 
-		#ifdef USE_OPENCV
-        cv::Mat capturedImage = frameBufferToCVMat(WINDOW_WIDTH, WINDOW_HEIGHT);
-
-		// Set some statistical texts.
-		std::string fpsText 		   = "FPS: " 			 + std::to_string(int(fps));
-        std::string eyePosText 		   = "Eye Position: (" 	 + intToString(eye_pos.x) + ", " + intToString(eye_pos.y) + ", " + intToString(eye_pos.z) + ")";
-
-		std::string timeText 		   = "Time: " 			 + current_time.time;
-		std::string temperatureText    = "Temperature: " 	 + floatToString(current_time.temperature)			+ "C";
-		std::string snowAmountText 	   = "Snow Amount: " 	 + intToString(current_time.snow_amount * 100)		+ "%";
-		std::string lightIntensityText = "Light Intensity: " + intToString(current_time.light_intensity * 100)	+ "%";
-		std::string elevationAngleText = "Elevation Angle: " + floatToString(current_time.elevation_angle)		+ "deg";
-
-		// Display those statistical texts.
-		int left_pos = 10;
-		int down_pos = 20;
-        //cv::putText(capturedImage, fpsText, 			cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
-        cv::putText(capturedImage, eyePosText, 			cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 40;
-		
-		cv::putText(capturedImage, timeText, 			cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
-		cv::putText(capturedImage, snowAmountText,  	cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
-		cv::putText(capturedImage, temperatureText, 	cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
-		cv::putText(capturedImage, lightIntensityText,	cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 20;
-		cv::putText(capturedImage, elevationAngleText,  cv::Point(left_pos, down_pos), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 2);	down_pos += 40;
-        
-		video.write(capturedImage);
-        cv::imshow(CV_WINDOW_NAME, capturedImage);
+		// Statistics overlay, drawn into the frame before it is read back (a single instanced draw call)
+		if(GPU_STATISTICS_OVERLAY){
+			char text[128];
+			int left_pos = 10;
+			int down_pos = 20;
+
+			snprintf(text, sizeof(text), "Eye Position: (%d, %d, %d)", (int)eye_pos.x, (int)eye_pos.y, (int)eye_pos.z);
+			printText2D(text, left_pos, down_pos - 14, 16);	down_pos += 20;
+			snprintf(text, sizeof(text), "Objects: %u/%u (occlusion map %u/%u)", shadingCulling.visible, (unsigned int)scene.instanceCount(), depthCulling.visible, (unsigned int)scene.instanceCount());
+			printText2D(text, left_pos, down_pos - 14, 16);	down_pos += 40;
+
+			snprintf(text, sizeof(text), "Time: %s", current_time.time);
+			printText2D(text, left_pos, down_pos - 14, 16);	down_pos += 20;
+			snprintf(text, sizeof(text), "Snow Amount: %d%%", (int)(current_time.snow_amount * 100));
+			printText2D(text, left_pos, down_pos - 14, 16);	down_pos += 20;
+			snprintf(text, sizeof(text), "Temperature: %.2fC", current_time.temperature);
+			printText2D(text, left_pos, down_pos - 14, 16);	down_pos += 20;
+			snprintf(text, sizeof(text), "Light Intensity: %d%%", (int)(current_time.light_intensity * 100));
+			printText2D(text, left_pos, down_pos - 14, 16);	down_pos += 20;
+			snprintf(text, sizeof(text), "Elevation Angle: %.2fdeg", current_time.elevation_angle);
+			printText2D(text, left_pos, down_pos - 14, 16);
+
+			glViewport(0, 0, windowWidth, windowHeight);
+			drawText2D(windowWidth, windowHeight);
+		}
 
-		if (cv::waitKey(1) >= 0){
-			cv::imwrite(OUTPUT_IMAGE_FILENAME, capturedImage);
-			break;
+		// Hand the frame over to the asynchronous readback, it gives back the one of READBACK_RING_SIZE frames ago.
+		if(capturing){
+
+			// Multisampled offscreen pixels have to be resolved first
+			if(headless){
+				resolveOffscreenTarget(offscreen);
+			}
+
+			FrameInfo info;
+			info.index = frame_count;
+			info.daytime_index = daytime_index;
+			info.eye_pos = eye_pos;
+			info.fps = fps;
+
+			Frame * frame = readback->capture(info);
+			if(frame != NULL){
+				output->push(frame, daytime_data.row(frame->info.daytime_index));
+			}
+
+			// A key has been pressed in the preview window
+			#ifdef USE_OPENCV
+			if(preview != NULL && !preview->show()){
+				break;
+			}
+			#endif
+			if(output->shouldStop()){
+				break;
+			}
+
+			#ifdef USE_OPENCV
+			if(AUTO_STOP_RECORDING && frame_count + 1 >= daytime_size){
+				running = false;
+			}
+			#endif
 		}
 
 		frame_count++;
-		if(AUTO_STOP_RECORDING && frame_count >= daytime_size){
-			break;
+
+		if(headless){
+			// No swap, no vsync: the batch is only bounded by rendering throughput.
+			if(frame_count >= daytime_size){
+				running = false;
+			}
 		}
-		#endif
 
-		// Swap buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		else{
+			// Swap buffers
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+
+			// The framebuffer follows the window (resized, or moved to a screen of another scale), so does the
+			// readback once the frames captured at the previous size are out. A minimized window keeps its size.
+			int framebufferWidth, framebufferHeight;
+			glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+			if(framebufferWidth > 0 && framebufferHeight > 0 && (framebufferWidth != windowWidth || framebufferHeight != windowHeight)){
+				windowWidth = framebufferWidth;
+				windowHeight = framebufferHeight;
+				if(capturing){
+					Frame * frame;
+					while((frame = readback->flush()) != NULL){
+						output->push(frame, daytime_data.row(frame->info.daytime_index));
+					}
+					readback->resize(windowWidth, windowHeight);
+				}
+			}
+
+			// Check if the ESC key was pressed or the window was closed
+			if(glfwGetKey(window, GLFW_KEY_ESCAPE ) == GLFW_PRESS || glfwWindowShouldClose(window) != 0){
+				running = false;
+			}
+
+			// The V key switches to the next debug view (none, visibility, inclination), compiled on first use
+			bool debugKey = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+			if(debugKey && !debugKeyHeld){
+				debugView = (debugView + 1) % 3;
+			}
+			debugKeyHeld = debugKey;
+		}
 
 	} 
 	
-	// Check if the ESC key was pressed or the window was closed
-	while(glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS && glfwWindowShouldClose(window) == 0);
+	while(running);
+
+	// Output the frames still in flight, then wait for the output threads to write everything
+	if(capturing){
+		Frame * frame;
+		while((frame = readback->flush()) != NULL){
+			output->push(frame, daytime_data.row(frame->info.daytime_index));
+		}
+
+		output->finish();
+		output->printStatistics();
+		output.reset();
+		readback.reset();
+	}
+
+	programCache.printStatistics();
+	occlusionCache.printStatistics();
+	if(SNOW_DEPTH_MAP){
+		snowDepth.printStatistics();
+	}
+	if(WIND_EXPOSURE){
+		windExposure.printStatistics();
+	}
+	if(!localLights.empty()){
+		lightClusters.printStatistics();
+	}
+	if(SUN_SHADOWS){
+		sunShadows.printStatistics();
+	}
+	scene.printStatistics();
+	if(textureStreamer){
+		textureStreamer->printStatistics();
+	}
+	printf("Culling: %.1f of %d instances drawn per frame on average, last frame %u outside the frustum, %u occluded\n",
+		frame_count > 0 ? shadingVisibleSum / frame_count : 0.0, (int)scene.instanceCount(), shadingCulling.frustumCulled, shadingCulling.occlusionCulled);
+	culler.release();
 
 	// Cleanup VBO and shader
-	glDeleteBuffers(1, &vertexbuffer);
-	glDeleteBuffers(1, &uvbuffer);
-	glDeleteBuffers(1, &normalbuffer);
-	glDeleteBuffers(1, &elementbuffer);
-	glDeleteProgram(programID);
-	glDeleteProgram(depthProgramID);
+	if(GPU_STATISTICS_OVERLAY){
+		cleanupText2D();
+	}
+	scene.release();
+	shadingPrograms.release();
+	depthProgram.release();
+	environmentBuffer.release();
+	if(SNOW_DEPTH_MAP){
+		snowDepth.release();
+	}
+	if(WIND_EXPOSURE){
+		windExposure.release();
+	}
+	if(!localLights.empty()){
+		lightClusters.release();
+	}
+	if(SUN_SHADOWS){
+		sunShadows.release();
+	}
 	glDeleteProgram(quad_programID);
-	glDeleteTextures(1, &Texture);
+	if(textureStreamer){
+		textureStreamer->release();
+	}
+	else{
+		glDeleteTextures(1, &Texture);
+		if(!sceneTextures.empty()){
+			glDeleteTextures(sceneTextures.size(), sceneTextures.data());
+		}
+	}
 
 	glDeleteFramebuffers(1, &FramebufferName);
 	glDeleteTextures(1, &depthTexture);
 	glDeleteBuffers(1, &quad_vertexbuffer);
 	glDeleteVertexArrays(1, &VertexArrayID);
+	setProgramCache(NULL);
 
 	// Close OpenGL window and terminate GLFW
-	glfwTerminate();
+	if(headless){
+		deleteOffscreenTarget(offscreen);
+		destroyHeadlessContext();
+	}
+	else{
+		glfwTerminate();
+	}
 
 	#ifdef USE_OPENCV
-	video.release();
     cv::destroyAllWindows();
 	#endif
 
@@ -0,0 +1,71 @@
+# Builds font.bmp, the glyph atlas of the statistics overlay (common/text2D.cpp).
+#
+# The glyphs are the fixed-width bitmap font shipped with AntTweakBar (s_FontFixed1 in
+# external/AntTweakBar-1.16/src/TwFonts.cpp). The atlas is a 16 x 16 grid of 8 x 16 pixel cells,
+# the cell of character c is at column c % 16 and row c // 16, counted from the top-left corner.
+# Coverage is stored as grey levels in a 24-bit BMP so loadBMP_custom() can read it.
+
+import os
+import re
+import struct
+
+CELL_WIDTH = 8
+CELL_HEIGHT = 16
+
+here = os.path.dirname(os.path.abspath(__file__))
+source = os.path.join(here, "..", "external", "AntTweakBar-1.16", "src", "TwFonts.cpp")
+text = open(source).read()
+
+width = int(re.search(r"FONTFIXED1_BM_W = (\d+);", text).group(1))
+height = int(re.search(r"FONTFIXED1_BM_H = (\d+);", text).group(1))
+body = text[text.index("s_FontFixed1[] = {"):]
+body = body[body.index("{") + 1:body.index("};")]
+bitmap = [int(value) for value in body.replace("\n", "").split(",") if value.strip()]
+assert len(bitmap) == width * height
+
+
+def pixel(x, y):
+    return bitmap[y * width + x]
+
+
+# Same layout as TwGenerateFont(): a zero in the first column ends a line of characters,
+# a zero in the last row of a line ends a character.
+glyph_height = 0
+while pixel(0, glyph_height) != 0:
+    glyph_height += 1
+
+glyphs = {}
+character = 32
+for line in range(height // (glyph_height + 1)):
+    top = line * (glyph_height + 1)
+    start = 1
+    for x in range(1, width):
+        if pixel(x, top + glyph_height) == 0 or x == width - 1:
+            if x == start:
+                break
+            glyphs[character] = [[pixel(gx, top + gy) for gx in range(start, x)] for gy in range(glyph_height)]
+            character += 1
+            start = x + 1
+
+atlas_width = 16 * CELL_WIDTH
+atlas_height = 16 * CELL_HEIGHT
+atlas = [[0] * atlas_width for _ in range(atlas_height)]
+for character, rows in glyphs.items():
+    left = (character % 16) * CELL_WIDTH
+    top = (character // 16) * CELL_HEIGHT
+    for gy, row in enumerate(rows[:CELL_HEIGHT]):
+        for gx, value in enumerate(row[:CELL_WIDTH]):
+            atlas[top + gy][left + gx] = min(255, value * 2)
+
+# 24-bit BMP, rows stored bottom-up
+image = bytearray()
+for row in reversed(atlas):
+    for value in row:
+        image += bytes((value, value, value))
+
+header = b"BM" + struct.pack("<IHHI", 54 + len(image), 0, 0, 54)
+info = struct.pack("<IiiHHIIiiII", 40, atlas_width, atlas_height, 1, 24, 0, len(image), 2835, 2835, 0, 0)
+with open(os.path.join(here, "font.bmp"), "wb") as output:
+    output.write(header + info + image)
+
+print("font.bmp: %d glyphs of %d x %d pixels" % (len(glyphs), CELL_WIDTH, glyph_height))
@@ -0,0 +1,8 @@
+#version 330 core
+
+// Only rasterized for occlusion queries, color writes are disabled
+layout(location = 0) out vec3 color;
+
+void main(){
+	color = vec3(1.0, 0.0, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+// Corner of the unit cube, stretched over the box of the instance
+layout(location = 0) in vec3 corner;
+
+uniform mat4 viewProjection;
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+void main(){
+	gl_Position =  viewProjection * vec4(mix(boxMin, boxMax, corner),1);
+}
@@ -3,10 +3,33 @@
 // Input vertex data, different for all executions of this shader.
 layout(location = 0) in vec3 vertexPosition_modelspace;
 
-// Values that stay constant for the whole mesh.
-uniform mat4 depthMVP;
+// Model matrix of the instance (see SCENE_INSTANCE_ATTRIBUTE in common/scene.hpp)
+layout(location = 3) in mat4 instanceModel;
+
+// Per-frame environment and camera state, one uniform buffer shared by all programs.
+// Keep in sync with EnvironmentBlock (common/environment.hpp).
+layout(std140) uniform Environment {
+	mat4 MVP;
+	mat4 V;
+	mat4 M;
+	mat4 DepthBiasMVP;
+	mat4 depthMVP;
+	vec3 LightInvDirection_worldspace[6];
+	vec3 sun_color;
+	float distortion_scalar;
+	vec3 snow_color;
+	float snow_amount;
+	float light_intensity;
+	int numLights;
+	float snow_displacement;
+	float wind_exposure;
+	ivec4 cluster_grid;
+	vec4 cluster_params;
+	mat4 sun_shadow_matrices[4];
+	vec4 sun_cascade_splits;
+};
 
 void main(){
-	gl_Position =  depthMVP * vec4(vertexPosition_modelspace,1);
+	gl_Position =  depthMVP * instanceModel * vec4(vertexPosition_modelspace,1);
 }
 
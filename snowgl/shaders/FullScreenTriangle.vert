@@ -0,0 +1,12 @@
+#version 330 core
+
+// Output data ; will be interpolated for each fragment.
+out vec2 UV;
+
+void main(){
+
+	// One triangle covering the whole map, built from the vertex index alone
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	UV = corner;
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
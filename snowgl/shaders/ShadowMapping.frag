@@ -1,28 +1,88 @@
 #version 330 core
 
+// Variant of the program, defined by ShaderPermutations (common/shader.hpp):
+// LIGHT_COUNT lights are shaded, SHADOW_TAPS occlusion map taps where the exposure isn't baked,
+// DEBUG_VIEW 1 shows the visibility and 2 the inclination instead of the snow, WIND_EXPOSURE reads the wind exposure map,
+// CLUSTERED_LIGHTS adds the point and spot lights of the fragment's cluster, SUN_SHADOWS shadows the sun with SUN_CASCADES cascades.
+// OCCLUSION_TAP_SPREAD and OCCLUSION_DEPTH_BIAS come from common/global.hpp, the exposure bake (common/exposure_bake.cpp) uses them too.
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 1
+#endif
+#ifndef SHADOW_TAPS
+#define SHADOW_TAPS 4
+#endif
+#ifndef DEBUG_VIEW
+#define DEBUG_VIEW 0
+#endif
+#ifndef WIND_EXPOSURE
+#define WIND_EXPOSURE 0
+#endif
+#ifndef CLUSTERED_LIGHTS
+#define CLUSTERED_LIGHTS 0
+#endif
+#ifndef SUN_SHADOWS
+#define SUN_SHADOWS 0
+#endif
+#ifndef SUN_CASCADES
+#define SUN_CASCADES 4
+#endif
+#ifndef OCCLUSION_TAP_SPREAD
+#define OCCLUSION_TAP_SPREAD 700
+#endif
+#ifndef OCCLUSION_DEPTH_BIAS
+#define OCCLUSION_DEPTH_BIAS 0.005
+#endif
+
 // Interpolated values from the vertex shaders
 in vec2 UV;
 in vec3 Position_worldspace;
 in vec3 Normal_cameraspace;
 in vec3 Normal_modelspace;
 in vec3 EyeDirection_cameraspace;
-in vec3 LightDirection_cameraspace[6];
+in vec3 LightDirection_cameraspace[LIGHT_COUNT];
 in vec4 ShadowCoord;
+in vec3 Exposure;
 
 // Output data
 layout(location = 0) out vec3 color;
 
 uniform sampler2D myTextureSampler;
-uniform mat4 MV;
-uniform vec3 LightPosition_worldspace;
 uniform sampler2DShadow shadowMap;
-uniform int numLights;
-uniform vec3 snow_color;
-uniform vec3 distortion_scalar;
 
-uniform float snow_amount;
-uniform float light_intensity;
-uniform vec3 sun_color;
+// Fraction of the snowfall reaching the top surface through the cone of wind directions (see common/wind_exposure.hpp)
+uniform sampler2D windExposureMap;
+
+// Local lights sorted into the clusters of the view frustum (see common/clustered_lights.hpp):
+// (first index, light count) per cluster, the light indices, and three texels per light in camera space
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLightIndices;
+uniform samplerBuffer clusterLights;
+
+// Depth maps of the sun, one layer per cascade (see common/sun_shadow.hpp)
+uniform sampler2DArrayShadow sunShadowMap;
+
+// Per-frame environment and camera state, one uniform buffer shared by all programs.
+// Keep in sync with EnvironmentBlock (common/environment.hpp).
+layout(std140) uniform Environment {
+	mat4 MVP;
+	mat4 V;
+	mat4 M;
+	mat4 DepthBiasMVP;
+	mat4 depthMVP;
+	vec3 LightInvDirection_worldspace[6];
+	vec3 sun_color;
+	float distortion_scalar;
+	vec3 snow_color;
+	float snow_amount;
+	float light_intensity;
+	int numLights;
+	float snow_displacement;
+	float wind_exposure;
+	ivec4 cluster_grid;
+	vec4 cluster_params;
+	mat4 sun_shadow_matrices[4];
+	vec4 sun_cascade_splits;
+};
 
 vec2 poissonDisk[16] = vec2[]( 
    vec2( -0.94201624, -0.39906216 ), 
@@ -125,6 +185,84 @@ vec3 visibilityColorMapping(float visibility) {
 	else 					 	   {	return vec3(0.8, 0.6, 1.0);		}	// Violet
 }
 
+/**
+ * Computes how much of the sun reaches a fragment.
+ *
+ * The cascade is chosen by the view depth of the fragment, the hardware compares 2x2 texels of its depth
+ * map. Fragments past the last cascade are fully lit.
+ *
+ * @return float 1 in full sunlight, 0 in the shadow.
+ */
+
+float sunVisibility(){
+
+#if SUN_SHADOWS
+	float depth = EyeDirection_cameraspace.z;
+	for (int c = 0; c < SUN_CASCADES; c++) {
+		if (depth < sun_cascade_splits[c]) {
+			vec4 coord = sun_shadow_matrices[c] * vec4(Position_worldspace, 1.0);
+			return texture(sunShadowMap, vec4(coord.xy, c, coord.z));
+		}
+	}
+#endif
+	return 1.0;
+}
+
+/**
+ * Computes the diffuse and specular light of the point and spot lights reaching a fragment.
+ *
+ * The fragment finds its cluster from its pixel and its depth, and only shades the lights sorted into it.
+ * Each light fades out smoothly to its radius, with an inverse square falloff, and a spot light also
+ * fades out between its inner and outer cones. Local lights cast no shadow.
+ *
+ * @param diffuseColor The diffuse color of the material.
+ * @param specularColor The specular color of the material.
+ * @param specularExponent The specular exponent of the material.
+ * @param n The normalized normal of the fragment, in camera space.
+ *
+ * @return vec3 The light of all the local lights.
+ */
+
+vec3 localLighting(vec3 diffuseColor, vec3 specularColor, float specularExponent, vec3 n){
+
+	vec3 color = vec3(0.0);
+#if CLUSTERED_LIGHTS
+	vec3 position = -EyeDirection_cameraspace;
+	vec3 E = normalize(EyeDirection_cameraspace);
+
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / cluster_params.xy), cluster_grid.xy - 1);
+	int slice = clamp(int(log(-position.z) * cluster_params.z + cluster_params.w), 0, cluster_grid.z - 1);
+	uvec2 cluster = texelFetch(clusterGrid, (slice * cluster_grid.y + tile.y) * cluster_grid.x + tile.x).rg;
+
+	for (uint i = 0u; i < cluster.y; i++) {
+		int light = int(texelFetch(clusterLightIndices, int(cluster.x + i)).r) * 3;
+		vec4 positionRadius = texelFetch(clusterLights, light);
+		vec4 colorInner = texelFetch(clusterLights, light + 1);
+		vec4 directionOuter = texelFetch(clusterLights, light + 2);
+
+		vec3 toLight = positionRadius.xyz - position;
+		float lightDistance = length(toLight);
+		if (lightDistance >= positionRadius.w) {
+			continue;
+		}
+		vec3 l = toLight / lightDistance;
+
+		// Inverse square falloff, windowed to reach 0 at the radius
+		float window = clamp(1.0 - pow(lightDistance / positionRadius.w, 4.0), 0.0, 1.0);
+		float attenuation = window * window / (lightDistance * lightDistance + 1.0);
+		if (directionOuter.w > -1.0) {
+			attenuation *= smoothstep(directionOuter.w, colorInner.w, dot(-l, directionOuter.xyz));
+		}
+
+		float cosTheta = clamp(dot(n, l), 0.0, 1.0);
+		float cosAlpha = clamp(dot(E, reflect(-l, n)), 0.0, 1.0);
+		vec3 lightColor = colorInner.rgb * attenuation;
+		color += diffuseColor * lightColor * cosTheta + specularColor * lightColor * pow(cosAlpha, specularExponent);
+	}
+#endif
+	return color;
+}
+
 /**
  * Computes the color of an object based on its material properties and lighting, without any snow effect.
  *
@@ -141,10 +279,12 @@ vec3 visibilityColorMapping(float visibility) {
  * Material and light properties such as color, intensity, and specular exponent are used to determine 
  * the appearance of the object under lighting.
  *
+ * @param sun The visibility of the sun, the first light.
+ *
  * @return vec3 The computed RGB color of the object under the given lighting conditions.
  */
  
- vec3 objectColor(){
+ vec3 objectColor(float sun){
 
 	// Light emission properties
 	vec3 LightColor = sun_color;
@@ -152,7 +292,7 @@ vec3 visibilityColorMapping(float visibility) {
 
 	// Material properties
 	vec3 MaterialDiffuseColor = texture(myTextureSampler, UV).rgb;
-	vec3 MaterialAmbientColor = vec3(0.05, 0.05, 0.05) * MaterialDiffuseColor;
+	vec3 MaterialAmbientColor = vec3(0.30, 0.30, 0.30) * MaterialDiffuseColor;
 	vec3 MaterialSpecularColor = vec3(0.5, 0.5, 0.5);
 	float MaterialSpecularExponent = 150.0f;
 
@@ -162,9 +302,9 @@ vec3 visibilityColorMapping(float visibility) {
 	// Eye vector (towards the camera)
 	vec3 E = normalize(EyeDirection_cameraspace);
 
-	// Calculate color contribution from each light
-	vec3 color = vec3(0.0);
-	for (int i = 0; i < numLights; i++) {
+	// The ambient light comes from the whole sky, once. Then the contribution of each light.
+	vec3 color = MaterialAmbientColor;
+	for (int i = 0; i < LIGHT_COUNT; i++) {
 
 		// Direction of the light (from the fragment to the light)
 		vec3 l = normalize(LightDirection_cameraspace[i]);
@@ -178,15 +318,15 @@ vec3 visibilityColorMapping(float visibility) {
 		// Cosine of the angle between the Eye vector and the Reflect vector
 		float cosAlpha = clamp(dot(E, R), 0.0, 1.0);
 
-		// Calculate Ambient, Diffuse, and Specular components
-		vec3 Ambient = MaterialAmbientColor;
+		// Calculate Diffuse and Specular components
 		vec3 Diffuse = MaterialDiffuseColor * LightColor * LightPower * cosTheta;
 		vec3 Specular = MaterialSpecularColor * LightColor * LightPower * pow(cosAlpha, MaterialSpecularExponent);
 
-		// Accumulate contributions from each light
-		color += Ambient + Diffuse + Specular;
+		// Accumulate contributions from each light, the sun only where it isn't shadowed
+		color += (Diffuse + Specular) * (i == 0 ? sun : 1.0);
 	}
 
+	color += localLighting(MaterialDiffuseColor, MaterialSpecularColor, MaterialSpecularExponent, n);
 	return color;
 }
 
@@ -207,10 +347,12 @@ vec3 visibilityColorMapping(float visibility) {
  * Material and light properties such as color, intensity, and specular exponent are used to determine 
  * the appearance of the snow under lighting conditions.
  *
+ * @param sun The visibility of the sun, the first light.
+ *
  * @return vec3 The computed RGB color of the snow under the given lighting conditions.
  */
  
- vec3 snowColor(){
+ vec3 snowColor(float sun){
 
 	vec3 LightColor = sun_color;
 	float LightPower = light_intensity;
@@ -221,30 +363,31 @@ vec3 visibilityColorMapping(float visibility) {
 	//vec3 SnowDiffuseColor = snow_color;
 	vec3 SnowDiffuseColor = vec3(0.9375, 0.9375, 1.0000);
 
-	vec3 SnowAmbientColor = vec3(0.10, 0.10, 0.10) * SnowDiffuseColor;
+	vec3 SnowAmbientColor = vec3(0.60, 0.60, 0.60) * SnowDiffuseColor;
 	vec3 SnowSpecularColor = vec3(0.2, 0.2, 0.2);
 	float SnowSpecularExponent = 25.0f;
 
-	// Calculate color contribution from each light
-	vec3 color = vec3(0.0);
-	for (int i = 0; i < numLights; i++) {
+	// Distorted normal
+	vec3 n = normalize(Normal_cameraspace + distortion_scalar * random(Normal_modelspace, 1));
+	vec3 E = normalize(EyeDirection_cameraspace);
+
+	// The ambient light comes from the whole sky, once. Then the contribution of each light.
+	vec3 color = SnowAmbientColor;
+	for (int i = 0; i < LIGHT_COUNT; i++) {
 
-		// Distorted normal
-		vec3 n = normalize(Normal_cameraspace + distortion_scalar * random(Normal_modelspace, 1));
 		vec3 l = normalize(LightDirection_cameraspace[i]);
 		float cosTheta = clamp(dot(n, l), 0.0, 1.0);
 
-		vec3 E = normalize(EyeDirection_cameraspace);
 		vec3 R = reflect(-l, n);
 		float cosAlpha = clamp(dot(E, R), 0.0, 1.0);
 
-		// Calculate Ambient, Diffuse, and Specular components
-		vec3 Ambient = SnowAmbientColor;
+		// Calculate Diffuse and Specular components
 		vec3 Diffuse = SnowDiffuseColor * LightColor * LightPower * cosTheta;
 		vec3 Specular = SnowSpecularColor * LightColor * LightPower * pow(cosAlpha, SnowSpecularExponent);
-		color += Ambient + Diffuse + Specular;
+		color += (Diffuse + Specular) * (i == 0 ? sun : 1.0);
 	}
 
+	color += localLighting(SnowDiffuseColor, SnowSpecularColor, SnowSpecularExponent, n);
 	return color;
 }
 
@@ -286,8 +429,9 @@ vec3 visibilityColorMapping(float visibility) {
  * Main function for fragment shader to calculate the final color of a fragment with potential snow accumulation.
  *
  * This function performs multiple tasks:
- * - It samples the shadow map multiple times to determine the visibility of the fragment under
- *   consideration, taking into account potential shadowing from multiple light sources.
+ * - It reads the visibility of the fragment baked at the vertices (see common/exposure_bake.hpp). Where
+ *   the vertices can't hold it (Exposure.z > 0, or meshes without a baked exposure), it samples the shadow
+ *   map multiple times instead. With wind, only the part of it the cone of snowfall directions reaches is kept.
  * - It calculates the snow accumulation prediction using three factors:
  *   - f_e: The exposure component based on visibility from shadow calculations.
  *   - f_inc: The inclination function that estimates how much snow can accumulate based on the 
@@ -305,40 +449,62 @@ vec3 visibilityColorMapping(float visibility) {
 
 void main(){
 
-	float bias = 0.005;
-	float visibility = 1.0;
-
-	// Sample the shadow map 4 times
-	for (int i=0; i<4; i++){
-		float in_shadow = texture(
-			shadowMap, 
-			vec3(ShadowCoord.xy + poissonDisk[i] / 700.0, (ShadowCoord.z - bias) / ShadowCoord.w)
-		);
-		
-		visibility -= 0.25 * (1.0 - in_shadow);
+	float visibility = Exposure.x;
+	float inclination = Exposure.y;
+
+	if (Exposure.z > 0.0) {
+		float bias = OCCLUSION_DEPTH_BIAS;
+		visibility = 1.0;
+
+		// Sample the shadow map SHADOW_TAPS times
+		for (int i=0; i<SHADOW_TAPS; i++){
+			float in_shadow = texture(
+				shadowMap, 
+				vec3(ShadowCoord.xy + poissonDisk[i] / float(OCCLUSION_TAP_SPREAD), (ShadowCoord.z - bias) / ShadowCoord.w)
+			);
+			
+			visibility -= (1.0 / SHADOW_TAPS) * (1.0 - in_shadow);
+		}
+
+		inclination = inclication(Normal_modelspace);
 	}
 
+	// The snow blown by the wind reaches only a part of the top surface: exposed / tested directions
+#if WIND_EXPOSURE
+	vec2 wind = texture(windExposureMap, ShadowCoord.xy / ShadowCoord.w).rg;
+	visibility *= (wind.y > 0.0) ? wind.x / wind.y : 1.0;
+#endif
+
+#if DEBUG_VIEW == 1
+
+	// Visibility/color mapping
+	color = visibilityColorMapping(visibility);
+
+#elif DEBUG_VIEW == 2
+
+	// Angle/color mapping
+	color = angleColorMapping(dot(normalize(Normal_modelspace), vec3(0, 0, 1)));
+
+#else
+
 	// f_e: The exposure component. f_inc: The inclication function. 
 	// f_u: a user-defined function to customize/manipulate the snow effect.
 	// It can be any function, but the range of it must in [0, 1]
 	float f_e = visibility;
-	float f_inc = inclication(Normal_modelspace);
+	float f_inc = inclination;
 	float f_u = snow_amount;
 
 	// Snow accumulation prediction function f_p = f_e * f_inc * f_u
 	float f_p = f_e * f_inc * f_u;
 
 	// c_s: The snow color. c_o: The object color without snow
-	vec3 c_s = snowColor();
-	vec3 c_o = objectColor();
+	float sun = sunVisibility();
+	vec3 c_s = snowColor(sun);
+	vec3 c_o = objectColor(sun);
 
 	// The Full snow equation is the blend of those two colors. 
 	// i,e,, C = c_s * f_p + c_o * (1 - f_p)
 	color = c_s * f_p + c_o * (1.00 - f_p);
 
-	// To get the visibility/color mapping, uncomment the following line of code.
-	// color = visibilityColorMapping(visibility);
-
-	// To get the angle/color mapping, uncomment the following line of code.
-	// color = angleColorMapping(dot(normalize(Normal_modelspace), vec3(0, 0, 1)));
+#endif
 }
\ No newline at end of file
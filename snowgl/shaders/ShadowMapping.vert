@@ -1,10 +1,30 @@
 #version 330 core
 
+// Variant of the program, defined by ShaderPermutations (common/shader.hpp). The defaults are a single light and no snow layer.
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 1
+#endif
+#ifndef DAYTIME_SIMULATION
+#define DAYTIME_SIMULATION 0
+#endif
+#ifndef SNOW_DEPTH_MAP
+#define SNOW_DEPTH_MAP 0
+#endif
+#ifndef OCCLUSION_DEPTH_BIAS
+#define OCCLUSION_DEPTH_BIAS 0.005
+#endif
+
 // Input vertex data, different for all executions of this shader.
 layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec2 vertexUV;
 layout(location = 2) in vec3 vertexNormal_modelspace;
 
+// Model matrix of the instance (see SCENE_INSTANCE_ATTRIBUTE in common/scene.hpp)
+layout(location = 3) in mat4 instanceModel;
+
+// Baked exposure, inclination, and 1 where the shader evaluates them itself (see SCENE_EXPOSURE_ATTRIBUTE in common/scene.hpp)
+layout(location = 7) in vec3 vertexExposure;
+
 // Output data ; will be interpolated for each fragment.
 out vec2 UV;
 out vec3 Position_worldspace;
@@ -12,41 +32,76 @@ out vec3 Normal_cameraspace;
 out vec3 Normal_modelspace;
 
 out vec3 EyeDirection_cameraspace;
-out vec3 LightDirection_cameraspace[6];
+out vec3 LightDirection_cameraspace[LIGHT_COUNT];
 out vec4 ShadowCoord;
+out vec3 Exposure;
 
-// Values that stay constant for the whole mesh.
-uniform mat4 MVP;
-uniform mat4 V;
-uniform mat4 M;
+// Occlusion map, and the snow depth lying on the scene in the same coordinates (see common/snow_depth.hpp)
+uniform sampler2DShadow shadowMap;
+uniform sampler2D snowDepthMap;
 
-uniform int numLights;
-uniform vec3 LightInvDirection_worldspace[6];
-uniform mat4 DepthBiasMVP;
+// Per-frame environment and camera state, one uniform buffer shared by all programs.
+// Keep in sync with EnvironmentBlock (common/environment.hpp).
+layout(std140) uniform Environment {
+	mat4 MVP;
+	mat4 V;
+	mat4 M;
+	mat4 DepthBiasMVP;
+	mat4 depthMVP;
+	vec3 LightInvDirection_worldspace[6];
+	vec3 sun_color;
+	float distortion_scalar;
+	vec3 snow_color;
+	float snow_amount;
+	float light_intensity;
+	int numLights;
+	float snow_displacement;
+	float wind_exposure;
+	ivec4 cluster_grid;
+	vec4 cluster_params;
+	mat4 sun_shadow_matrices[4];
+	vec4 sun_cascade_splits;
+};
 
 void main(){
 
+	// Position and normal of the vertex once the instance is placed in the scene
+	vec4 position = instanceModel * vec4(vertexPosition_modelspace,1);
+	vec3 normal = mat3(instanceModel) * vertexNormal_modelspace;
+
+	// The occlusion is tested with the bare surface, the snow lies on top of it
+	ShadowCoord = DepthBiasMVP * position;
+
+	// Vertices exposed to the snowfall are raised by the snow lying there. The snow depth is measured
+	// vertically, so vertices sharing a position (on either side of a crease) move together.
+#if SNOW_DEPTH_MAP && DAYTIME_SIMULATION
+	float exposed = texture(shadowMap, vec3(ShadowCoord.xy, (ShadowCoord.z - OCCLUSION_DEPTH_BIAS) / ShadowCoord.w));
+	float snow_depth = texture(snowDepthMap, ShadowCoord.xy).r;
+	position.z += snow_displacement * snow_depth * exposed;
+#endif
+
 	// Output position of the vertex, in clip space : MVP * position
-	gl_Position =  MVP * vec4(vertexPosition_modelspace,1);
-	
-	ShadowCoord = DepthBiasMVP * vec4(vertexPosition_modelspace,1);
+	gl_Position =  MVP * position;
 	
 	// Position of the vertex, in worldspace : M * position
-	Position_worldspace = (M * vec4(vertexPosition_modelspace,1)).xyz;
+	Position_worldspace = (M * position).xyz;
 	
 	// Vector that goes from the vertex to the camera, in camera space.
 	// In camera space, the camera is at the origin (0, 0, 0).
-	EyeDirection_cameraspace = vec3(0, 0, 0) - ( V * M * vec4(vertexPosition_modelspace,1)).xyz;
+	EyeDirection_cameraspace = vec3(0, 0, 0) - ( V * M * position).xyz;
 
 	// Vector that goes from the vertex to the light, in camera space
-	for(int i = 0; i < numLights; i++) {
-    	LightDirection_cameraspace[i] = (V * vec4(LightInvDirection_worldspace[i], 0.0)).xyz;
-    }
+	for(int i = 0; i < LIGHT_COUNT; i++) {
+		LightDirection_cameraspace[i] = (V * vec4(LightInvDirection_worldspace[i], 0.0)).xyz;
+	}
 	
 	// Normal of the the vertex, in both camera space and modelspace.
-	Normal_cameraspace = ( V * M * vec4(vertexNormal_modelspace,0)).xyz;
-	Normal_modelspace = vertexNormal_modelspace;
+	// The instance rotation is included so the snow settles on what faces up in the scene.
+	Normal_cameraspace = ( V * M * vec4(normal,0)).xyz;
+	Normal_modelspace = normal;
 
 	// UV of the vertex. No special space for this one.
 	UV = vertexUV;
+
+	Exposure = vertexExposure;
 }
\ No newline at end of file
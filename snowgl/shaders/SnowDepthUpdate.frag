@@ -0,0 +1,49 @@
+#version 330 core
+
+// Interpolated values from the vertex shaders
+in vec2 UV;
+
+// Output data
+layout(location = 0) out float depth;
+
+// Snow depth before this time step, in scene units
+uniform sampler2D previousDepth;
+
+// Depth of the occlusion map (the top surface of the scene, seen from the snowfall), without comparison
+uniform sampler2D occlusionMap;
+
+// Size of the orthographic box of the occlusion map, in scene units
+uniform vec3 occlusionExtent;
+
+// Snow falling on a flat texel during this time step, and snow melting everywhere
+uniform float accumulation;
+uniform float melt;
+uniform float maxDepth;
+
+/**
+ * Advances the snow depth of a texel by one time step.
+ *
+ * The snow falling on the texel lands on the top surface of the scene, the first one the occlusion map
+ * sees. Flat surfaces hold all of it, steep ones less: the slope is measured with the depths of the
+ * neighbouring texels, and the accumulation is scaled by its cosine (0 across the silhouette of an object).
+ * Texels without any surface below them keep no snow.
+ */
+
+void main(){
+
+	float previous = texture(previousDepth, UV).r;
+	float surface = texture(occlusionMap, UV).r;
+	if (surface >= 1.0) {
+		depth = 0.0;
+		return;
+	}
+
+	// Height difference between the neighbours, over their horizontal distance
+	vec2 texel = 1.0 / vec2(textureSize(occlusionMap, 0));
+	float dx = texture(occlusionMap, UV + vec2(texel.x, 0.0)).r - texture(occlusionMap, UV - vec2(texel.x, 0.0)).r;
+	float dy = texture(occlusionMap, UV + vec2(0.0, texel.y)).r - texture(occlusionMap, UV - vec2(0.0, texel.y)).r;
+	vec2 slope = vec2(dx, dy) * occlusionExtent.z / (2.0 * texel * occlusionExtent.xy);
+	float flatness = inversesqrt(1.0 + dot(slope, slope));
+
+	depth = clamp(previous + accumulation * flatness - melt, 0.0, maxDepth);
+}
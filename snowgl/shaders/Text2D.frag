@@ -0,0 +1,17 @@
+#version 330 core
+
+// Interpolated values from the vertex shaders
+in vec2 UV;
+
+// Output data
+layout(location = 0) out vec4 color;
+
+// Values that stay constant for the whole mesh.
+uniform sampler2D fontSampler;
+uniform vec3 textColor;
+
+void main(){
+
+	// The atlas is grey, any channel holds the coverage of the glyph
+	color = vec4(textColor, texture(fontSampler, UV).r);
+}
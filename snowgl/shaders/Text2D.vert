@@ -0,0 +1,24 @@
+#version 330 core
+
+// Corner of the glyph quad, from (0,0) to (1,1), the same for all glyphs.
+layout(location = 0) in vec2 vertexCorner;
+
+// Per-glyph data: top-left corner in pixels, glyph height in pixels, character code.
+layout(location = 1) in vec4 glyph;
+
+// Output data ; will be interpolated for each fragment.
+out vec2 UV;
+
+// Size of the screen the pixel coordinates refer to.
+uniform vec2 screenSize;
+
+void main(){
+
+	// Glyphs are half as wide as they are high, pixel y goes down
+	vec2 pixel = glyph.xy + vertexCorner * vec2(glyph.z * 0.5, glyph.z);
+	gl_Position = vec4(pixel.x / screenSize.x * 2.0 - 1.0, 1.0 - pixel.y / screenSize.y * 2.0, 0, 1);
+
+	// Cell of the character in the 16 x 16 atlas, BMP rows are stored bottom-up
+	vec2 cell = vec2(mod(glyph.w, 16.0), floor(glyph.w / 16.0));
+	UV = vec2((cell.x + vertexCorner.x) / 16.0, 1.0 - (cell.y + vertexCorner.y) / 16.0);
+}
@@ -0,0 +1,36 @@
+#version 330 core
+
+// Interpolated values from the vertex shaders
+in vec2 UV;
+
+// Output data, added to the exposure map: x = 1 if this direction sees the texel, y = 1 for every tested direction
+layout(location = 0) out vec2 exposure;
+
+// Depth of the occlusion map (the top surface of the scene, seen from above), without comparison
+uniform sampler2D occlusionMap;
+
+// Depth map of the scene seen from one direction of the cone
+uniform sampler2DShadow directionMap;
+
+// From the occlusion map coordinates (UV, depth) to the direction map coordinates, depth bias included
+uniform mat4 occlusionToDirection;
+
+/**
+ * Tests whether the snow falling from one direction reaches the top surface of a texel.
+ *
+ * The point of the top surface is rebuilt from the occlusion map, then compared with the depth map of the
+ * direction like the shading pass compares a fragment with the occlusion map. Texels without any
+ * surface are not tested: they keep the full exposure.
+ */
+
+void main(){
+
+	float surface = texture(occlusionMap, UV).r;
+	if (surface >= 1.0) {
+		exposure = vec2(0.0);
+		return;
+	}
+
+	vec4 point = occlusionToDirection * vec4(UV, surface, 1.0);
+	exposure = vec2(texture(directionMap, point.xyz / point.w), 1.0);
+}
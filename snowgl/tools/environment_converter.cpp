@@ -0,0 +1,47 @@
+// Offline environment converter: turns the CSV written by day_time_simulator.py into the binary columns SnowGL maps.
+//
+//   EnvironmentConverter input.csv [output.envtable]
+//
+// The output defaults to input.csv.envtable, the table SnowGL looks for next to DATA_LOCATION. SnowGL writes it
+// too on the first launch after the CSV changes, the converter only saves that parse for long series.
+
+#include <stdio.h>
+#include <string>
+#include <chrono>
+
+#include <common/csv_reader.hpp>
+#include <common/environment_table.hpp>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char * argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s input.csv [output%s]\n", argv[0], ENVIRONMENT_TABLE_EXTENSION);
+		return 1;
+	}
+	std::string tablePath = (argc > 2) ? argv[2] : std::string(argv[1]) + ENVIRONMENT_TABLE_EXTENSION;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	csv_reader reader(argv[1]);
+	if (!reader.read_csv()) {
+		return 1;
+	}
+	double parseSeconds = secondsSince(start);
+	if (!writeEnvironmentTable(tablePath.c_str(), argv[1], reader.getData())) {
+		return 1;
+	}
+
+	// Time the way back, as SnowGL opens it
+	start = std::chrono::steady_clock::now();
+	EnvironmentTable table;
+	if (!table.open(tablePath.c_str(), argv[1]) || table.getData().size() != reader.getData().size()) {
+		fprintf(stderr, "%s could not be read back.\n", tablePath.c_str());
+		return 1;
+	}
+	double openSeconds = secondsSince(start);
+
+	printf("%s : %zu rows, parsed in %.1f ms, mapped in %.3f ms\n", tablePath.c_str(), reader.getData().size(), parseSeconds * 1000.0, openSeconds * 1000.0);
+	return 0;
+}
@@ -0,0 +1,162 @@
+// Offline texture converter: compresses a BMP into a DDS file with its whole mip chain, ready for loadDDS.
+//
+//   TextureConverter input.bmp output.dds [bc1|bc3|bc7]
+//
+// BC1 (the default) is written with the DXT1 FourCC and BC3 with DXT5, BC7 needs the DX10 extension header.
+// The rows are stored from the top like every DDS file, which is what the V flip of the OBJ loaders expects.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include <common/image.hpp>
+#include <common/bcn_encoder.hpp>
+
+// dwFlags of the DDS header
+#define DDSD_CAPS					0x1
+#define DDSD_HEIGHT					0x2
+#define DDSD_WIDTH					0x4
+#define DDSD_PIXELFORMAT			0x1000
+#define DDSD_MIPMAPCOUNT			0x20000
+#define DDSD_LINEARSIZE				0x80000
+#define DDPF_FOURCC					0x4
+#define DDSCAPS_COMPLEX				0x8
+#define DDSCAPS_TEXTURE				0x1000
+#define DDSCAPS_MIPMAP				0x400000
+
+#define DXGI_FORMAT_BC7_UNORM		98
+#define D3D10_RESOURCE_TEXTURE2D	3
+
+static void putU32(unsigned char * p, uint32_t value) {
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+	p[2] = (value >> 16) & 0xFF;
+	p[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t fourCC(const char * code) {
+	return code[0] | (code[1] << 8) | (code[2] << 16) | ((uint32_t)code[3] << 24);
+}
+
+static bool writeDDS(const char * path, BlockFormat format, int width, int height, const std::vector<std::vector<unsigned char>> & levels) {
+	unsigned char header[4 + 124 + 20] = {};
+	memcpy(header, "DDS ", 4);
+	unsigned char * surface = header + 4;
+	putU32(surface + 0, 124);
+	putU32(surface + 4, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+	putU32(surface + 8, height);
+	putU32(surface + 12, width);
+	putU32(surface + 16, (uint32_t)levels[0].size());
+	putU32(surface + 24, (uint32_t)levels.size());
+	putU32(surface + 72, 32);
+	putU32(surface + 76, DDPF_FOURCC);
+	putU32(surface + 80, fourCC(format == BlockFormat::BC1 ? "DXT1" : format == BlockFormat::BC3 ? "DXT5" : "DX10"));
+	putU32(surface + 104, DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+	size_t headerSize = 4 + 124;
+	if (format == BlockFormat::BC7) {
+		unsigned char * extension = header + headerSize;
+		putU32(extension + 0, DXGI_FORMAT_BC7_UNORM);
+		putU32(extension + 4, D3D10_RESOURCE_TEXTURE2D);
+		putU32(extension + 12, 1);	// Array size
+		headerSize += 20;
+	}
+
+	// Written next to the output then renamed, a failed conversion doesn't leave a truncated texture behind
+	std::string temporary = std::string(path) + ".tmp";
+	FILE * file = fopen(temporary.c_str(), "wb");
+	if (file == NULL) {
+		fprintf(stderr, "%s could not be created.\n", temporary.c_str());
+		return false;
+	}
+	bool written = fwrite(header, 1, headerSize, file) == headerSize;
+	for (size_t level = 0; written && level < levels.size(); level++) {
+		written = fwrite(levels[level].data(), 1, levels[level].size(), file) == levels[level].size();
+	}
+	if (fclose(file) != 0 || !written) {
+		fprintf(stderr, "%s could not be written.\n", temporary.c_str());
+		remove(temporary.c_str());
+		return false;
+	}
+	// rename doesn't replace an existing file on Windows
+	remove(path);
+	if (rename(temporary.c_str(), path) != 0) {
+		fprintf(stderr, "%s could not be renamed to %s.\n", temporary.c_str(), path);
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Peak signal to noise ratio of the compressed image, over the channels the format keeps
+static double psnr(const Image & original, const Image & decoded, int channelCount) {
+	double squaredError = 0.0;
+	for (size_t i = 0; i < original.pixels.size(); i++) {
+		if ((int)(i % 4) < channelCount) {
+			double d = (double)original.pixels[i] - decoded.pixels[i];
+			squaredError += d * d;
+		}
+	}
+	double mse = squaredError / ((double)original.width * original.height * channelCount);
+	return (mse > 0.0) ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+int main(int argc, char * argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s input.bmp output.dds [bc1|bc3|bc7]\n", argv[0]);
+		return 1;
+	}
+	BlockFormat format = BlockFormat::BC1;
+	const char * formatName = (argc > 3) ? argv[3] : "bc1";
+	if (strcmp(formatName, "bc1") == 0) {
+		format = BlockFormat::BC1;
+	} else if (strcmp(formatName, "bc3") == 0) {
+		format = BlockFormat::BC3;
+	} else if (strcmp(formatName, "bc7") == 0) {
+		format = BlockFormat::BC7;
+	} else {
+		fprintf(stderr, "Unknown format %s, use bc1, bc3 or bc7.\n", formatName);
+		return 1;
+	}
+
+	Image image;
+	if (!readBMP(argv[1], image)) {
+		return 1;
+	}
+	int width = image.width, height = image.height;
+
+	// Every level down to 1x1, each one filtered from the previous one
+	std::vector<std::vector<unsigned char>> levels;
+	size_t compressedSize = 0, uncompressedSize = 0;
+	double topPSNR = 0.0;
+	while (true) {
+		levels.emplace_back();
+		encodeImage(image, format, levels.back());
+		compressedSize += levels.back().size();
+		uncompressedSize += (size_t)image.width * image.height * 4;
+		if (levels.size() == 1) {
+			Image decoded;
+			if (decodeImage(levels[0].data(), image.width, image.height, format, decoded)) {
+				topPSNR = psnr(image, decoded, (format == BlockFormat::BC1) ? 3 : 4);
+			}
+		}
+		if (image.width == 1 && image.height == 1) {
+			break;
+		}
+		Image half;
+		downsampleImage(image, half);
+		image.width = half.width;
+		image.height = half.height;
+		image.pixels.swap(half.pixels);
+	}
+
+	if (!writeDDS(argv[2], format, width, height, levels)) {
+		return 1;
+	}
+	printf("%s : %dx%d, %zu levels, %s, %.1f KB instead of %.1f KB as RGBA8 (%.1fx), PSNR %.2f dB\n",
+		argv[2], width, height, levels.size(), formatName, compressedSize / 1024.0, uncompressedSize / 1024.0,
+		(double)uncompressedSize / compressedSize, topPSNR);
+	return 0;
+}